@@ -1,10 +1,12 @@
 #include "header/animated_model.h"
 #include "header/stb_image.h"
 #include <iostream>
+#include <algorithm>
+#include <cstring>
 #include <filesystem>
 
 
-AnimatedModel::AnimatedModel(const std::string& path) : texture(0) {
+AnimatedModel::AnimatedModel(const std::string& path) : m_Path(path) {
     loadModel(path);
 }
 
@@ -35,6 +37,8 @@ void AnimatedModel::loadModel(const std::string& path) {
 
     setupMesh();
     loadMaterialTextures(m_scene);
+    computeBoneBounds();
+    updateBounds();
 }
 
 void AnimatedModel::processNode(aiNode* node, const aiScene* scene) {
@@ -94,16 +98,18 @@ void AnimatedModel::processMesh(aiMesh* mesh, const aiScene* scene) {
 }
 
 void AnimatedModel::setupMesh() {
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
+    VAO.create(GL_OBJECT_VERTEX_ARRAY, GPU_MEMORY_MESHES, m_Path.c_str());
+    VBO.create(GL_OBJECT_BUFFER, GPU_MEMORY_MESHES, m_Path.c_str());
+    EBO.create(GL_OBJECT_BUFFER, GPU_MEMORY_MESHES, m_Path.c_str());
     
     glBindVertexArray(VAO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+    VBO.resize(vertices.size() * sizeof(Vertex));
     
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    EBO.resize(indices.size() * sizeof(unsigned int));
     
     // Vertex positions
     glEnableVertexAttribArray(0);
@@ -126,32 +132,146 @@ void AnimatedModel::setupMesh() {
     glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
     
     glBindVertexArray(0);
+
+    // Post-skin buffer: skinned position/normal from skinnedVBO, texcoords still
+    // from the bind-pose VBO, same index buffer
+    skinnedVAO.create(GL_OBJECT_VERTEX_ARRAY, GPU_MEMORY_MESHES, m_Path.c_str());
+    skinnedVBO.create(GL_OBJECT_BUFFER, GPU_MEMORY_MESHES, m_Path.c_str());
+
+    glBindVertexArray(skinnedVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, skinnedVBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(SkinnedVertex), NULL, GL_DYNAMIC_COPY);
+    skinnedVBO.resize(vertices.size() * sizeof(SkinnedVertex));
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, Position));
+
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, Normal));
+
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBindVertexArray(0);
+
+    // Same storage viewed as RGBA32F texels for texelFetch in the fx shaders
+    skinnedTBO.create(GL_OBJECT_TEXTURE, GPU_MEMORY_MESHES, m_Path.c_str());
+    glBindTexture(GL_TEXTURE_BUFFER, skinnedTBO);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, skinnedVBO);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    setupFaceStream();
+}
+
+void AnimatedModel::setupFaceStream() {
+    std::vector<FaceCorner> corners;
+    corners.reserve(indices.size());
+    for (size_t face = 0; face + 2 < indices.size(); face += 3) {
+        for (int corner = 0; corner < 3; corner++) {
+            FaceCorner c;
+            c.FaceIndices[0] = indices[face];
+            c.FaceIndices[1] = indices[face + 1];
+            c.FaceIndices[2] = indices[face + 2];
+            c.FaceIndices[3] = corner;
+            c.TexCoords = vertices[indices[face + corner]].TexCoords;
+            c.Seed = float(face / 3);
+            c.pad = 0.0f;
+            corners.push_back(c);
+        }
+    }
+
+    faceVAO.create(GL_OBJECT_VERTEX_ARRAY, GPU_MEMORY_MESHES, m_Path.c_str());
+    faceVBO.create(GL_OBJECT_BUFFER, GPU_MEMORY_MESHES, m_Path.c_str());
+
+    glBindVertexArray(faceVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, faceVBO);
+    glBufferData(GL_ARRAY_BUFFER, corners.size() * sizeof(FaceCorner), corners.data(), GL_STATIC_DRAW);
+    faceVBO.resize(corners.size() * sizeof(FaceCorner));
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribIPointer(0, 4, GL_INT, sizeof(FaceCorner), (void*)offsetof(FaceCorner, FaceIndices));
+
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(FaceCorner), (void*)offsetof(FaceCorner, TexCoords));
+
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(FaceCorner), (void*)offsetof(FaceCorner, Seed));
+
+    glBindVertexArray(0);
 }
 
 void AnimatedModel::loadTexture(const std::string& filepath) {
-    glGenTextures(1, &texture);
+    texture.create(GL_OBJECT_TEXTURE, GPU_MEMORY_TEXTURES, m_Path.c_str());
     glBindTexture(GL_TEXTURE_2D, texture);
-    
+    std::vector<std::string> paths = { filepath };
+    if (uploadTexture(nullptr, paths) > 0) {
+        makeTextureStreamable(nullptr, paths);
+    } else {
+        std::cout << "Failed to load texture: " << filepath << std::endl;
+    }
+}
+
+size_t AnimatedModel::uploadTexture(const aiTexture* embedded, const std::vector<std::string>& paths,
+                                    std::string* loadedPath) {
+    return uploadTexture(decodeTexture(embedded, paths, loadedPath));
+}
+
+DecodedImage AnimatedModel::decodeTexture(const aiTexture* embedded, const std::vector<std::string>& paths,
+                                          std::string* loadedPath) {
+    unsigned char* data = nullptr;
+    DecodedImage image;
+    // per thread, reloads decode on worker threads
+    stbi_set_flip_vertically_on_load_thread(false);
+    if (embedded) {
+        // mHeight 0: compressed (PNG, JPG inside the FBX), otherwise raw ARGB8888
+        int bytes = embedded->mHeight == 0 ? embedded->mWidth : embedded->mWidth * embedded->mHeight * 4;
+        data = stbi_load_from_memory(reinterpret_cast<unsigned char*>(embedded->pcData), bytes, &image.width,
+                                     &image.height, &image.channels, 0);
+    } else {
+        for (const std::string& path : paths) {
+            data = stbi_load(path.c_str(), &image.width, &image.height, &image.channels, 0);
+            if (data) {
+                if (loadedPath) *loadedPath = path;
+                break;
+            }
+        }
+    }
+    if (data) image.pixels.reset(data, stbi_image_free);
+    return image;
+}
+
+size_t AnimatedModel::uploadTexture(const DecodedImage& image) {
+    if (!image.pixels) return 0;
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    
-    int width, height, nrChannels;
-    stbi_set_flip_vertically_on_load(false);
-    unsigned char* data = stbi_load(filepath.c_str(), &width, &height, &nrChannels, 0);
-    if (data) {
-        GLenum format;
-        if (nrChannels == 1) format = GL_RED;
-        else if (nrChannels == 3) format = GL_RGB;
-        else if (nrChannels == 4) format = GL_RGBA;
-        
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    } else {
-        std::cout << "Failed to load texture: " << filepath << std::endl;
-    }
-    stbi_image_free(data);
+
+    GLenum format = GL_RGBA;
+    if (image.channels == 1) format = GL_RED;
+    else if (image.channels == 2) format = GL_RG;
+    else if (image.channels == 3) format = GL_RGB;
+    glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels.get());
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    size_t bytes = gpu_memory_t::texture_bytes(format, image.width, image.height, 1, true);
+    texture.resize(bytes, format);
+    return bytes;
+}
+
+// An evicted texture is decoded again on a worker thread once it is bound and
+// uploaded by gpuMemory.end_frame(), so embedded sources rely on the importer
+// keeping the scene alive with the model
+void AnimatedModel::makeTextureStreamable(const aiTexture* embedded, const std::vector<std::string>& paths) {
+    gpuMemory.set_streamable(texture, [this, embedded, paths]() {
+        DecodedImage image = decodeTexture(embedded, paths);
+        return texture_upload_t([this, image]() {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            return uploadTexture(image);
+        });
+    });
 }
 
 std::string AnimatedModel::strReplace(std::string str, const std::string& oldStr, const std::string& newStr) {
@@ -178,29 +298,16 @@ void AnimatedModel::loadMaterialTextures(const aiScene* scene) {
             // Check if texture is embedded
             const aiTexture* embeddedTexture = scene->GetEmbeddedTexture(path.c_str());
             
-            glGenTextures(1, &texture);
+            texture.create(GL_OBJECT_TEXTURE, GPU_MEMORY_TEXTURES, m_Path.c_str());
             glBindTexture(GL_TEXTURE_2D, texture);
             
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            
-            unsigned char* data = nullptr;
-            int width, height, nrChannels;
-            stbi_set_flip_vertically_on_load(false);
+            bool loaded = false;
+            std::vector<std::string> paths;
             
             if (embeddedTexture) {
                 // Load embedded texture
-                if (embeddedTexture->mHeight == 0) {
-                    // Compressed texture (e.g. PNG, JPG inside FBX)
-                    data = stbi_load_from_memory(reinterpret_cast<unsigned char*>(embeddedTexture->pcData), embeddedTexture->mWidth, &width, &height, &nrChannels, 0);
-                } else {
-                    // Raw texture data (ARGB8888)
-                    data = stbi_load_from_memory(reinterpret_cast<unsigned char*>(embeddedTexture->pcData), embeddedTexture->mWidth * embeddedTexture->mHeight * 4, &width, &height, &nrChannels, 0);
-                }
-                
-                if (data) std::cout << "Loaded embedded texture from FBX!" << std::endl;
+                loaded = uploadTexture(embeddedTexture, paths) > 0;
+                if (loaded) std::cout << "Loaded embedded texture from FBX!" << std::endl;
             } else {
                 // Load from file path (handle potential path issues)
                 // Fix path: Assimp might return full absolute paths from original PC, take filename only
@@ -210,70 +317,125 @@ void AnimatedModel::loadMaterialTextures(const aiScene* scene) {
                     filename = filename.substr(last_slash_idx + 1);
                 }
                 
-                // Try texture directory first
+                // Try texture directory first, then the same dir as model or just filename
                 std::string textureDir = "../../src/asset/texture/";
-                std::string fullPath = textureDir + filename;
+                std::string loadedPath;
+                loaded = uploadTexture(nullptr, { textureDir + filename, filename }, &loadedPath) > 0;
+                // reloads go straight to the file that worked
+                if (loaded) paths.push_back(loadedPath);
                 
-                data = stbi_load(fullPath.c_str(), &width, &height, &nrChannels, 0);
-                
-                if (!data) {
-                    // Fallback to searching in same dir as model or just filename
-                    data = stbi_load(filename.c_str(), &width, &height, &nrChannels, 0);
-                }
-                
-                if (data) std::cout << "Loaded referenced texture: " << filename << std::endl;
+                if (loaded) std::cout << "Loaded referenced texture: " << filename << std::endl;
             }
             
-            if (data) {
-                GLenum format;
-                if (nrChannels == 1) format = GL_RED;
-                else if (nrChannels == 3) format = GL_RGB;
-                else if (nrChannels == 4) format = GL_RGBA;
-                
-                glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-                glGenerateMipmap(GL_TEXTURE_2D);
-                stbi_image_free(data);
+            if (loaded) {
+                makeTextureStreamable(embeddedTexture, paths);
                 
                 // We found a texture, stop searching (simplification for single-texture model)
                 return; 
             } else {
+                texture.reset();
                 std::cout << "Failed to load FBX texture: " << path << std::endl;
             }
         }
     }
 }
 
-void AnimatedModel::render() {
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
-}
-
 void AnimatedModel::updateAnimation(float timeInSeconds) {
     if (!m_CurrentAnimation) return;
     
     m_AnimationTime = fmod(timeInSeconds * m_CurrentAnimation->mTicksPerSecond, m_CurrentAnimation->mDuration);
-    calculateBoneTransform(m_scene->mRootNode, glm::mat4(1.0f), m_AnimationTime);
+    calculateBoneTransform(m_scene->mRootNode, glm::mat4(1.0f), m_AnimationTime, m_FinalBoneMatrices);
+    skinnedValid = false;
+    updateBounds();
 }
 
-void AnimatedModel::calculateBoneTransform(const aiNode* node, glm::mat4 parentTransform, float animationTime) {
-    std::string nodeName = node->mName.data;
-    glm::mat4 nodeTransform = aiMatrix4x4ToGlm(node->mTransformation);
-    
-    const aiNodeAnim* nodeAnim = nullptr;
-    
-    // Find the animation node for this bone
-    if (m_CurrentAnimation) {
-        for (unsigned int i = 0; i < m_CurrentAnimation->mNumChannels; i++) {
-            if (std::string(m_CurrentAnimation->mChannels[i]->mNodeName.data) == nodeName) {
-                nodeAnim = m_CurrentAnimation->mChannels[i];
+void AnimatedModel::evaluatePose(float timeInSeconds, std::vector<glm::mat4>& palette, aabb_t& bounds) const {
+    if (!m_CurrentAnimation) {
+        palette.clear();
+        bounds = m_Bounds;
+        return;
+    }
+    // bones the node tree doesn't reach keep identity, like m_FinalBoneMatrices
+    if (palette.size() != m_FinalBoneMatrices.size()) {
+        palette.assign(m_FinalBoneMatrices.size(), glm::mat4(1.0f));
+    }
+    float animationTime = fmod(timeInSeconds * m_CurrentAnimation->mTicksPerSecond, m_CurrentAnimation->mDuration);
+    calculateBoneTransform(m_scene->mRootNode, glm::mat4(1.0f), animationTime, palette);
+    bounds = poseBounds(palette);
+}
+
+void AnimatedModel::applyPose(const std::vector<glm::mat4>& palette, const aabb_t& bounds) {
+    if (!m_CurrentAnimation || palette.size() != m_FinalBoneMatrices.size()) return;
+    // element copy only, evaluatePose() may read the size from another thread
+    std::copy(palette.begin(), palette.end(), m_FinalBoneMatrices.begin());
+    m_Bounds = bounds;
+    skinnedValid = false;
+}
+
+float AnimatedModel::getAnimationDuration() const {
+    if (!m_CurrentAnimation || m_CurrentAnimation->mTicksPerSecond <= 0.0) return 0.0f;
+    return m_CurrentAnimation->mDuration / m_CurrentAnimation->mTicksPerSecond;
+}
+
+void AnimatedModel::computeBoneBounds() {
+    int boneCount = m_FinalBoneMatrices.size();
+    m_BoneBounds.assign(boneCount, aabb_t());
+    m_UnskinnedBounds = aabb_t();
+
+    // Same rules as the skinning shaders: an out of range id or a vertex without
+    // any weighted bone keeps its bind pose.
+    for (const Vertex& v : vertices) {
+        bool weighted = false;
+        bool bindPose = false;
+        float weightSum = 0.0f;
+        for (int k = 0; k < MAX_BONE_INFLUENCE; k++) {
+            if (v.m_BoneIDs[k] < 0) continue;
+            if (v.m_BoneIDs[k] >= boneCount) {
+                bindPose = true;
                 break;
             }
+            weighted = weighted || v.m_Weights[k] != 0.0f;
+            weightSum += v.m_Weights[k];
+        }
+        if (bindPose || !weighted) {
+            m_UnskinnedBounds.expand(v.Position);
+            continue;
         }
+
+        for (int k = 0; k < MAX_BONE_INFLUENCE; k++) {
+            if (v.m_BoneIDs[k] >= 0 && v.m_Weights[k] != 0.0f) {
+                m_BoneBounds[v.m_BoneIDs[k]].expand(v.Position);
+            }
+        }
+        // The skinned position is a weighted mix of the per-bone positions. If
+        // influences were dropped (more than MAX_BONE_INFLUENCE) the weights sum
+        // to less than one and the mix is pulled towards the origin.
+        if (weightSum < 0.999f) {
+            m_UnskinnedBounds.expand(glm::vec3(0.0f));
+        }
+    }
+}
+
+void AnimatedModel::updateBounds() {
+    m_Bounds = poseBounds(m_FinalBoneMatrices);
+}
+
+aabb_t AnimatedModel::poseBounds(const std::vector<glm::mat4>& palette) const {
+    aabb_t bounds = m_UnskinnedBounds;
+    for (size_t i = 0; i < m_BoneBounds.size(); i++) {
+        bounds.expand(transform_aabb(m_BoneBounds[i], palette[i]));
     }
+    return bounds;
+}
+
+void AnimatedModel::calculateBoneTransform(const aiNode* node, glm::mat4 parentTransform, float animationTime,
+                                           std::vector<glm::mat4>& palette) const {
+    // no std::string per node: this runs for every node of every pose
+    const char* nodeName = node->mName.C_Str();
+    glm::mat4 nodeTransform = aiMatrix4x4ToGlm(node->mTransformation);
+    
+    // Find the animation node for this bone
+    const aiNodeAnim* nodeAnim = findChannel(nodeName);
     
     if (nodeAnim) {
         // Interpolate scaling and generate scaling transformation matrix
@@ -281,17 +443,8 @@ void AnimatedModel::calculateBoneTransform(const aiNode* node, glm::mat4 parentT
         if (nodeAnim->mNumScalingKeys == 1) {
             scaling = aiVector3DToGlm(nodeAnim->mScalingKeys[0].mValue);
         } else if (nodeAnim->mNumScalingKeys > 1) {
-            unsigned int scalingIndex = 0;
-            bool foundScaling = false;
-            for (unsigned int i = 0; i < nodeAnim->mNumScalingKeys - 1; i++) {
-                if (animationTime < (float)nodeAnim->mScalingKeys[i + 1].mTime) {
-                    scalingIndex = i;
-                    foundScaling = true;
-                    break;
-                }
-            }
-            
-            if (!foundScaling) {
+            unsigned int scalingIndex = findKeyIndex(nodeAnim->mScalingKeys, nodeAnim->mNumScalingKeys, animationTime);
+            if (scalingIndex == nodeAnim->mNumScalingKeys - 1) {
                 scaling = aiVector3DToGlm(nodeAnim->mScalingKeys[nodeAnim->mNumScalingKeys - 1].mValue);
             } else {
                 float deltaTime = nodeAnim->mScalingKeys[scalingIndex + 1].mTime - nodeAnim->mScalingKeys[scalingIndex].mTime;
@@ -311,17 +464,8 @@ void AnimatedModel::calculateBoneTransform(const aiNode* node, glm::mat4 parentT
         if (nodeAnim->mNumRotationKeys == 1) {
             rotation = aiQuaternionToGlm(nodeAnim->mRotationKeys[0].mValue);
         } else if (nodeAnim->mNumRotationKeys > 1) {
-            unsigned int rotationIndex = 0;
-            bool foundRotation = false;
-            for (unsigned int i = 0; i < nodeAnim->mNumRotationKeys - 1; i++) {
-                if (animationTime < (float)nodeAnim->mRotationKeys[i + 1].mTime) {
-                    rotationIndex = i;
-                    foundRotation = true;
-                    break;
-                }
-            }
-            
-            if (!foundRotation) {
+            unsigned int rotationIndex = findKeyIndex(nodeAnim->mRotationKeys, nodeAnim->mNumRotationKeys, animationTime);
+            if (rotationIndex == nodeAnim->mNumRotationKeys - 1) {
                 rotation = aiQuaternionToGlm(nodeAnim->mRotationKeys[nodeAnim->mNumRotationKeys - 1].mValue);
             } else {
                 float deltaTime = nodeAnim->mRotationKeys[rotationIndex + 1].mTime - nodeAnim->mRotationKeys[rotationIndex].mTime;
@@ -341,17 +485,8 @@ void AnimatedModel::calculateBoneTransform(const aiNode* node, glm::mat4 parentT
         if (nodeAnim->mNumPositionKeys == 1) {
             translation = aiVector3DToGlm(nodeAnim->mPositionKeys[0].mValue);
         } else if (nodeAnim->mNumPositionKeys > 1) {
-            unsigned int positionIndex = 0;
-            bool foundPosition = false;
-            for (unsigned int i = 0; i < nodeAnim->mNumPositionKeys - 1; i++) {
-                if (animationTime < (float)nodeAnim->mPositionKeys[i + 1].mTime) {
-                    positionIndex = i;
-                    foundPosition = true;
-                    break;
-                }
-            }
-            
-            if (!foundPosition) {
+            unsigned int positionIndex = findKeyIndex(nodeAnim->mPositionKeys, nodeAnim->mNumPositionKeys, animationTime);
+            if (positionIndex == nodeAnim->mNumPositionKeys - 1) {
                 translation = aiVector3DToGlm(nodeAnim->mPositionKeys[nodeAnim->mNumPositionKeys - 1].mValue);
             } else {
                 float deltaTime = nodeAnim->mPositionKeys[positionIndex + 1].mTime - nodeAnim->mPositionKeys[positionIndex].mTime;
@@ -380,15 +515,25 @@ void AnimatedModel::calculateBoneTransform(const aiNode* node, glm::mat4 parentT
     if (boneInfoMap != m_BoneInfoMap.end()) {
         int index = boneInfoMap->second.id;
         glm::mat4 offset = boneInfoMap->second.offset;
-        m_FinalBoneMatrices[index] = globalTransformation * offset;
+        palette[index] = globalTransformation * offset;
     }
     
     for (unsigned int i = 0; i < node->mNumChildren; i++) {
-        calculateBoneTransform(node->mChildren[i], globalTransformation, animationTime);
+        calculateBoneTransform(node->mChildren[i], globalTransformation, animationTime, palette);
+    }
+}
+
+const aiNodeAnim* AnimatedModel::findChannel(const char* nodeName) const {
+    if (!m_CurrentAnimation) return nullptr;
+    for (unsigned int i = 0; i < m_CurrentAnimation->mNumChannels; i++) {
+        if (std::strcmp(m_CurrentAnimation->mChannels[i]->mNodeName.C_Str(), nodeName) == 0) {
+            return m_CurrentAnimation->mChannels[i];
+        }
     }
+    return nullptr;
 }
 
-glm::mat4 AnimatedModel::aiMatrix4x4ToGlm(const aiMatrix4x4& from) {
+glm::mat4 AnimatedModel::aiMatrix4x4ToGlm(const aiMatrix4x4& from) const {
     glm::mat4 to;
     to[0][0] = from.a1; to[1][0] = from.a2; to[2][0] = from.a3; to[3][0] = from.a4;
     to[0][1] = from.b1; to[1][1] = from.b2; to[2][1] = from.b3; to[3][1] = from.b4;
@@ -397,11 +542,11 @@ glm::mat4 AnimatedModel::aiMatrix4x4ToGlm(const aiMatrix4x4& from) {
     return to;
 }
 
-glm::vec3 AnimatedModel::aiVector3DToGlm(const aiVector3D& vec) {
+glm::vec3 AnimatedModel::aiVector3DToGlm(const aiVector3D& vec) const {
     return glm::vec3(vec.x, vec.y, vec.z);
 }
 
-glm::quat AnimatedModel::aiQuaternionToGlm(const aiQuaternion& pOrientation) {
+glm::quat AnimatedModel::aiQuaternionToGlm(const aiQuaternion& pOrientation) const {
     return glm::quat(pOrientation.w, pOrientation.x, pOrientation.y, pOrientation.z);
 }
 
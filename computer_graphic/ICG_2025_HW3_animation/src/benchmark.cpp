@@ -0,0 +1,398 @@
+// Benchmarks for the animation, skinning and loading hot paths, one case per
+// asset of the scene where it matters. Prints a summary and writes the
+// results as JSON so runs can be compared commit to commit:
+//
+//   ICG_2024_HW3_Bench [--out=FILE] [--filter=SUBSTRING] [--scene=FILE]
+//                      [--frames=N] [--size=WxH] [--no-frame]
+//
+// Times are microseconds per operation; "items" is how much work one
+// operation is (instances posed, lookups, uploads), "per_item" the median
+// divided by it. The full-frame case runs ICG_2024_HW3_Animated --headless
+// on the same scene from the same directory and embeds its --bench-json output.
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "header/animated_model.h"
+#include "header/headless_context.h"
+#include "header/scene.h"
+#include "header/stb_image.h"
+
+#ifndef ICG_GIT_COMMIT
+#define ICG_GIT_COMMIT "unknown"
+#endif
+
+#ifdef _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+namespace {
+
+struct bench_result_t {
+    std::string name;
+    std::vector<double> samples; // microseconds per operation
+    double items = 1.0;
+};
+
+struct bench_model_t {
+    std::string name;
+    std::string file;
+    AnimatedModel* model = nullptr;
+};
+
+std::vector<bench_result_t> results;
+std::string filter;
+
+// Times fn(iteration) iterations times after warmup untimed calls
+template <typename Fn>
+void run(const std::string& name, int iterations, double items, int warmup, Fn&& fn) {
+    if (!filter.empty() && name.find(filter) == std::string::npos) return;
+    for (int i = 0; i < warmup; i++) fn(i);
+    bench_result_t result;
+    result.name = name;
+    result.items = items;
+    for (int i = 0; i < iterations; i++) {
+        auto start = std::chrono::steady_clock::now();
+        fn(i);
+        result.samples.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(result.samples.begin(), result.samples.end());
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-48s median %12.2f us  min %12.2f us  (%d runs)",
+                  name.c_str(), result.samples[result.samples.size() / 2], result.samples.front(), iterations);
+    std::cout << line << std::endl;
+    results.push_back(std::move(result));
+}
+
+void collect_node_names(const aiNode* node, std::vector<std::string>& names) {
+    names.push_back(node->mName.data);
+    for (unsigned int i = 0; i < node->mNumChildren; i++) {
+        collect_node_names(node->mChildren[i], names);
+    }
+}
+
+GLuint compile_upload_program() {
+    // reads every palette entry so neither path can be optimized away
+    const char* vertexSource =
+        "#version 330 core\n"
+        "const int MAX_BONES = 200;\n"
+        "uniform mat4 finalBonesMatrices[MAX_BONES];\n"
+        "uniform samplerBuffer paletteBuffer;\n"
+        "void main() {\n"
+        "    gl_Position = finalBonesMatrices[gl_VertexID % MAX_BONES][0] + texelFetch(paletteBuffer, gl_VertexID);\n"
+        "}\n";
+    const char* fragmentSource =
+        "#version 330 core\n"
+        "out vec4 color;\n"
+        "void main() { color = vec4(1.0); }\n";
+    GLuint vertex = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertex, 1, &vertexSource, NULL);
+    glCompileShader(vertex);
+    GLuint fragment = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragment, 1, &fragmentSource, NULL);
+    glCompileShader(fragment);
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertex);
+    glAttachShader(program, fragment);
+    glLinkProgram(program);
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+    GLint linked = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        std::cerr << "bench: upload program failed to link" << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+void bench_load(std::vector<bench_model_t>& models) {
+    for (bench_model_t& entry : models) {
+        run("load/" + entry.name, 3, 1.0, 0, [&](int) {
+            // includes freeing the previous load's GL objects
+            delete entry.model;
+            entry.model = new AnimatedModel(entry.file);
+        });
+        if (!entry.model) entry.model = new AnimatedModel(entry.file);
+    }
+}
+
+void bench_pose(const std::vector<bench_model_t>& models) {
+    for (const bench_model_t& entry : models) {
+        if (!entry.model->m_scene || entry.model->isStaticPose()) continue;
+        float duration = std::max(entry.model->getAnimationDuration(), 0.1f);
+        for (int instances : { 1, 16, 128 }) {
+            std::vector<std::vector<glm::mat4>> palettes(instances);
+            aabb_t bounds;
+            run("pose/" + entry.name + "/x" + std::to_string(instances), 30, instances, 2, [&](int iteration) {
+                for (int k = 0; k < instances; k++) {
+                    float time = std::fmod(0.37f * k + 0.016f * iteration, duration);
+                    entry.model->evaluatePose(time, palettes[k], bounds);
+                }
+            });
+        }
+    }
+}
+
+void bench_lookup(const std::vector<bench_model_t>& models) {
+    const int TIMES_PER_CHANNEL = 64;
+    for (const bench_model_t& entry : models) {
+        const aiScene* scene = entry.model->m_scene;
+        if (!scene || entry.model->isStaticPose()) continue;
+        const aiAnimation* clip = scene->mAnimations[0];
+
+        // the per-node channel search calculateBoneTransform() does
+        std::vector<std::string> nodeNames;
+        collect_node_names(scene->mRootNode, nodeNames);
+        size_t found = 0;
+        run("lookup/channel/" + entry.name, 30, nodeNames.size(), 2, [&](int) {
+            for (const std::string& name : nodeNames) {
+                found += entry.model->findChannel(name.c_str()) != nullptr;
+            }
+        });
+
+        // key interval search of every channel at times spread over the clip
+        size_t keySum = 0;
+        run("lookup/key/" + entry.name, 30, (double)clip->mNumChannels * TIMES_PER_CHANNEL, 2, [&](int iteration) {
+            for (unsigned int c = 0; c < clip->mNumChannels; c++) {
+                const aiNodeAnim* channel = clip->mChannels[c];
+                for (int t = 0; t < TIMES_PER_CHANNEL; t++) {
+                    float time = (float)clip->mDuration * ((t + 0.5f * (iteration & 1)) / TIMES_PER_CHANNEL);
+                    keySum += AnimatedModel::findKeyIndex(channel->mRotationKeys, channel->mNumRotationKeys, time);
+                }
+            }
+        });
+        if (found + keySum == 0) std::cout << "(" << entry.name << ": nothing found)" << std::endl;
+    }
+}
+
+// Per-draw bone palette upload through the uniform array the animated shaders
+// use, and through a buffer texture. Each upload is followed by a one-point
+// draw with rasterization off, so the driver can't fold uploads together.
+void bench_upload(const std::vector<bench_model_t>& models) {
+    const int UPLOADS = 200;
+    GLuint program = compile_upload_program();
+    if (!program) return;
+    GLuint vao, buffer, bufferTexture;
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &buffer);
+    glGenTextures(1, &bufferTexture);
+    glBindVertexArray(vao);
+    glUseProgram(program);
+    glEnable(GL_RASTERIZER_DISCARD);
+    GLint paletteLocation = glGetUniformLocation(program, "finalBonesMatrices");
+    glUniform1i(glGetUniformLocation(program, "paletteBuffer"), 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, bufferTexture);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+
+    for (const bench_model_t& entry : models) {
+        if (entry.model->isStaticPose()) continue;
+        const std::vector<glm::mat4>& palette = entry.model->m_FinalBoneMatrices;
+        GLsizei bones = (GLsizei)std::min<size_t>(palette.size(), 200);
+        GLsizeiptr bytes = bones * sizeof(glm::mat4);
+        glBufferData(GL_TEXTURE_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+
+        std::string suffix = entry.name + "/" + std::to_string(bones) + "-bones";
+        run("upload/uniform/" + suffix, 20, UPLOADS, 2, [&](int) {
+            for (int u = 0; u < UPLOADS; u++) {
+                glUniformMatrix4fv(paletteLocation, bones, GL_FALSE, &palette[0][0][0]);
+                glDrawArrays(GL_POINTS, 0, 1);
+            }
+            glFinish();
+        });
+        run("upload/buffer/" + suffix, 20, UPLOADS, 2, [&](int) {
+            for (int u = 0; u < UPLOADS; u++) {
+                glBufferData(GL_TEXTURE_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+                glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, palette.data());
+                glDrawArrays(GL_POINTS, 0, 1);
+            }
+            glFinish();
+        });
+    }
+
+    glDisable(GL_RASTERIZER_DISCARD);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glDeleteTextures(1, &bufferTexture);
+    glDeleteBuffers(1, &buffer);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteProgram(program);
+}
+
+void bench_texture_decode(const std::string& textureDir) {
+    std::vector<std::filesystem::path> files;
+    std::error_code error;
+    for (const auto& file : std::filesystem::directory_iterator(textureDir, error)) {
+        std::string extension = file.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        if (extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".tga") {
+            files.push_back(file.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    stbi_set_flip_vertically_on_load(false);
+    for (const auto& file : files) {
+        run("decode/" + file.filename().string(), 3, 1.0, 1, [&](int) {
+            int width, height, channels;
+            unsigned char* data = stbi_load(file.string().c_str(), &width, &height, &channels, 0);
+            stbi_image_free(data);
+        });
+    }
+}
+
+// Runs the real renderer headless and returns its --bench-json output
+std::string bench_frame(const std::filesystem::path& executableDir, const std::string& scenePath, int frames,
+                        const std::string& size) {
+    std::filesystem::path app = executableDir / "ICG_2024_HW3_Animated";
+    std::filesystem::path json = std::filesystem::temp_directory_path() / "icg_bench_frame.json";
+    std::filesystem::remove(json);
+    std::string command = "\"" + app.string() + "\" --headless --scene=\"" + scenePath +
+                          "\" --frames=" + std::to_string(frames) + " --size=" + size + " --bench-json=\"" +
+                          json.string() + "\" > " NULL_DEVICE;
+    std::cout << "frame: " << command << std::endl;
+    if (std::system(command.c_str()) != 0) {
+        std::cerr << "bench: headless run failed" << std::endl;
+        return "null";
+    }
+    std::ifstream in(json);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    std::string result = contents.str();
+    while (!result.empty() && std::isspace((unsigned char)result.back())) result.pop_back();
+    std::cout << "frame: " << (result.empty() ? "no output" : result) << std::endl;
+    return result.empty() ? "null" : result;
+}
+
+void write_json_string(std::ostream& out, const std::string& text) {
+    out << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') out << '\\';
+        if ((unsigned char)c >= 0x20) out << c;
+    }
+    out << '"';
+}
+
+void write_results(std::ostream& out, const std::string& renderer, const std::string& frame) {
+    out << "{\n  \"commit\": ";
+    write_json_string(out, ICG_GIT_COMMIT);
+    out << ",\n  \"renderer\": ";
+    write_json_string(out, renderer);
+    out << ",\n  \"unit\": \"us\",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const bench_result_t& result = results[i];
+        const std::vector<double>& samples = result.samples;
+        double mean = 0.0;
+        for (double sample : samples) mean += sample;
+        mean /= samples.size();
+        double median = samples[samples.size() / 2];
+        out << (i ? ",\n    " : "\n    ") << "{\"name\": ";
+        write_json_string(out, result.name);
+        out << ", \"iterations\": " << samples.size() << ", \"items\": " << result.items
+            << ", \"min\": " << samples.front() << ", \"median\": " << median << ", \"mean\": " << mean
+            << ", \"max\": " << samples.back() << ", \"per_item\": " << median / result.items << "}";
+    }
+    out << "\n  ],\n  \"frame\": " << frame << "\n}" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string outPath = "benchmark.json";
+    std::string scenePath = "../../src/asset/default.scene";
+    std::string size = "1280x720";
+    int frames = 300;
+    bool runFrame = true;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--out=", 0) == 0) outPath = arg.substr(6);
+        else if (arg.rfind("--filter=", 0) == 0) filter = arg.substr(9);
+        else if (arg.rfind("--scene=", 0) == 0) scenePath = arg.substr(8);
+        else if (arg.rfind("--frames=", 0) == 0) frames = std::max(1, std::atoi(arg.c_str() + 9));
+        else if (arg.rfind("--size=", 0) == 0) size = arg.substr(7);
+        else if (arg == "--no-frame") runFrame = false;
+        else std::cout << "unknown argument " << arg << std::endl;
+    }
+    // the assets the scene draws, textures from the texture/ directory next to it
+    scene_t scene;
+    if (!scene.load(scenePath)) return -1;
+    size_t slash = scenePath.find_last_of("/\\");
+    std::string sceneDir = slash == std::string::npos ? "" : scenePath.substr(0, slash + 1);
+
+    // Loading needs a context for its buffers and textures: EGL without a
+    // display when built with it, otherwise a hidden window
+    headless_context_t headlessContext;
+    GLFWwindow* window = nullptr;
+    bool loaded = false;
+    if (headlessContext.create()) {
+        loaded = gladLoadGLLoader((GLADloadproc)headless_context_t::proc_address);
+    } else {
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        window = glfwCreateWindow(64, 64, "ICG benchmark", NULL, NULL);
+        if (window) {
+            glfwMakeContextCurrent(window);
+            loaded = gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+        }
+    }
+    if (!loaded) {
+        std::cerr << "bench: no GL 3.3 context" << std::endl;
+        return -1;
+    }
+    std::string renderer = (const char*)glGetString(GL_RENDERER);
+    std::cout << "renderer: " << renderer << ", commit " << ICG_GIT_COMMIT << std::endl;
+
+    std::vector<bench_model_t> models;
+    for (const scene_asset_t& asset : scene.assets) models.push_back({ asset.name, asset.path });
+    bench_load(models);
+    bench_pose(models);
+    bench_lookup(models);
+    bench_upload(models);
+    bench_texture_decode(sceneDir + "texture/");
+
+    for (bench_model_t& entry : models) delete entry.model;
+    if (window) {
+        glfwTerminate();
+    } else {
+        headlessContext.destroy();
+    }
+
+    std::string frame = "null";
+    if (runFrame && (filter.empty() || std::string("frame").find(filter) != std::string::npos)) {
+        frame = bench_frame(std::filesystem::absolute(argv[0]).parent_path(),
+                            std::filesystem::absolute(scenePath).string(), frames, size);
+    }
+
+    std::ofstream out(outPath);
+    if (!out) {
+        std::cerr << "bench: cannot write " << outPath << std::endl;
+        return -1;
+    }
+    write_results(out, renderer, frame);
+    std::cout << "wrote " << results.size() << " results to " << outPath << std::endl;
+    return 0;
+}
@@ -0,0 +1,120 @@
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+
+#include "header/bounds.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BOUNDS_SSE 1
+#include <emmintrin.h>
+#endif
+
+void aabb_t::expand(const glm::vec3& p) {
+    min = glm::min(min, p);
+    max = glm::max(max, p);
+}
+
+void aabb_t::expand(const aabb_t& box) {
+    if (box.empty()) return;
+    min = glm::min(min, box.min);
+    max = glm::max(max, box.max);
+}
+
+void aabb_t::pad(float amount) {
+    if (empty()) return;
+    min -= glm::vec3(amount);
+    max += glm::vec3(amount);
+}
+
+aabb_t transform_aabb(const aabb_t& box, const glm::mat4& m) {
+    if (box.empty()) return box;
+    glm::vec3 c = glm::vec3(m * glm::vec4(box.center(), 1.0f));
+    glm::vec3 e = box.extent();
+    glm::vec3 r(0.0f);
+    for (int col = 0; col < 3; col++) {
+        r += glm::abs(glm::vec3(m[col])) * e[col];
+    }
+    aabb_t out;
+    out.min = c - r;
+    out.max = c + r;
+    return out;
+}
+
+frustum_t extract_frustum(const glm::mat4& viewProjection) {
+    // rows of the matrix, glm is column-major
+    glm::vec4 row[4];
+    for (int i = 0; i < 4; i++) {
+        row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+    }
+
+    frustum_t frustum;
+    frustum.planes[0] = row[3] + row[0]; // left
+    frustum.planes[1] = row[3] - row[0]; // right
+    frustum.planes[2] = row[3] + row[1]; // bottom
+    frustum.planes[3] = row[3] - row[1]; // top
+    frustum.planes[4] = row[3] + row[2]; // near
+    frustum.planes[5] = row[3] - row[2]; // far
+    for (auto& plane : frustum.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+}
+
+// A box is outside once its most positive corner is behind any plane
+static bool box_visible(const frustum_t& frustum, const aabb_t& box) {
+    glm::vec3 c = box.center();
+    glm::vec3 e = box.extent();
+    for (const auto& plane : frustum.planes) {
+        glm::vec3 n(plane);
+        if (glm::dot(n, c) + glm::dot(glm::abs(n), e) + plane.w < 0.0f) return false;
+    }
+    return true;
+}
+
+size_t frustum_cull(const frustum_t& frustum, const aabb_t* boxes, size_t count, uint8_t* visible) {
+    size_t i = 0;
+    size_t visibleCount = 0;
+
+#ifdef BOUNDS_SSE
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    for (; i + 4 <= count; i += 4) {
+        // four boxes transposed to center/extent lanes
+        glm::vec3 c[4], e[4];
+        for (int k = 0; k < 4; k++) {
+            c[k] = boxes[i + k].center();
+            e[k] = boxes[i + k].extent();
+        }
+        __m128 cx = _mm_setr_ps(c[0].x, c[1].x, c[2].x, c[3].x);
+        __m128 cy = _mm_setr_ps(c[0].y, c[1].y, c[2].y, c[3].y);
+        __m128 cz = _mm_setr_ps(c[0].z, c[1].z, c[2].z, c[3].z);
+        __m128 ex = _mm_setr_ps(e[0].x, e[1].x, e[2].x, e[3].x);
+        __m128 ey = _mm_setr_ps(e[0].y, e[1].y, e[2].y, e[3].y);
+        __m128 ez = _mm_setr_ps(e[0].z, e[1].z, e[2].z, e[3].z);
+
+        __m128 outside = _mm_setzero_ps();
+        for (const auto& plane : frustum.planes) {
+            __m128 nx = _mm_set1_ps(plane.x);
+            __m128 ny = _mm_set1_ps(plane.y);
+            __m128 nz = _mm_set1_ps(plane.z);
+            __m128 d = _mm_add_ps(_mm_mul_ps(nx, cx), _mm_add_ps(_mm_mul_ps(ny, cy), _mm_mul_ps(nz, cz)));
+            __m128 r = _mm_add_ps(_mm_mul_ps(_mm_and_ps(nx, absMask), ex),
+                                  _mm_add_ps(_mm_mul_ps(_mm_and_ps(ny, absMask), ey),
+                                             _mm_mul_ps(_mm_and_ps(nz, absMask), ez)));
+            __m128 dist = _mm_add_ps(_mm_add_ps(d, r), _mm_set1_ps(plane.w));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, _mm_setzero_ps()));
+        }
+
+        int mask = _mm_movemask_ps(outside);
+        for (int k = 0; k < 4; k++) {
+            visible[i + k] = !(mask & (1 << k)) && !boxes[i + k].empty();
+            visibleCount += visible[i + k];
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        visible[i] = !boxes[i].empty() && box_visible(frustum, boxes[i]);
+        visibleCount += visible[i];
+    }
+    return visibleCount;
+}
@@ -0,0 +1,214 @@
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "header/shader.h"
+#include "header/clustered_lighting.h"
+#include "header/gpu_memory.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CLUSTER_BINNING_SSE 1
+#include <emmintrin.h>
+#endif
+
+static_assert(sizeof(dynamic_light_t) == LIGHT_TEXELS * sizeof(glm::vec4),
+              "dynamic_light_t must match the shader texel layout");
+static_assert(CLUSTER_X % 4 == 0, "cluster rows are tested four at a time");
+
+static void make_buffer_texture(unsigned int& buffer, unsigned int& texture, GLenum format, const char* owner) {
+    glGenBuffers(1, &buffer);
+    glGenTextures(1, &texture);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+    gpuMemory.track(GL_OBJECT_BUFFER, buffer, GPU_MEMORY_STREAMING, owner);
+    gpuMemory.resize(GL_OBJECT_BUFFER, buffer, 16);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+// orphaned every frame, last frame's draws may still be reading
+static void upload_buffer(unsigned int buffer, const void* data, size_t bytes) {
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(bytes, 16), NULL, GL_STREAM_DRAW);
+    gpuMemory.resize(GL_OBJECT_BUFFER, buffer, std::max<size_t>(bytes, 16));
+    if (bytes > 0) glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+light_clusters_t::light_clusters_t() {
+    make_buffer_texture(lightBuffer, lightTexture, GL_RGBA32F, "lights");
+    make_buffer_texture(clusterBuffer, clusterTexture, GL_RG32UI, "light clusters");
+    make_buffer_texture(indexBuffer, indexTexture, GL_R32UI, "light cluster indices");
+    clusterRanges.assign(CLUSTER_COUNT * 2, 0);
+}
+
+light_clusters_t::~light_clusters_t() {
+    glDeleteTextures(1, &lightTexture);
+    glDeleteTextures(1, &clusterTexture);
+    glDeleteTextures(1, &indexTexture);
+    gpuMemory.untrack(GL_OBJECT_BUFFER, lightBuffer);
+    gpuMemory.untrack(GL_OBJECT_BUFFER, clusterBuffer);
+    gpuMemory.untrack(GL_OBJECT_BUFFER, indexBuffer);
+    glDeleteBuffers(1, &lightBuffer);
+    glDeleteBuffers(1, &clusterBuffer);
+    glDeleteBuffers(1, &indexBuffer);
+}
+
+int light_clusters_t::slice(float depth) const {
+    int k = (int)std::floor(std::log(std::max(depth, nearPlane) / nearPlane) * sliceScale);
+    return std::clamp(k, 0, CLUSTER_Z - 1);
+}
+
+// View-space box of every cluster, with depth positive into the screen.
+// Only changes with the projection.
+void light_clusters_t::build_cluster_bounds(float fovY, float aspect, float zNear, float zFar) {
+    nearPlane = zNear;
+    farPlane = zFar;
+    tanHalfY = std::tan(fovY * 0.5f);
+    tanHalfX = tanHalfY * aspect;
+    sliceScale = CLUSTER_Z / std::log(zFar / zNear);
+
+    minX.resize(CLUSTER_COUNT); minY.resize(CLUSTER_COUNT); minZ.resize(CLUSTER_COUNT);
+    maxX.resize(CLUSTER_COUNT); maxY.resize(CLUSTER_COUNT); maxZ.resize(CLUSTER_COUNT);
+    for (int k = 0; k < CLUSTER_Z; k++) {
+        float z0 = zNear * std::pow(zFar / zNear, (float)k / CLUSTER_Z);
+        float z1 = zNear * std::pow(zFar / zNear, (float)(k + 1) / CLUSTER_Z);
+        for (int j = 0; j < CLUSTER_Y; j++) {
+            float y0 = (-1.0f + 2.0f * j / CLUSTER_Y) * tanHalfY;
+            float y1 = (-1.0f + 2.0f * (j + 1) / CLUSTER_Y) * tanHalfY;
+            for (int i = 0; i < CLUSTER_X; i++) {
+                float x0 = (-1.0f + 2.0f * i / CLUSTER_X) * tanHalfX;
+                float x1 = (-1.0f + 2.0f * (i + 1) / CLUSTER_X) * tanHalfX;
+                int c = (k * CLUSTER_Y + j) * CLUSTER_X + i;
+                minX[c] = std::min(x0 * z0, x0 * z1);
+                maxX[c] = std::max(x1 * z0, x1 * z1);
+                minY[c] = std::min(y0 * z0, y0 * z1);
+                maxY[c] = std::max(y1 * z0, y1 * z1);
+                minZ[c] = z0;
+                maxZ[c] = z1;
+            }
+        }
+    }
+}
+
+// Screen tile range of a view-space sphere: its box in x (or y) over the depth
+// range it spans, divided by depth at whichever end widens it
+static void tile_range(float center, float radius, float depthMin, float depthMax, float tanHalf,
+                       int tiles, int& first, int& last) {
+    float lo = center - radius, hi = center + radius;
+    float ndcLo = lo / ((lo >= 0.0f ? depthMax : depthMin) * tanHalf);
+    float ndcHi = hi / ((hi >= 0.0f ? depthMin : depthMax) * tanHalf);
+    first = std::clamp((int)std::floor((ndcLo * 0.5f + 0.5f) * tiles), 0, tiles - 1);
+    last = std::clamp((int)std::floor((ndcHi * 0.5f + 0.5f) * tiles), 0, tiles - 1);
+}
+
+void light_clusters_t::update(const std::vector<dynamic_light_t>& lights, const glm::mat4& viewMatrix,
+                              float fovY, float aspect, float zNear, float zFar) {
+    if (boundsKey[0] != fovY || boundsKey[1] != aspect || boundsKey[2] != zNear || boundsKey[3] != zFar) {
+        build_cluster_bounds(fovY, aspect, zNear, zFar);
+        boundsKey[0] = fovY; boundsKey[1] = aspect; boundsKey[2] = zNear; boundsKey[3] = zFar;
+    }
+    view = viewMatrix;
+    lightCount = lights.size();
+    pairCluster.clear();
+    pairLight.clear();
+
+    for (size_t l = 0; l < lights.size(); l++) {
+        const dynamic_light_t& light = lights[l];
+        glm::vec4 p = viewMatrix * glm::vec4(light.position, 1.0f);
+        float px = p.x, py = p.y, pd = -p.z, r = light.radius;
+        if (pd + r < nearPlane || pd - r > farPlane) continue;
+
+        float dMin = std::max(pd - r, nearPlane);
+        float dMax = std::min(pd + r, farPlane);
+        int k0 = slice(dMin), k1 = slice(dMax);
+        int i0, i1, j0, j1;
+        tile_range(px, r, dMin, dMax, tanHalfX, CLUSTER_X, i0, i1);
+        tile_range(py, r, dMin, dMax, tanHalfY, CLUSTER_Y, j0, j1);
+
+        for (int k = k0; k <= k1; k++) {
+            for (int j = j0; j <= j1; j++) {
+                int row = (k * CLUSTER_Y + j) * CLUSTER_X;
+#ifdef CLUSTER_BINNING_SSE
+                // squared distance from the center to each box, four boxes per step
+                __m128 cx = _mm_set1_ps(px), cy = _mm_set1_ps(py), cz = _mm_set1_ps(pd);
+                __m128 r2 = _mm_set1_ps(r * r);
+                __m128 zero = _mm_setzero_ps();
+                for (int i = i0 & ~3; i <= i1; i += 4) {
+                    int c = row + i;
+                    __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minX[c]), cx),
+                                                      _mm_sub_ps(cx, _mm_loadu_ps(&maxX[c]))), zero);
+                    __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minY[c]), cy),
+                                                      _mm_sub_ps(cy, _mm_loadu_ps(&maxY[c]))), zero);
+                    __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&minZ[c]), cz),
+                                                      _mm_sub_ps(cz, _mm_loadu_ps(&maxZ[c]))), zero);
+                    __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                    int hit = _mm_movemask_ps(_mm_cmple_ps(d2, r2));
+                    for (int lane = 0; lane < 4; lane++) {
+                        if (!(hit & (1 << lane)) || i + lane < i0 || i + lane > i1) continue;
+                        pairCluster.push_back(c + lane);
+                        pairLight.push_back(l);
+                    }
+                }
+#else
+                for (int i = i0; i <= i1; i++) {
+                    int c = row + i;
+                    float dx = std::max(std::max(minX[c] - px, px - maxX[c]), 0.0f);
+                    float dy = std::max(std::max(minY[c] - py, py - maxY[c]), 0.0f);
+                    float dz = std::max(std::max(minZ[c] - pd, pd - maxZ[c]), 0.0f);
+                    if (dx * dx + dy * dy + dz * dz > r * r) continue;
+                    pairCluster.push_back(c);
+                    pairLight.push_back(l);
+                }
+#endif
+            }
+        }
+    }
+
+    // counting sort of the (cluster, light) pairs into per-cluster ranges;
+    // lights stay in submission order within a cluster
+    std::fill(clusterRanges.begin(), clusterRanges.end(), 0);
+    for (uint32_t c : pairCluster) clusterRanges[c * 2 + 1]++;
+    uint32_t offset = 0;
+    maxClusterLights = 0;
+    for (int c = 0; c < CLUSTER_COUNT; c++) {
+        clusterRanges[c * 2] = offset;
+        offset += clusterRanges[c * 2 + 1];
+        maxClusterLights = std::max(maxClusterLights, clusterRanges[c * 2 + 1]);
+        clusterRanges[c * 2 + 1] = 0;
+    }
+    indices.resize(pairCluster.size());
+    for (size_t p = 0; p < pairCluster.size(); p++) {
+        uint32_t c = pairCluster[p];
+        indices[clusterRanges[c * 2] + clusterRanges[c * 2 + 1]++] = pairLight[p];
+    }
+
+    texels.resize(lights.size() * LIGHT_TEXELS);
+    if (!lights.empty()) std::memcpy(texels.data(), lights.data(), lights.size() * sizeof(dynamic_light_t));
+    upload_buffer(lightBuffer, texels.data(), texels.size() * sizeof(glm::vec4));
+    upload_buffer(clusterBuffer, clusterRanges.data(), clusterRanges.size() * sizeof(uint32_t));
+    upload_buffer(indexBuffer, indices.data(), indices.size() * sizeof(uint32_t));
+}
+
+void light_clusters_t::bind() {
+    glActiveTexture(GL_TEXTURE0 + LIGHT_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, lightTexture);
+    glActiveTexture(GL_TEXTURE0 + CLUSTER_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, clusterTexture);
+    glActiveTexture(GL_TEXTURE0 + LIGHT_INDEX_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void light_clusters_t::set_uniforms(shader_program_t* program, int screenWidth, int screenHeight) const {
+    program->set_uniform_value("lightData", LIGHT_TEXTURE_UNIT);
+    program->set_uniform_value("clusterData", CLUSTER_TEXTURE_UNIT);
+    program->set_uniform_value("lightIndices", LIGHT_INDEX_TEXTURE_UNIT);
+    program->set_uniform_value("clusterView", view);
+    program->set_uniform_value("clusterScreen", glm::vec2((float)screenWidth, (float)screenHeight));
+    program->set_uniform_value("clusterDepth", glm::vec2(nearPlane, sliceScale));
+}
@@ -0,0 +1,141 @@
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "header/cpu_skinning.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_SKINNING_AVX2 1
+#include <immintrin.h>
+#endif
+
+// vertices per parallel_for chunk
+static const size_t SKINNING_GRAIN = 2048;
+
+// Same rules as the skinning shaders: -1 ids are unused, an out of range id or a
+// vertex without any weighted bone keeps its bind pose.
+static void skin_range_scalar(const Vertex* in, SkinnedVertex* out, const glm::mat4* bones,
+                              int boneCount, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+        const Vertex& v = in[i];
+        glm::mat4 blend(0.0f);
+        bool weighted = false;
+        bool bindPose = false;
+
+        for (int k = 0; k < MAX_BONE_INFLUENCE; k++) {
+            int id = v.m_BoneIDs[k];
+            if (id < 0) continue;
+            if (id >= boneCount) {
+                bindPose = true;
+                break;
+            }
+            blend = blend + bones[id] * v.m_Weights[k];
+            weighted = weighted || v.m_Weights[k] != 0.0f;
+        }
+
+        if (bindPose || !weighted) {
+            out[i].Position = glm::vec4(v.Position, 1.0f);
+            out[i].Normal = glm::vec4(v.Normal, 0.0f);
+            continue;
+        }
+        out[i].Position = blend * glm::vec4(v.Position, 1.0f);
+        out[i].Normal = glm::vec4(glm::mat3(blend) * v.Normal, 0.0f);
+    }
+}
+
+#ifdef CPU_SKINNING_AVX2
+// A blended mat4 is kept as two ymm registers (columns 0|1 and 2|3). The matrix
+// times vector product is then two FMAs and a fold of the 128-bit halves.
+__attribute__((target("avx2,fma")))
+static void skin_range_avx2(const Vertex* in, SkinnedVertex* out, const glm::mat4* bones,
+                            int boneCount, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+        const Vertex& v = in[i];
+        __m256 c01 = _mm256_setzero_ps();
+        __m256 c23 = _mm256_setzero_ps();
+        bool weighted = false;
+        bool bindPose = false;
+
+        for (int k = 0; k < MAX_BONE_INFLUENCE; k++) {
+            int id = v.m_BoneIDs[k];
+            if (id < 0) continue;
+            if (id >= boneCount) {
+                bindPose = true;
+                break;
+            }
+            const float* bone = &bones[id][0][0];
+            __m256 w = _mm256_set1_ps(v.m_Weights[k]);
+            c01 = _mm256_fmadd_ps(w, _mm256_loadu_ps(bone), c01);
+            c23 = _mm256_fmadd_ps(w, _mm256_loadu_ps(bone + 8), c23);
+            weighted = weighted || v.m_Weights[k] != 0.0f;
+        }
+
+        if (bindPose || !weighted) {
+            out[i].Position = glm::vec4(v.Position, 1.0f);
+            out[i].Normal = glm::vec4(v.Normal, 0.0f);
+            continue;
+        }
+
+        __m256 px = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(v.Position.x)), _mm_set1_ps(v.Position.y), 1);
+        __m256 pz = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(v.Position.z)), _mm_set1_ps(1.0f), 1);
+        __m256 p = _mm256_fmadd_ps(c23, pz, _mm256_mul_ps(c01, px));
+        _mm_storeu_ps(&out[i].Position.x, _mm_add_ps(_mm256_castps256_ps128(p), _mm256_extractf128_ps(p, 1)));
+
+        __m256 nx = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(v.Normal.x)), _mm_set1_ps(v.Normal.y), 1);
+        __m256 nz = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(v.Normal.z)), _mm_setzero_ps(), 1);
+        __m256 n = _mm256_fmadd_ps(c23, nz, _mm256_mul_ps(c01, nx));
+        _mm_storeu_ps(&out[i].Normal.x, _mm_add_ps(_mm256_castps256_ps128(n), _mm256_extractf128_ps(n, 1)));
+    }
+}
+#endif
+
+cpu_skinner_t::cpu_skinner_t(unsigned int workerCount) : pool(workerCount) {
+}
+
+bool cpu_skinner_t::has_avx2() {
+#ifdef CPU_SKINNING_AVX2
+    static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+void cpu_skinner_t::skin(AnimatedModel* model) {
+    size_t count = model->vertices.size();
+    if (count == 0) return;
+    size_t bytes = count * sizeof(SkinnedVertex);
+
+    // orphan last frame's storage so the driver never waits on it
+    glBindBuffer(GL_ARRAY_BUFFER, model->skinnedVBO);
+    glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+    SkinnedVertex* out = (SkinnedVertex*)glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes,
+                                                          GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    bool mapped = out != nullptr;
+    if (!mapped) {
+        staging.resize(count);
+        out = staging.data();
+    }
+
+    const Vertex* in = model->vertices.data();
+    const glm::mat4* bones = model->m_FinalBoneMatrices.data();
+    int boneCount = model->m_FinalBoneMatrices.size();
+    bool avx2 = has_avx2();
+    (void)avx2;
+
+    pool.parallel_for(count, SKINNING_GRAIN, [&](size_t begin, size_t end) {
+#ifdef CPU_SKINNING_AVX2
+        if (avx2) {
+            skin_range_avx2(in, out, bones, boneCount, begin, end);
+            return;
+        }
+#endif
+        skin_range_scalar(in, out, bones, boneCount, begin, end);
+    });
+
+    if (mapped) {
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    } else {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, out);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
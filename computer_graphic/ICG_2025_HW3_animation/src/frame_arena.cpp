@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#include "header/frame_arena.h"
+
+// Counting replacement of the global operator new. The array and nothrow
+// forms forward to this one or to the aligned one below, so every C++ heap
+// allocation passes through.
+static thread_local unsigned long threadAllocations = 0;
+
+void* operator new(std::size_t size) {
+    threadAllocations++;
+    if (size == 0) size = 1;
+    while (true) {
+        void* p = std::malloc(size);
+        if (p) return p;
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) throw std::bad_alloc();
+        handler();
+    }
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+// Types aligned beyond __STDCPP_DEFAULT_NEW_ALIGNMENT__ come through the
+// align_val_t forms. Replaced as a set, so their memory is freed the way it
+// was allocated.
+static void* aligned_malloc(std::size_t size, std::size_t alignment) {
+#ifdef _WIN32
+    return _aligned_malloc(size, alignment);
+#else
+    void* p = nullptr;
+    if (alignment < sizeof(void*)) alignment = sizeof(void*);
+    return posix_memalign(&p, alignment, size) == 0 ? p : nullptr;
+#endif
+}
+
+static void aligned_free(void* p) {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    threadAllocations++;
+    if (size == 0) size = 1;
+    while (true) {
+        void* p = aligned_malloc(size, static_cast<std::size_t>(alignment));
+        if (p) return p;
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) throw std::bad_alloc();
+        handler();
+    }
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return ::operator new(size, alignment);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    aligned_free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+    aligned_free(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept {
+    aligned_free(p);
+}
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {
+    aligned_free(p);
+}
+
+unsigned long heap_allocations() {
+    return threadAllocations;
+}
+
+frame_arena_t& frame_arena() {
+    static thread_local frame_arena_t arena;
+    return arena;
+}
+
+frame_arena_t::frame_arena_t(size_t initialBytes) {
+    current = new_block(initialBytes, nullptr);
+}
+
+frame_arena_t::~frame_arena_t() {
+    while (current) {
+        block_t* previous = current->previous;
+        ::operator delete(current);
+        current = previous;
+    }
+}
+
+frame_arena_t::block_t* frame_arena_t::new_block(size_t size, block_t* previous) {
+    block_t* block = static_cast<block_t*>(::operator new(HEADER + size));
+    block->previous = previous;
+    block->size = size;
+    block->offset = HEADER;
+    return block;
+}
+
+void* frame_arena_t::allocate(size_t bytes, size_t alignment) {
+    size_t start = (current->offset + alignment - 1) & ~(alignment - 1);
+    if (start + bytes > HEADER + current->size) {
+        // chained until reset(), at least double so a growing frame adds few
+        size_t size = std::max(current->size * 2, bytes + alignment);
+        current = new_block(size, current);
+        start = (current->offset + alignment - 1) & ~(alignment - 1);
+    }
+    usedBytes += start + bytes - current->offset;
+    current->offset = start + bytes;
+    return reinterpret_cast<char*>(current) + start;
+}
+
+void frame_arena_t::reset() {
+    highWater = std::max(highWater, usedBytes);
+    usedBytes = 0;
+    if (current->previous) {
+        // overflowed: one block the size of all of them from now on
+        size_t total = capacity();
+        while (current) {
+            block_t* previous = current->previous;
+            ::operator delete(current);
+            current = previous;
+        }
+        current = new_block(total, nullptr);
+        return;
+    }
+    current->offset = HEADER;
+}
+
+size_t frame_arena_t::capacity() const {
+    size_t total = 0;
+    for (block_t* block = current; block; block = block->previous) total += block->size;
+    return total;
+}
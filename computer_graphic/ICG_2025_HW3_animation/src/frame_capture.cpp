@@ -0,0 +1,337 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#include "header/frame_capture.h"
+#include "header/profiler.h"
+#include "header/gpu_memory.h"
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+frame_capture_t::frame_capture_t(int w, int h, capture_format_t fmt, const std::string& out)
+    : width(w), height(h), format(fmt), target(out) {
+    if (format == CAPTURE_PNG) {
+        std::error_code error;
+        std::filesystem::create_directories(target, error);
+        if (error) {
+            std::cerr << "capture: cannot create " << target << ": " << error.message() << std::endl;
+            return;
+        }
+    } else {
+        if (width % 2 || height % 2) {
+            std::cerr << "capture: I420 needs an even frame size, got " << width << "x" << height << std::endl;
+            return;
+        }
+        pipe = popen(target.c_str(), "w");
+        if (!pipe) {
+            std::cerr << "capture: cannot start " << target << std::endl;
+            return;
+        }
+    }
+
+    size_t bytes = (size_t)width * height * 4;
+    for (slot_t& slot : slots) {
+        glGenBuffers(1, &slot.pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+        gpuMemory.track(GL_OBJECT_BUFFER, slot.pbo, GPU_MEMORY_STREAMING, "frame capture");
+        gpuMemory.resize(GL_OBJECT_BUFFER, slot.pbo, bytes);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    for (job_t& job : jobs) {
+        job.pixels.resize(bytes);
+        freeJobs.push_back(&job);
+    }
+    worker = std::thread(&frame_capture_t::worker_loop, this);
+    valid = true;
+}
+
+frame_capture_t::~frame_capture_t() {
+    if (valid) finish();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobReady.notify_one();
+    if (worker.joinable()) worker.join();
+    for (slot_t& slot : slots) {
+        if (slot.fence) glDeleteSync((GLsync)slot.fence);
+        if (!slot.pbo) continue;
+        gpuMemory.untrack(GL_OBJECT_BUFFER, slot.pbo);
+        glDeleteBuffers(1, &slot.pbo);
+    }
+    if (pipe) pclose(pipe);
+}
+
+void frame_capture_t::capture(unsigned int fbo, int w, int h) {
+    if (!valid) return;
+    if (w != width || h != height) {
+        skipped++;
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    // the ring wrapped: the oldest frame has to come back before its PBO is reused
+    slot_t& slot = slots[nextSlot];
+    if (slot.busy) collect(slot, true);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    glReadBuffer(fbo ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.frame = frameCounter++;
+    slot.busy = true;
+    nextSlot = (nextSlot + 1) % CAPTURE_RING_SIZE;
+
+    // hand over whatever finished since, oldest first, without waiting
+    for (int i = 0; i < CAPTURE_RING_SIZE; i++) {
+        slot_t& older = slots[(nextSlot + i) % CAPTURE_RING_SIZE];
+        if (!older.busy) continue;
+        if (!collect(older, false)) break;
+    }
+    captured++;
+    captureSeconds += seconds_since(start);
+}
+
+// Maps a slot whose readback is done and queues a copy for the worker.
+// false when the fence hasn't passed and wait is off.
+bool frame_capture_t::collect(slot_t& slot, bool wait) {
+    auto start = std::chrono::steady_clock::now();
+    GLsync fence = (GLsync)slot.fence;
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        if (!wait) return false;
+        do {
+            status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+        } while (status == GL_TIMEOUT_EXPIRED);
+    }
+    glDeleteSync(fence);
+    slot.fence = nullptr;
+
+    job_t* job;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        jobFree.wait(lock, [&] { return !freeJobs.empty(); });
+        job = freeJobs.back();
+        freeJobs.pop_back();
+    }
+    if (wait) stallSeconds += seconds_since(start);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    const void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, job->pixels.size(), GL_MAP_READ_BIT);
+    if (data) {
+        std::memcpy(job->pixels.data(), data, job->pixels.size());
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    job->frame = slot.frame;
+    slot.busy = false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (data) {
+            queue.push_back(job);
+        } else {
+            freeJobs.push_back(job);
+        }
+    }
+    jobReady.notify_one();
+    return true;
+}
+
+void frame_capture_t::finish() {
+    for (int i = 0; i < CAPTURE_RING_SIZE; i++) {
+        slot_t& slot = slots[(nextSlot + i) % CAPTURE_RING_SIZE];
+        if (slot.busy) collect(slot, true);
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    jobFree.wait(lock, [&] { return freeJobs.size() == CAPTURE_QUEUE_DEPTH; });
+    if (pipe) fflush(pipe);
+}
+
+unsigned long frame_capture_t::written() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return writtenFrames;
+}
+
+void frame_capture_t::worker_loop() {
+    PROFILE_THREAD("capture writer");
+    while (true) {
+        job_t* job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobReady.wait(lock, [&] { return stopping || !queue.empty(); });
+            if (queue.empty()) return;
+            job = queue.front();
+            queue.pop_front();
+        }
+
+        PROFILE_ZONE("capture.write");
+        if (format == CAPTURE_PNG) {
+            write_png(*job);
+        } else {
+            write_yuv(*job);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            freeJobs.push_back(job);
+            writtenFrames++;
+        }
+        jobFree.notify_one();
+    }
+}
+
+static uint32_t crc32_update(uint32_t crc, const unsigned char* data, size_t length) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t;
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void put_u32(std::vector<unsigned char>& out, uint32_t v) {
+    out.push_back(v >> 24);
+    out.push_back(v >> 16);
+    out.push_back(v >> 8);
+    out.push_back(v);
+}
+
+static void put_chunk(FILE* file, const char* type, const unsigned char* data, size_t length) {
+    std::vector<unsigned char> header;
+    put_u32(header, (uint32_t)length);
+    header.insert(header.end(), type, type + 4);
+    uint32_t crc = crc32_update(crc32_update(0, header.data() + 4, 4), data, length);
+    std::vector<unsigned char> footer;
+    put_u32(footer, crc);
+    fwrite(header.data(), 1, header.size(), file);
+    if (length) fwrite(data, 1, length, file);
+    fwrite(footer.data(), 1, footer.size(), file);
+}
+
+// 8-bit RGB PNG with stored (uncompressed) deflate blocks: no zlib needed and
+// next to no CPU on the writer, the files are for an encoder to pick up
+void frame_capture_t::write_png(const job_t& job) {
+    // rows come bottom first from GL; filter byte 0 per row
+    const size_t rowBytes = (size_t)width * 3 + 1;
+    scanlines.resize(rowBytes * height);
+    for (int y = 0; y < height; y++) {
+        const unsigned char* in = job.pixels.data() + (size_t)(height - 1 - y) * width * 4;
+        unsigned char* out = scanlines.data() + y * rowBytes;
+        *out++ = 0;
+        for (int x = 0; x < width; x++, in += 4, out += 3) {
+            out[0] = in[0];
+            out[1] = in[1];
+            out[2] = in[2];
+        }
+    }
+
+    // adler32, reduced every 5552 bytes as zlib does
+    uint32_t adlerA = 1, adlerB = 0;
+    for (size_t offset = 0; offset < scanlines.size(); offset += 5552) {
+        size_t end = std::min(offset + 5552, scanlines.size());
+        for (size_t i = offset; i < end; i++) {
+            adlerA += scanlines[i];
+            adlerB += adlerA;
+        }
+        adlerA %= 65521;
+        adlerB %= 65521;
+    }
+
+    encoded.clear();
+    encoded.push_back(0x78);
+    encoded.push_back(0x01);
+    for (size_t offset = 0; offset < scanlines.size(); offset += 65535) {
+        size_t block = std::min<size_t>(scanlines.size() - offset, 65535);
+        encoded.push_back(offset + block == scanlines.size() ? 1 : 0);
+        encoded.push_back(block & 0xFF);
+        encoded.push_back(block >> 8);
+        encoded.push_back(~block & 0xFF);
+        encoded.push_back((~block >> 8) & 0xFF);
+        encoded.insert(encoded.end(), scanlines.begin() + offset, scanlines.begin() + offset + block);
+    }
+    put_u32(encoded, (adlerB << 16) | adlerA);
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "frame_%06lu.png", job.frame);
+    std::string path = (std::filesystem::path(target) / name).string();
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "capture: cannot write " << path << std::endl;
+        return;
+    }
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    fwrite(signature, 1, 8, file);
+    std::vector<unsigned char> header;
+    put_u32(header, width);
+    put_u32(header, height);
+    header.push_back(8); // bit depth
+    header.push_back(2); // RGB
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(0);
+    put_chunk(file, "IHDR", header.data(), header.size());
+    put_chunk(file, "IDAT", encoded.data(), encoded.size());
+    put_chunk(file, "IEND", nullptr, 0);
+    std::fclose(file);
+}
+
+// BT.601 limited range I420, what rawvideo/yuv420p encoders assume by default
+void frame_capture_t::write_yuv(const job_t& job) {
+    const int chromaWidth = width / 2, chromaHeight = height / 2;
+    encoded.resize((size_t)width * height + 2 * (size_t)chromaWidth * chromaHeight);
+    unsigned char* yPlane = encoded.data();
+    unsigned char* uPlane = yPlane + (size_t)width * height;
+    unsigned char* vPlane = uPlane + (size_t)chromaWidth * chromaHeight;
+
+    for (int y = 0; y < height; y++) {
+        const unsigned char* row = job.pixels.data() + (size_t)(height - 1 - y) * width * 4;
+        unsigned char* out = yPlane + (size_t)y * width;
+        for (int x = 0; x < width; x++) {
+            int r = row[x * 4], g = row[x * 4 + 1], b = row[x * 4 + 2];
+            out[x] = (unsigned char)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        }
+    }
+    for (int y = 0; y < chromaHeight; y++) {
+        const unsigned char* row0 = job.pixels.data() + (size_t)(height - 1 - 2 * y) * width * 4;
+        const unsigned char* row1 = row0 - (size_t)width * 4;
+        for (int x = 0; x < chromaWidth; x++) {
+            const unsigned char* p[4] = { row0 + x * 8, row0 + x * 8 + 4, row1 + x * 8, row1 + x * 8 + 4 };
+            int r = 0, g = 0, b = 0;
+            for (const unsigned char* q : p) {
+                r += q[0];
+                g += q[1];
+                b += q[2];
+            }
+            r = (r + 2) / 4;
+            g = (g + 2) / 4;
+            b = (b + 2) / 4;
+            uPlane[(size_t)y * chromaWidth + x] = (unsigned char)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            vPlane[(size_t)y * chromaWidth + x] = (unsigned char)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+    if (fwrite(encoded.data(), 1, encoded.size(), pipe) != encoded.size()) {
+        std::cerr << "capture: encoder pipe closed" << std::endl;
+    }
+}
@@ -0,0 +1,225 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#include "header/gpu_memory.h"
+
+gpu_memory_t gpuMemory;
+
+const char* gpu_memory_t::category_name(gpu_memory_category_t category) {
+    switch (category) {
+    case GPU_MEMORY_TEXTURES: return "textures";
+    case GPU_MEMORY_TARGETS: return "targets";
+    case GPU_MEMORY_MESHES: return "meshes";
+    case GPU_MEMORY_STREAMING: return "streaming";
+    case GPU_MEMORY_PROGRAMS: return "programs";
+    default: return "?";
+    }
+}
+
+size_t gpu_memory_t::texture_bytes(unsigned int internalFormat, int width, int height, int depth, bool mipmaps) {
+    size_t texel;
+    switch (internalFormat) {
+    case GL_RED: case GL_R8: texel = 1; break;
+    case GL_R16F: case GL_RG: case GL_RG8: texel = 2; break;
+    // unsized RGB is stored as RGBA by every driver
+    case GL_RGB: case GL_RGB8: case GL_RGBA: case GL_RGBA8: case GL_SRGB8_ALPHA8:
+    case GL_R32F: case GL_RG16F: case GL_R11F_G11F_B10F:
+    case GL_DEPTH_COMPONENT24: case GL_DEPTH_COMPONENT32F: case GL_DEPTH24_STENCIL8: texel = 4; break;
+    case GL_RGB16F: case GL_RGBA16F: case GL_RG32F: texel = 8; break;
+    case GL_RGB32F: case GL_RGBA32F: texel = 16; break;
+    default: texel = 4; break;
+    }
+    size_t bytes = texel * (size_t)std::max(width, 0) * (size_t)std::max(height, 0) * (size_t)std::max(depth, 0);
+    // a full chain adds a third
+    return mipmaps ? bytes + bytes / 3 : bytes;
+}
+
+void gpu_memory_t::track(gl_object_type_t type, unsigned int id, gpu_memory_category_t category, const char* owner) {
+    if (id == 0) return;
+    untrack(type, id);
+    object_t object;
+    object.type = type;
+    object.id = id;
+    object.category = category;
+    object.owner = owner;
+    objects.emplace(key(type, id), object);
+    categoryCount[category]++;
+}
+
+void gpu_memory_t::set_bytes(object_t& object, size_t bytes) {
+    totalBytes = totalBytes - object.bytes + bytes;
+    categoryBytes[object.category] = categoryBytes[object.category] - object.bytes + bytes;
+    object.bytes = bytes;
+}
+
+void gpu_memory_t::resize(gl_object_type_t type, unsigned int id, size_t bytes, unsigned int format) {
+    auto it = objects.find(key(type, id));
+    if (it == objects.end()) return;
+    set_bytes(it->second, bytes);
+    it->second.format = format;
+}
+
+void gpu_memory_t::untrack(gl_object_type_t type, unsigned int id) {
+    auto it = objects.find(key(type, id));
+    if (it == objects.end()) return;
+    set_bytes(it->second, 0);
+    categoryCount[it->second.category]--;
+    objects.erase(it);
+    if (type == GL_OBJECT_TEXTURE) streamables.erase(id);
+}
+
+void gpu_memory_t::set_streamable(unsigned int texture, std::function<texture_upload_t()> decode) {
+    if (objects.find(key(GL_OBJECT_TEXTURE, texture)) == objects.end()) return;
+    streamable_t& entry = streamables[texture];
+    entry.decode = std::move(decode);
+    entry.lastUse = frame;
+    entry.evicted = false;
+}
+
+// The least recently bound texture not bound last frame or this one. Its
+// mip levels are emptied and level 0 becomes one grey texel, so the name
+// stays valid and complete for everyone holding it.
+bool gpu_memory_t::evict_one() {
+    unsigned int victim = 0;
+    unsigned long oldest = frame;
+    for (const auto& entry : streamables) {
+        if (!entry.second.evicted && entry.second.lastUse + 1 < frame && entry.second.lastUse < oldest) {
+            oldest = entry.second.lastUse;
+            victim = entry.first;
+        }
+    }
+    if (victim == 0) return false;
+
+    static const unsigned char grey[4] = { 128, 128, 128, 255 };
+    glBindTexture(GL_TEXTURE_2D, victim);
+    for (int level = 1; level < 16; level++) {
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    resize(GL_OBJECT_TEXTURE, victim, 4, GL_RGBA8);
+    streamables[victim].evicted = true;
+    evictions++;
+    return true;
+}
+
+void gpu_memory_t::end_frame() {
+    // Reloads decode on worker threads, the render thread only uploads what
+    // has been decoded, up to reloadBytesPerFrame a frame
+    if (reloadWanted) {
+        reloadWanted = false;
+        size_t uploaded = 0;
+        int decoding = 0;
+        for (auto& entry : streamables) {
+            streamable_t& texture = entry.second;
+            if (!texture.pending.valid()) continue;
+            if (uploaded < reloadBytesPerFrame &&
+                texture.pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                size_t bytes = texture.pending.get()();
+                glBindTexture(GL_TEXTURE_2D, 0);
+                texture.evicted = false;
+                texture.lastUse = frame;
+                resize(GL_OBJECT_TEXTURE, entry.first, bytes, objects[key(GL_OBJECT_TEXTURE, entry.first)].format);
+                uploaded += bytes;
+                reloads++;
+                continue;
+            }
+            decoding++;
+            reloadWanted = true;
+        }
+        for (auto& entry : streamables) {
+            streamable_t& texture = entry.second;
+            if (decoding >= GPU_MEMORY_MAX_DECODES) break;
+            if (!texture.evicted || texture.pending.valid()) continue;
+            if (texture.lastUse != frame) continue;
+            texture.pending = std::async(std::launch::async, texture.decode);
+            decoding++;
+            reloadWanted = true;
+        }
+    }
+    if (budget > 0 && totalBytes > budget) {
+        while (totalBytes > budget && evict_one()) {}
+        if (totalBytes > budget && !warnedOverBudget) {
+            std::cout << "[gpu-mem] " << totalBytes / 1048576.0 << " MB in use, nothing left to evict under the "
+                      << budget / 1048576.0 << " MB budget" << std::endl;
+            warnedOverBudget = true;
+        }
+    }
+    frame++;
+}
+
+void gpu_memory_t::report() const {
+    std::cout << "[gpu-mem] " << totalBytes / 1048576.0 << " MB";
+    if (budget > 0) std::cout << " of " << budget / 1048576.0 << " MB budget";
+    std::cout << ":";
+    for (int c = 0; c < GPU_MEMORY_CATEGORIES; c++) {
+        gpu_memory_category_t category = (gpu_memory_category_t)c;
+        std::cout << " " << category_name(category) << " " << categoryCount[c];
+        if (category != GPU_MEMORY_PROGRAMS) std::cout << " / " << categoryBytes[c] / 1048576.0 << " MB";
+        std::cout << (c + 1 < GPU_MEMORY_CATEGORIES ? "," : "");
+    }
+    if (!streamables.empty()) {
+        size_t evicted = 0;
+        for (const auto& entry : streamables) evicted += entry.second.evicted;
+        std::cout << " | streamable " << streamables.size() << ", evicted now " << evicted
+                  << ", evictions " << evictions << ", reloads " << reloads;
+    }
+    std::cout << std::endl;
+}
+
+void gpu_memory_t::list() const {
+    std::vector<const object_t*> sorted;
+    for (const auto& entry : objects) sorted.push_back(&entry.second);
+    std::sort(sorted.begin(), sorted.end(), [](const object_t* a, const object_t* b) {
+        return a->bytes != b->bytes ? a->bytes > b->bytes : a->id < b->id;
+    });
+    static const char* typeNames[] = { "buffer", "texture", "renderbuffer", "vertex array", "program" };
+    char line[192];
+    for (const object_t* object : sorted) {
+        std::snprintf(line, sizeof(line), "[gpu-mem] %10.3f MB  %-12s %5u  %-9s format 0x%04x  %s",
+                      object->bytes / 1048576.0, typeNames[object->type], object->id,
+                      category_name(object->category), object->format, object->owner);
+        std::cout << line << std::endl;
+    }
+}
+
+gl_object_t& gl_object_t::operator=(gl_object_t&& other) noexcept {
+    if (this != &other) {
+        reset();
+        type = other.type;
+        handle = other.handle;
+        other.handle = 0;
+    }
+    return *this;
+}
+
+unsigned int gl_object_t::create(gl_object_type_t objectType, gpu_memory_category_t category, const char* owner) {
+    reset();
+    type = objectType;
+    switch (type) {
+    case GL_OBJECT_BUFFER: glGenBuffers(1, &handle); break;
+    case GL_OBJECT_TEXTURE: glGenTextures(1, &handle); break;
+    case GL_OBJECT_RENDERBUFFER: glGenRenderbuffers(1, &handle); break;
+    case GL_OBJECT_VERTEX_ARRAY: glGenVertexArrays(1, &handle); break;
+    case GL_OBJECT_PROGRAM: handle = glCreateProgram(); break;
+    }
+    gpuMemory.track(type, handle, category, owner);
+    return handle;
+}
+
+void gl_object_t::reset() {
+    if (handle == 0) return;
+    gpuMemory.untrack(type, handle);
+    switch (type) {
+    case GL_OBJECT_BUFFER: glDeleteBuffers(1, &handle); break;
+    case GL_OBJECT_TEXTURE: glDeleteTextures(1, &handle); break;
+    case GL_OBJECT_RENDERBUFFER: glDeleteRenderbuffers(1, &handle); break;
+    case GL_OBJECT_VERTEX_ARRAY: glDeleteVertexArrays(1, &handle); break;
+    case GL_OBJECT_PROGRAM: glDeleteProgram(handle); break;
+    }
+    handle = 0;
+}
@@ -0,0 +1,122 @@
+#include <glad/glad.h>
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+
+#include "header/gpu_timer.h"
+#include "header/profiler.h"
+
+#ifndef GL_FRAGMENT_SHADER_INVOCATIONS_ARB
+#define GL_FRAGMENT_SHADER_INVOCATIONS_ARB 0x82F4
+#endif
+
+int gpu_timer_t::pipeline_statistics = -1;
+
+bool gpu_timer_t::has_pipeline_statistics() {
+    if (pipeline_statistics < 0) {
+        pipeline_statistics = 0;
+        int count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (int i = 0; i < count; i++) {
+            const char* ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (ext && strcmp(ext, "GL_ARB_pipeline_statistics_query") == 0) {
+                pipeline_statistics = 1;
+                break;
+            }
+        }
+    }
+    return pipeline_statistics == 1;
+}
+
+gpu_timer_t::~gpu_timer_t() {
+    for (auto& pass : passes) {
+        glDeleteQueries(QUERY_RING, pass.queries);
+        if (has_pipeline_statistics()) glDeleteQueries(QUERY_RING, pass.fragment_queries);
+    }
+}
+
+gpu_timer_t::pass_t* gpu_timer_t::find_or_create(const std::string& name) {
+    for (auto& pass : passes) {
+        if (pass.name == name) return &pass;
+    }
+    passes.emplace_back();
+    passes.back().name = name;
+    glGenQueries(QUERY_RING, passes.back().queries);
+    if (has_pipeline_statistics()) glGenQueries(QUERY_RING, passes.back().fragment_queries);
+    return &passes.back();
+}
+
+void gpu_timer_t::begin(const std::string& name) {
+    if (active) end();
+    PROFILE_GPU_BEGIN(name);
+    pass_t* pass = find_or_create(name);
+
+    // ring slot still in flight: drop this sample instead of waiting on it
+    if (pass->issued[pass->head]) {
+        active = nullptr;
+        return;
+    }
+    glBeginQuery(GL_TIME_ELAPSED, pass->queries[pass->head]);
+    if (has_pipeline_statistics()) {
+        glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB, pass->fragment_queries[pass->head]);
+    }
+    active = pass;
+}
+
+void gpu_timer_t::end() {
+    PROFILE_GPU_END();
+    if (!active) return;
+    glEndQuery(GL_TIME_ELAPSED);
+    if (has_pipeline_statistics()) glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB);
+    active->issued[active->head] = true;
+    active->head = (active->head + 1) % QUERY_RING;
+    active = nullptr;
+}
+
+void gpu_timer_t::resolve() {
+    for (auto& pass : passes) {
+        for (int i = 0; i < QUERY_RING; i++) {
+            if (!pass.issued[i]) continue;
+            int available = 0;
+            glGetQueryObjectiv(pass.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available && has_pipeline_statistics()) {
+                glGetQueryObjectiv(pass.fragment_queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            }
+            if (!available) continue;
+
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(pass.queries[i], GL_QUERY_RESULT, &ns);
+            pass.total_ms += ns / 1.0e6;
+            if (has_pipeline_statistics()) {
+                GLuint64 fragments = 0;
+                glGetQueryObjectui64v(pass.fragment_queries[i], GL_QUERY_RESULT, &fragments);
+                pass.total_fragments += fragments;
+            }
+            pass.samples++;
+            pass.issued[i] = false;
+        }
+    }
+}
+
+void gpu_timer_t::report(const std::string& label) {
+    std::cout << "[gpu] " << label;
+    double total = 0.0;
+    for (auto& pass : passes) {
+        if (pass.samples == 0) continue;
+        double ms = pass.total_ms / pass.samples;
+        total += ms;
+        std::cout << "  " << pass.name << " " << std::fixed << std::setprecision(3) << ms << "ms";
+        if (has_pipeline_statistics()) {
+            std::cout << " " << std::setprecision(0) << pass.total_fragments / pass.samples << "frag";
+        }
+    }
+    std::cout << "  | total " << std::fixed << std::setprecision(3) << total << "ms" << std::endl;
+}
+
+void gpu_timer_t::reset() {
+    for (auto& pass : passes) {
+        pass.total_ms = 0.0;
+        pass.total_fragments = 0.0;
+        pass.samples = 0;
+    }
+}
@@ -12,8 +12,14 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <memory>
+
+#include "bounds.h"
+#include "gpu_memory.h"
 
 #define MAX_BONE_INFLUENCE 4
+// texture unit the post-skin buffer texture is bound to for face stream draws
+#define SKINNED_BUFFER_TEXTURE_UNIT 2
 
 struct Vertex {
     glm::vec3 Position;
@@ -23,6 +29,27 @@ struct Vertex {
     float m_Weights[MAX_BONE_INFLUENCE];
 };
 
+// One entry of the post-skin buffer written by the skinning pass (model space)
+struct SkinnedVertex {
+    glm::vec4 Position;
+    glm::vec4 Normal;
+};
+
+// One corner of the de-indexed face stream used by the fx_*.vert effects. The
+// corner knows its whole triangle so the vertex shader can rebuild the face.
+struct FaceCorner {
+    int FaceIndices[4]; // xyz = triangle vertex indices, w = which of them is this corner
+    glm::vec2 TexCoords;
+    float Seed;         // triangle index, replaces gl_PrimitiveIDIn
+    float pad;
+};
+
+// Pixels decoded by stb_image, freed with the last copy
+struct DecodedImage {
+    std::shared_ptr<unsigned char> pixels;
+    int width = 0, height = 0, channels = 0;
+};
+
 struct BoneInfo {
     int id;
     glm::mat4 offset;
@@ -32,11 +59,29 @@ class AnimatedModel {
 public:
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
-    unsigned int VAO, VBO, EBO;
-    unsigned int texture;
+    // GL objects are released with the model
+    gl_object_t VAO, VBO, EBO;
+    gl_object_t texture; // streamable when loaded from an image
+    
+    // post-skin vertex buffer, filled once per frame by the skinning pass and
+    // drawn through skinnedVAO with non-skinning vertex shaders
+    gl_object_t skinnedVAO, skinnedVBO;
+    bool skinnedValid = false; // buffer holds the current pose
+    // buffer texture over skinnedVBO and the per-corner face stream for the
+    // vertex-stage explosion/pulse/aura effects (built once at load time)
+    gl_object_t skinnedTBO;
+    gl_object_t faceVAO, faceVBO;
+
+    // Conservative bounds for culling. Each bone gets the box of the bind-pose
+    // vertices it moves (built at load time); the current pose is the union of
+    // those boxes mapped through the palette, so it never has to skin anything.
+    std::vector<aabb_t> m_BoneBounds;
+    aabb_t m_UnskinnedBounds; // vertices no bone moves
+    aabb_t m_Bounds;          // current pose, model space
     
     // bone stuff
-    std::map<std::string, BoneInfo> m_BoneInfoMap;
+    // std::less<> so the pose code can look up a node's const char* name
+    std::map<std::string, BoneInfo, std::less<>> m_BoneInfoMap;
     int m_BoneCounter = 0;
     
     // animation
@@ -44,30 +89,68 @@ public:
     Assimp::Importer m_Importer;
     
     AnimatedModel(const std::string& path);
+    // the texture goes first, it waits for a reload decoding from m_Importer
+    ~AnimatedModel() { texture.reset(); }
     void loadModel(const std::string& path);
     void processNode(aiNode* node, const aiScene* scene);
     void processMesh(aiMesh* mesh, const aiScene* scene);
     void loadTexture(const std::string& filepath);
     void setupMesh();
-    void render();
+    void setupFaceStream();
+    // no animation: the post-skin buffer only has to be written once
+    bool isStaticPose() const { return m_CurrentAnimation == nullptr; }
+    void computeBoneBounds();
+    void updateBounds();
+    aabb_t poseBounds(const std::vector<glm::mat4>& palette) const;
     
     // animation functions
     void updateAnimation(float timeInSeconds);
-    void calculateBoneTransform(const aiNode* node, glm::mat4 parentTransform, float animationTime);
-    glm::mat4 aiMatrix4x4ToGlm(const aiMatrix4x4& from);
-    glm::vec3 aiVector3DToGlm(const aiVector3D& vec);
-    glm::quat aiQuaternionToGlm(const aiQuaternion& pOrientation);
+    // seconds until updateAnimation() repeats, 0 when the pose never changes
+    float getAnimationDuration() const;
+    // Pose at timeInSeconds into an outside palette without touching the model,
+    // so the simulation thread can pose while the render thread draws.
+    // Static models leave the palette empty.
+    void evaluatePose(float timeInSeconds, std::vector<glm::mat4>& palette, aabb_t& bounds) const;
+    // render side: take a pose from evaluatePose() as the current one
+    void applyPose(const std::vector<glm::mat4>& palette, const aabb_t& bounds);
+    void calculateBoneTransform(const aiNode* node, glm::mat4 parentTransform, float animationTime,
+                                std::vector<glm::mat4>& palette) const;
+    // channel of the current animation driving nodeName, nullptr if none
+    const aiNodeAnim* findChannel(const char* nodeName) const;
+    // Key interval holding time, keys[i].mTime <= time < keys[i + 1].mTime
+    // (times before the first key fall in interval 0), or count - 1 past the last key
+    template <typename Key>
+    static unsigned int findKeyIndex(const Key* keys, unsigned int count, float time) {
+        for (unsigned int i = 0; i + 1 < count; i++) {
+            if (time < (float)keys[i + 1].mTime) return i;
+        }
+        return count - 1;
+    }
+    glm::mat4 aiMatrix4x4ToGlm(const aiMatrix4x4& from) const;
+    glm::vec3 aiVector3DToGlm(const aiVector3D& vec) const;
+    glm::quat aiQuaternionToGlm(const aiQuaternion& pOrientation) const;
     
     // bone functions
     void setVertexBoneDataToDefault(Vertex& vertex);
     void setVertexBoneData(Vertex& vertex, int boneID, float weight);
     void loadMaterialTextures(const aiScene* scene);
+    // Decodes an embedded image, or the first of paths that loads, into the
+    // bound GL_TEXTURE_2D with mipmaps; returns the bytes uploaded (0: nothing
+    // loaded) and the path used
+    size_t uploadTexture(const aiTexture* embedded, const std::vector<std::string>& paths,
+                         std::string* loadedPath = nullptr);
+    // the two halves of it: decoding touches no GL and runs on any thread
+    static DecodedImage decodeTexture(const aiTexture* embedded, const std::vector<std::string>& paths,
+                                      std::string* loadedPath = nullptr);
+    size_t uploadTexture(const DecodedImage& image);
+    void makeTextureStreamable(const aiTexture* embedded, const std::vector<std::string>& paths);
     std::string strReplace(std::string str, const std::string& oldStr, const std::string& newStr);
     void extractBoneWeightForVertices(std::vector<Vertex>& vertices, aiMesh* mesh, const aiScene* scene);
     
     std::vector<glm::mat4> m_FinalBoneMatrices;
     
 private:
+    std::string m_Path; // owner name of the GL objects
     float m_AnimationTime = 0.0f;
     aiAnimation* m_CurrentAnimation = nullptr;
 };
@@ -0,0 +1,36 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+
+// Axis aligned box. An empty box has min > max.
+struct aabb_t {
+    glm::vec3 min = glm::vec3(1e30f);
+    glm::vec3 max = glm::vec3(-1e30f);
+
+    bool empty() const { return min.x > max.x; }
+    void expand(const glm::vec3& p);
+    void expand(const aabb_t& box);
+    void pad(float amount);
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+    glm::vec3 extent() const { return (max - min) * 0.5f; }
+};
+
+// Box enclosing the 8 transformed corners of box (center/extent form, Arvo)
+aabb_t transform_aabb(const aabb_t& box, const glm::mat4& m);
+
+// Six planes (xyz = inward normal, w = distance), inside when dot(n, p) + w >= 0
+struct frustum_t {
+    glm::vec4 planes[6];
+};
+
+// Gribb/Hartmann plane extraction from a projection * view matrix
+frustum_t extract_frustum(const glm::mat4& viewProjection);
+
+// Writes visible[i] = 1 if boxes[i] touches the frustum, 0 otherwise, and
+// returns the visible count. Four boxes per iteration with SSE on x86.
+size_t frustum_cull(const frustum_t& frustum, const aabb_t* boxes, size_t count, uint8_t* visible);
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef CLUSTERED_LIGHTING_H
+#define CLUSTERED_LIGHTING_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+class shader_program_t;
+
+// texture units of the three light buffer textures
+#define LIGHT_TEXTURE_UNIT 4        // RGBA32F, LIGHT_TEXELS per light
+#define CLUSTER_TEXTURE_UNIT 5      // RG32UI, (first index, light count) per cluster
+#define LIGHT_INDEX_TEXTURE_UNIT 6  // R32UI, light indices grouped by cluster
+#define LIGHT_TEXELS 3
+
+// View-space cluster grid: screen tiles in x/y, exponential depth slices in z.
+// Defined for the shaders too, see shaders/fragment.glsl.
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+
+// Point light, or spot light when cosOuter >= -1. Texel layout:
+//   (position, radius) (color, cosOuter) (direction, cosInner)
+struct dynamic_light_t {
+    glm::vec3 position;
+    float radius = 10.0f;       // no contribution beyond it
+    glm::vec3 color;            // already scaled by intensity
+    float cosOuter = -2.0f;
+    glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+    float cosInner = -1.0f;
+};
+
+// Clustered forward lighting. Every frame the lights are binned on the CPU
+// into the clusters their sphere touches (SSE, four clusters of a row per
+// test) and the fragment shaders loop over their own cluster's list only, so
+// the per-fragment cost follows the local light density, not the light count.
+class light_clusters_t {
+public:
+    light_clusters_t();
+    ~light_clusters_t();
+    // bin into the grid of this camera and upload the buffers
+    void update(const std::vector<dynamic_light_t>& lights, const glm::mat4& view,
+                float fovY, float aspect, float nearPlane, float farPlane);
+    void bind();
+    // sampler units and grid parameters, for programs that shade with the lights
+    void set_uniforms(shader_program_t* program, int screenWidth, int screenHeight) const;
+
+    size_t light_count() const { return lightCount; }
+    size_t index_count() const { return indices.size(); }
+    uint32_t max_cluster_lights() const { return maxClusterLights; }
+
+private:
+    void build_cluster_bounds(float fovY, float aspect, float nearPlane, float farPlane);
+    int slice(float depth) const;
+
+    unsigned int lightBuffer, clusterBuffer, indexBuffer;
+    unsigned int lightTexture, clusterTexture, indexTexture;
+
+    // view-space cluster boxes, structure of arrays so a row is tested 4 at a time
+    float boundsKey[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+    float nearPlane = 0.1f, farPlane = 1.0f, tanHalfX = 1.0f, tanHalfY = 1.0f, sliceScale = 1.0f;
+    glm::mat4 view = glm::mat4(1.0f);
+
+    std::vector<glm::vec4> texels;
+    std::vector<uint32_t> clusterRanges; // (first, count) pairs
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> pairCluster, pairLight;
+    size_t lightCount = 0;
+    uint32_t maxClusterLights = 0;
+};
+
+#endif
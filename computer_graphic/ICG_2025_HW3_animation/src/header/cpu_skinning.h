@@ -0,0 +1,24 @@
+#ifndef CPU_SKINNING_H
+#define CPU_SKINNING_H
+
+#include "animated_model.h"
+#include "thread_pool.h"
+
+// CPU skinning backend for software GL (llvmpipe) and GPU-less nodes. Skins
+// AnimatedModel::vertices with m_FinalBoneMatrices across a thread pool and
+// streams the result into the model's post-skin buffer, which is then drawn
+// with the same preskinned_*.vert shaders as the transform feedback path.
+class cpu_skinner_t {
+public:
+    explicit cpu_skinner_t(unsigned int workerCount = 0);
+    void skin(AnimatedModel* model);
+    // AVX2+FMA kernel is picked at runtime, scalar glm fallback otherwise
+    static bool has_avx2();
+    unsigned int thread_count() const { return pool.size(); }
+
+private:
+    thread_pool_t pool;
+    std::vector<SkinnedVertex> staging; // only used if the buffer can't be mapped
+};
+
+#endif
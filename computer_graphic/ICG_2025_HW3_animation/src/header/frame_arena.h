@@ -0,0 +1,108 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator for data that only lives until the end of the frame: draw
+// callbacks, caster lists, scratch arrays. Every thread has its own (see
+// frame_arena()), the thread that owns a frame resets it at the end, and
+// nothing is freed before that. A frame that overflows the block chains more
+// blocks on; reset() then swaps them for one block that holds them all, so
+// after the first frames the arena stops touching the heap. Destructors are
+// never run, which create() checks.
+class frame_arena_t {
+public:
+    explicit frame_arena_t(size_t initialBytes = 64 * 1024);
+    ~frame_arena_t();
+    frame_arena_t(const frame_arena_t&) = delete;
+    frame_arena_t& operator=(const frame_arena_t&) = delete;
+
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+    template <typename T, typename... Args>
+    T* create(Args&&... args) {
+        static_assert(std::is_trivially_destructible<T>::value, "the frame arena never runs destructors");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+    // invalidates everything allocated since the last reset()
+    void reset();
+
+    size_t used() const { return usedBytes; }     // this frame
+    size_t capacity() const;
+    size_t high_water() const { return highWater; } // most one frame used
+
+private:
+    struct block_t {
+        block_t* previous;
+        size_t size;
+        size_t offset;
+    };
+    // the header sits in front of the data, padded to max_align_t
+    static const size_t HEADER = (sizeof(block_t) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+    block_t* new_block(size_t size, block_t* previous);
+
+    block_t* current = nullptr;
+    size_t usedBytes = 0;
+    size_t highWater = 0;
+};
+
+// the calling thread's arena
+frame_arena_t& frame_arena();
+
+// operator new calls made by the calling thread so far. With the arena in
+// place a steady-state frame shouldn't add any; the report prints the rate.
+unsigned long heap_allocations();
+
+// std allocator on the arena of the thread that made it. deallocate() is a
+// no-op, so reserve() up front rather than growing.
+template <typename T>
+struct frame_allocator_t {
+    using value_type = T;
+    frame_allocator_t() noexcept : arena(&frame_arena()) {}
+    template <typename U>
+    frame_allocator_t(const frame_allocator_t<U>& other) noexcept : arena(other.arena) {}
+    T* allocate(size_t count) { return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T))); }
+    void deallocate(T*, size_t) noexcept {}
+    frame_arena_t* arena;
+};
+template <typename T, typename U>
+bool operator==(const frame_allocator_t<T>& a, const frame_allocator_t<U>& b) { return a.arena == b.arena; }
+template <typename T, typename U>
+bool operator!=(const frame_allocator_t<T>& a, const frame_allocator_t<U>& b) { return a.arena != b.arena; }
+
+template <typename T>
+using frame_vector_t = std::vector<T, frame_allocator_t<T>>;
+
+// std::function for callbacks that don't outlive the frame. The callable is
+// copied into the arena once; copies of the function share it, so a capture
+// of any size costs no heap allocation. Callables must be trivially
+// destructible (pointers, ints, matrices).
+template <typename Signature>
+class frame_function_t;
+
+template <typename R, typename... Args>
+class frame_function_t<R(Args...)> {
+public:
+    frame_function_t() = default;
+    template <typename F, typename = typename std::enable_if<
+                              !std::is_same<typename std::decay<F>::type, frame_function_t>::value>::type>
+    frame_function_t(F&& f) {
+        using callable_t = typename std::decay<F>::type;
+        callable = frame_arena().create<callable_t>(std::forward<F>(f));
+        invoke = [](const void* c, Args... args) -> R {
+            return (*static_cast<const callable_t*>(c))(std::forward<Args>(args)...);
+        };
+    }
+
+    R operator()(Args... args) const { return invoke(callable, std::forward<Args>(args)...); }
+    explicit operator bool() const { return invoke != nullptr; }
+
+private:
+    const void* callable = nullptr;
+    R (*invoke)(const void*, Args...) = nullptr;
+};
+
+#endif
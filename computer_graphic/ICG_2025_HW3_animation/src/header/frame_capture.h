@@ -0,0 +1,90 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// PBOs the readback rotates through: a frame is mapped this many frames
+// after its glReadPixels, by when the GPU has long finished it
+#define CAPTURE_RING_SIZE 3
+// frames copied out of the ring but not written yet; capture() blocks beyond
+#define CAPTURE_QUEUE_DEPTH 4
+
+enum capture_format_t {
+    CAPTURE_PNG,      // numbered RGB images in a directory
+    CAPTURE_YUV_PIPE  // raw I420 frames on the stdin of an encoder command
+};
+
+// Records the frames the render loop draws without stalling it. capture()
+// queues an asynchronous glReadPixels into the next PBO of a ring with a
+// fence behind it; PBOs whose fence has passed are mapped, copied into a
+// recycled buffer and handed to a worker thread, which flips, converts and
+// writes them. Nothing is dropped: a slow writer blocks capture() instead.
+class frame_capture_t {
+public:
+    // target: output directory for CAPTURE_PNG, shell command for CAPTURE_YUV_PIPE
+    frame_capture_t(int width, int height, capture_format_t format, const std::string& target);
+    ~frame_capture_t();
+    bool ok() const { return valid; }
+
+    // after the frame is drawn into fbo (0 = back buffer), before the swap;
+    // frames of another size (window resized) are skipped
+    void capture(unsigned int fbo, int width, int height);
+    // every frame captured so far is written when this returns
+    void finish();
+
+    // counters since the last reset_counters(), times on the render thread
+    unsigned long captured = 0;
+    unsigned long skipped = 0;
+    double captureSeconds = 0.0; // inside capture()
+    double stallSeconds = 0.0;   // of that, waiting on a fence or the writer
+    void reset_counters() { captured = skipped = 0; captureSeconds = stallSeconds = 0.0; }
+    unsigned long written() const;
+
+private:
+    struct slot_t {
+        unsigned int pbo = 0;
+        void* fence = nullptr; // GLsync
+        unsigned long frame = 0;
+        bool busy = false;
+    };
+    struct job_t {
+        std::vector<unsigned char> pixels; // RGBA, bottom row first
+        unsigned long frame = 0;
+    };
+
+    bool collect(slot_t& slot, bool wait);
+    void worker_loop();
+    void write_png(const job_t& job);
+    void write_yuv(const job_t& job);
+
+    int width, height;
+    capture_format_t format;
+    std::string target;
+    bool valid = false;
+    slot_t slots[CAPTURE_RING_SIZE];
+    int nextSlot = 0;
+    unsigned long frameCounter = 0;
+
+    job_t jobs[CAPTURE_QUEUE_DEPTH];
+    std::vector<job_t*> freeJobs;
+    std::deque<job_t*> queue;
+    mutable std::mutex mutex;
+    std::condition_variable jobReady;  // worker: something in queue
+    std::condition_variable jobFree;   // render thread: a buffer came back
+    bool stopping = false;
+    unsigned long writtenFrames = 0;
+    std::thread worker;
+
+    // worker side
+    FILE* pipe = nullptr;
+    std::vector<unsigned char> scanlines, encoded;
+};
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef GPU_MEMORY_H
+#define GPU_MEMORY_H
+
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+enum gpu_memory_category_t {
+    GPU_MEMORY_TEXTURES,   // model textures and cubemaps
+    GPU_MEMORY_TARGETS,    // render targets, depth buffers, shadow maps, atlases
+    GPU_MEMORY_MESHES,     // vertex, index and post-skin buffers
+    GPU_MEMORY_STREAMING,  // buffers rewritten every frame (instances, lights)
+    GPU_MEMORY_PROGRAMS,   // counted only, GL 3.3 can't tell their size
+    GPU_MEMORY_CATEGORIES
+};
+
+enum gl_object_type_t {
+    GL_OBJECT_BUFFER,
+    GL_OBJECT_TEXTURE,
+    GL_OBJECT_RENDERBUFFER,
+    GL_OBJECT_VERTEX_ARRAY,
+    GL_OBJECT_PROGRAM
+};
+
+// Brings an evicted texture back on the render thread: binds it to
+// GL_TEXTURE_2D, uploads it and returns its size in bytes (0 on failure)
+typedef std::function<size_t()> texture_upload_t;
+
+// textures decoding at once for reloads, each on a thread of its own
+#define GPU_MEMORY_MAX_DECODES 2
+
+// What every live GL object holds, by category and owner. Sizes are what
+// the storage calls asked for (drivers pad and keep copies, so real usage
+// is higher). With a budget set, textures marked streamable are evicted
+// least recently bound first down to a 1x1 placeholder under the same
+// name, decoded again off the render thread once something binds them and
+// uploaded when that is done.
+// GL thread only.
+class gpu_memory_t {
+public:
+    // owner must outlive the object: a literal or a string owned by it
+    void track(gl_object_type_t type, unsigned int id, gpu_memory_category_t category, const char* owner);
+    // the object's storage was (re)allocated
+    void resize(gl_object_type_t type, unsigned int id, size_t bytes, unsigned int format = 0);
+    void untrack(gl_object_type_t type, unsigned int id);
+    static size_t texture_bytes(unsigned int internalFormat, int width, int height, int depth = 1, bool mipmaps = false);
+
+    // decode runs off the render thread without GL and returns the upload
+    void set_streamable(unsigned int texture, std::function<texture_upload_t()> decode);
+    // every texture bind; an evicted texture starts decoding at the next
+    // end_frame() and is uploaded by one of the following ones
+    void touch(unsigned int texture) {
+        if (streamables.empty()) return;
+        auto it = streamables.find(texture);
+        if (it != streamables.end()) {
+            it->second.lastUse = frame;
+            if (it->second.evicted) reloadWanted = true;
+        }
+    }
+    // once per frame, outside the render queue (binds GL_TEXTURE_2D)
+    void end_frame();
+
+    size_t budget = 0; // bytes, 0 = no limit
+    // reloaded bytes uploaded per end_frame(), past it the rest wait a frame
+    // (one texture always goes through)
+    size_t reloadBytesPerFrame = 16 << 20;
+    size_t total() const { return totalBytes; }
+    size_t bytes(gpu_memory_category_t category) const { return categoryBytes[category]; }
+    size_t count(gpu_memory_category_t category) const { return categoryCount[category]; }
+    static const char* category_name(gpu_memory_category_t category);
+    // one line per category
+    void report() const;
+    // every object, largest first
+    void list() const;
+
+    // counters since the last reset_counters()
+    unsigned long evictions = 0, reloads = 0;
+    void reset_counters() { evictions = reloads = 0; }
+
+private:
+    struct object_t {
+        gl_object_type_t type;
+        unsigned int id;
+        gpu_memory_category_t category;
+        const char* owner;
+        size_t bytes = 0;
+        unsigned int format = 0;
+    };
+    struct streamable_t {
+        std::function<texture_upload_t()> decode;
+        std::future<texture_upload_t> pending; // decoding, its destructor waits for it
+        unsigned long lastUse = 0;
+        bool evicted = false;
+    };
+    static unsigned long long key(gl_object_type_t type, unsigned int id) {
+        return ((unsigned long long)type << 32) | id;
+    }
+    void set_bytes(object_t& object, size_t bytes);
+    bool evict_one();
+
+    std::unordered_map<unsigned long long, object_t> objects;
+    std::unordered_map<unsigned int, streamable_t> streamables;
+    size_t totalBytes = 0;
+    size_t categoryBytes[GPU_MEMORY_CATEGORIES] = {};
+    size_t categoryCount[GPU_MEMORY_CATEGORIES] = {};
+    unsigned long frame = 0;
+    bool reloadWanted = false;
+    bool warnedOverBudget = false;
+};
+
+extern gpu_memory_t gpuMemory;
+
+// One GL object, deleted and untracked with whatever owns it. Converts to
+// the GL name so it drops in where a raw unsigned int was used.
+class gl_object_t {
+public:
+    gl_object_t() = default;
+    ~gl_object_t() { reset(); }
+    gl_object_t(const gl_object_t&) = delete;
+    gl_object_t& operator=(const gl_object_t&) = delete;
+    gl_object_t(gl_object_t&& other) noexcept { *this = std::move(other); }
+    gl_object_t& operator=(gl_object_t&& other) noexcept;
+
+    // generates a new object of type (deleting the current one)
+    unsigned int create(gl_object_type_t type, gpu_memory_category_t category, const char* owner);
+    // after glBufferData / glTexImage / glRenderbufferStorage
+    void resize(size_t bytes, unsigned int format = 0) { gpuMemory.resize(type, handle, bytes, format); }
+    void reset();
+
+    unsigned int id() const { return handle; }
+    operator unsigned int() const { return handle; }
+
+private:
+    gl_object_type_t type = GL_OBJECT_BUFFER;
+    unsigned int handle = 0;
+};
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <string>
+#include <vector>
+
+// Per-pass GPU timing with GL_TIME_ELAPSED queries. Every pass owns a small ring
+// of query objects so results are read a few frames late and never stall.
+// Passes must not nest (only one GL_TIME_ELAPSED query can be active).
+// With GL_ARB_pipeline_statistics_query each pass also counts its fragment
+// shader invocations.
+class gpu_timer_t {
+public:
+    static const int QUERY_RING = 4;
+
+    static bool has_pipeline_statistics();
+
+    ~gpu_timer_t();
+    void begin(const std::string& pass);
+    void end();
+    // collect finished results, call once per frame after all passes
+    void resolve();
+    // average milliseconds per pass since the last reset
+    void report(const std::string& label);
+    void reset();
+
+private:
+    struct pass_t {
+        std::string name;
+        unsigned int queries[QUERY_RING] = {0};
+        unsigned int fragment_queries[QUERY_RING] = {0};
+        bool issued[QUERY_RING] = {false};
+        int head = 0;
+        double total_ms = 0.0;
+        double total_fragments = 0.0;
+        int samples = 0;
+    };
+    pass_t* find_or_create(const std::string& pass);
+
+    std::vector<pass_t> passes;
+    pass_t* active = nullptr;
+
+    static int pipeline_statistics; // -1 = not queried yet
+};
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef HEADLESS_CONTEXT_H
+#define HEADLESS_CONTEXT_H
+
+// GL 3.3 core context without a window, for batch runs on machines with no
+// display: a surfaceless EGL context (GPU device, Mesa surfaceless or default
+// display, whichever comes up first) drawing into an offscreen framebuffer
+// that stands in for the backbuffer. Needs a build with ICG_HEADLESS_EGL.
+class headless_context_t {
+public:
+    ~headless_context_t();
+    // context current on the calling thread, GL functions not loaded yet
+    bool create();
+    // after gladLoadGLLoader(proc_address): the width x height output target
+    bool create_target(int width, int height);
+    // deletes the output target, context still current
+    void destroy_target();
+    void destroy();
+
+    static void* proc_address(const char* name);
+    unsigned int output_fbo() const { return fbo; }
+    const char* platform() const { return platformName; }
+
+private:
+    void* display = nullptr;
+    void* context = nullptr;
+    const char* platformName = "none";
+    unsigned int fbo = 0, colorBuffer = 0, depthBuffer = 0;
+};
+
+#endif
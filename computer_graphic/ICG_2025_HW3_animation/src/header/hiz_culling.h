@@ -0,0 +1,73 @@
+#ifndef HIZ_CULLING_H
+#define HIZ_CULLING_H
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+#include "bounds.h"
+
+class shader_program_t;
+
+// Max-depth pyramid of the scene framebuffer's depth. The pyramid is built on
+// the GPU and its first level at most HIZ_READBACK_WIDTH texels wide is read
+// back, so occlusion tests run on the CPU against a few thousand texels.
+// The readback goes into a PBO. Deciding what phase 1 draws next frame can use
+// one mapped a frame later, which doesn't wait for the draws; the late draws
+// need this frame's pyramid and wait() for it. Every readback keeps the
+// bounds and view-projection it was built with and is tested with those, so
+// an instance is never hidden by its own older depth.
+#define HIZ_READBACK_WIDTH 64
+// PBOs the readback alternates between
+#define HIZ_READBACK_SLOTS 2
+
+class hiz_pyramid_t {
+public:
+    explicit hiz_pyramid_t(const std::string& shaderDir);
+    ~hiz_pyramid_t();
+    // downsample what has been drawn so far into sceneFBO (seen through
+    // viewProjection, instance boxes in bounds), leaves it bound. Queues its
+    // readback and takes over the one queued last frame if the GPU is done
+    // with it.
+    void build(int width, int height, const glm::mat4& viewProjection, const std::vector<aabb_t>& bounds,
+               unsigned int sceneFBO = 0);
+    // waits for the readback of the last build(), tests see this frame's pyramid
+    void wait();
+    // true when the instance's whole box was behind the depth of the readback
+    // in use, both as they were when it was built
+    bool occluded(size_t instance) const;
+    bool valid() const { return !readback.empty(); }
+
+    // counters since the last reset_counters()
+    unsigned long waits = 0;
+    unsigned long dropped = 0; // readbacks not back before their PBO was reused
+    void reset_counters() { waits = dropped = 0; }
+
+private:
+    struct slot_t {
+        unsigned int pbo = 0;
+        void* fence = nullptr; // GLsync
+        glm::mat4 viewProjection;
+        std::vector<aabb_t> bounds;
+    };
+
+    void resize(int width, int height);
+    void release_slots();
+    // false when the fence hasn't passed and wait is off
+    bool collect(slot_t& slot, bool wait);
+
+    shader_program_t* program;
+    unsigned int depthTexture = 0, depthFBO = 0;
+    unsigned int pyramidTexture = 0, pyramidFBO = 0;
+    unsigned int emptyVAO = 0;
+    int width = 0, height = 0;
+    std::vector<int> levelWidth, levelHeight;
+    int readbackLevel = 0;
+    slot_t slots[HIZ_READBACK_SLOTS];
+    int nextSlot = 0;
+    std::vector<float> readback;
+    glm::mat4 readbackViewProjection;
+    std::vector<aabb_t> readbackBounds;
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef IMPOSTOR_H
+#define IMPOSTOR_H
+
+#include <glm/glm.hpp>
+#include <functional>
+#include <map>
+#include <string>
+
+class shader_program_t;
+class AnimatedModel;
+
+#define IMPOSTOR_VIEWS 8    // octahedral grid of IMPOSTOR_VIEWS^2 view directions
+#define IMPOSTOR_CELL 64    // texels per side of one view
+#define IMPOSTOR_FRAMES 8   // animation frames baked over one loop
+
+// One character baked into a 2D array texture: a layer per animation frame,
+// each layer an IMPOSTOR_VIEWS x IMPOSTOR_VIEWS grid of views. Cell (i, j)
+// looks at the bounding sphere from impostor_direction((i + 0.5) / VIEWS, ...).
+struct impostor_atlas_t {
+    unsigned int texture = 0;
+    int frames = 1;
+    float duration = 0.0f;      // animation loop in seconds, 0 for a static pose
+    glm::vec3 center;           // model-space sphere around every baked pose
+    float radius = 0.0f;
+};
+
+// Octahedral map around y: unit direction <-> [0, 1]^2 (impostor.frag has the same)
+glm::vec2 impostor_encode(const glm::vec3& direction);
+glm::vec3 impostor_decode(const glm::vec2& uv);
+
+// Bakes atlases and draws instances as one camera-facing quad that blends the
+// four nearest views of the two nearest animation frames. The mesh and the
+// impostor crossfade with complementary screen-door dither (impostorBlend in
+// toon.frag / impostor.frag), so neither needs blending or sorting.
+class impostor_renderer_t {
+public:
+    explicit impostor_renderer_t(const std::string& shaderDir);
+    ~impostor_renderer_t();
+    // uniforms sets the light/material the bake shades with, like the mesh's
+    const impostor_atlas_t* bake(AnimatedModel* model, const std::function<void(shader_program_t*)>& uniforms);
+    const impostor_atlas_t* find(const AnimatedModel* model) const;
+
+    shader_program_t* program() const { return drawProgram; }
+    unsigned int quad_vao() const { return emptyVAO; }
+    // per-instance uniforms, with program() current
+    void set_instance_uniforms(const impostor_atlas_t& atlas, const glm::mat4& model, float time, float blend);
+
+private:
+    shader_program_t* bakeProgram;
+    shader_program_t* drawProgram;
+    unsigned int emptyVAO = 0;
+    std::map<const AnimatedModel*, impostor_atlas_t> atlases;
+};
+
+#endif
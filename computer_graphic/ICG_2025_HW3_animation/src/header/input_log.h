@@ -0,0 +1,46 @@
+#ifndef INPUT_LOG_H
+#define INPUT_LOG_H
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// The input the simulation consumed, one entry per change, stamped with the
+// fixed step it applied to. Replaying it into the same step numbers at the
+// same step rate reproduces the camera path, toggles and finale transition
+// of the recorded run exactly, however the steps land on frames.
+//
+// Text file, one event per line after a header with the step rate:
+//   icg-input 1 <steps per second>
+//   a <step> <orbit x> <orbit y> <zoom>   held keys changed
+//   k <step> <glfw key>                   toggle key pressed
+class input_log_t {
+public:
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+
+    // recording, steps ascending: only changes are kept
+    void record(unsigned long step, const glm::vec2& orbit, float zoom, const std::vector<int>& presses);
+    // replay, steps ascending: the recorded input of step
+    void replay(unsigned long step, glm::vec2& orbit, float& zoom, std::vector<int>& presses);
+    // nothing recorded after step
+    bool finished(unsigned long step) const { return events.empty() || step > events.back().step; }
+    unsigned long last_step() const { return events.empty() ? 0 : events.back().step; }
+    size_t size() const { return events.size(); }
+
+    int stepRate = 60;
+
+private:
+    struct event_t {
+        unsigned long step;
+        int key;            // 0: held keys changed
+        glm::vec2 orbit;
+        float zoom;
+    };
+    std::vector<event_t> events;
+    size_t cursor = 0;
+    glm::vec2 orbit = glm::vec2(0.0f); // held keys as of the last event seen
+    float zoom = 0.0f;
+};
+
+#endif
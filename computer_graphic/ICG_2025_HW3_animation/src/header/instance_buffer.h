@@ -0,0 +1,55 @@
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+// texture unit the per-instance buffer texture is bound to
+#define INSTANCE_BUFFER_TEXTURE_UNIT 3
+// RGBA32F texels per instance: model (4 columns), mvp (4), normal matrix (3)
+#define INSTANCE_TEXELS 11
+
+// Per-instance matrices, computed once per instance on the CPU so the vertex
+// shaders neither multiply matrices nor invert them per vertex.
+struct instance_transform_t {
+    glm::mat4 model;
+    glm::mat4 mvp;
+    glm::vec4 normalMatrix[3]; // columns of transpose(inverse(mat3(model))), w unused
+};
+
+// Batched mvp = viewProjection * model and normal matrix (SSE on x86, glm otherwise)
+void compute_instance_transforms(const glm::mat4& viewProjection, const glm::mat4* models,
+                                 instance_transform_t* out, size_t count);
+
+// Transforms of the instances drawn this frame, packed in instance order in
+// a buffer texture. Shaders read (instanceBase + gl_InstanceID) with
+// texelFetch, see shaders/instance.glsl; instanceBase is base() of a run's
+// first instance, a run of selected instances stays contiguous.
+// GL_MAX_TEXTURE_BUFFER_SIZE bounds the texels, GL 3.3 only promises 65536
+// (5957 instances): selected instances past max_instances() aren't uploaded,
+// and the first frame that has any says so.
+class instance_buffer_t {
+public:
+    instance_buffer_t();
+    ~instance_buffer_t();
+    // instance i of the scene is models[i], the ones with selected[i] set are
+    // uploaded. Those that don't fit are cleared in selected.
+    void upload(const glm::mat4& viewProjection, const std::vector<glm::mat4>& models, uint8_t* selected);
+    void bind();
+    // position of an uploaded instance in the buffer
+    int base(size_t instance) const { return bases[instance]; }
+    size_t size() const { return transforms.size(); }
+    size_t max_instances() const { return maxInstances; }
+
+private:
+    unsigned int buffer;
+    unsigned int texture;
+    size_t capacity = 0;
+    size_t maxInstances = 0;
+    bool warnedLimit = false;
+    std::vector<instance_transform_t> transforms;
+    std::vector<int> bases; // per scene instance, -1 when not uploaded
+};
+
+#endif
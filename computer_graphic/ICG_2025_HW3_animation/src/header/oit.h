@@ -0,0 +1,35 @@
+#ifndef OIT_H
+#define OIT_H
+
+#include <string>
+
+class shader_program_t;
+
+// Weighted blended order independent transparency (McGuire & Bavoil 2013).
+// Transparent draws go unsorted into two targets that share a copy of the
+// scene depth, then one full-screen pass composites them over the frame.
+//   accumulation RGBA16F: rgb += color * a * w, a *= (1 - a)  (revealage)
+//   weights      R16F:    r += a * w
+// GL 3.3 has no per-buffer blend functions, so revealage rides in the
+// accumulation alpha; both targets use glBlendFuncSeparate(ONE, ONE, ZERO,
+// ONE_MINUS_SRC_ALPHA). Fragment shaders write the targets when oitPass is set.
+class oit_target_t {
+public:
+    explicit oit_target_t(const std::string& shaderDir);
+    ~oit_target_t();
+    // copy the scene framebuffer's depth, bind and clear the targets
+    void begin(int width, int height, unsigned int sceneFBO = 0);
+    // back to the scene framebuffer and blend the result over it
+    void composite();
+
+private:
+    void resize(int width, int height);
+
+    shader_program_t* program;
+    unsigned int fbo = 0, sceneFBO = 0;
+    unsigned int accumTexture = 0, weightTexture = 0, depthBuffer = 0;
+    unsigned int emptyVAO = 0;
+    int width = 0, height = 0;
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef POST_PROCESS_H
+#define POST_PROCESS_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class shader_program_t;
+
+// Color attachment plus an optional DEPTH24_STENCIL8 renderbuffer
+struct render_target_t {
+    unsigned int fbo = 0;
+    unsigned int color = 0;
+    unsigned int depth = 0;
+    int width = 0, height = 0;
+    unsigned int format = 0;
+    bool inUse = false;
+    int idleFrames = 0;
+};
+
+// Targets that only live for part of a frame (the HDR scene, intermediates
+// between post passes). A released target is handed out again to the next
+// request with the same size and format, so a frame allocates nothing once
+// the pool is warm. Targets unused for POOL_MAX_IDLE_FRAMES are deleted, which
+// is what happens to the old sizes after a resize.
+class render_target_pool_t {
+public:
+    static const int POOL_MAX_IDLE_FRAMES = 60;
+
+    ~render_target_pool_t();
+    render_target_t* acquire(int width, int height, unsigned int format, bool depth = false);
+    void release(render_target_t* target);
+    void end_frame();
+    size_t size() const { return targets.size(); }
+
+private:
+    std::vector<render_target_t*> targets;
+};
+
+// Stages post_fused.frag applies in one pass, always in this order
+enum post_stage_t {
+    POST_TONEMAP  = 1 << 0,
+    POST_GRADE    = 1 << 1,
+    POST_VIGNETTE = 1 << 2,
+    POST_FADE     = 1 << 3
+};
+
+// One effect of the chain. Per-pixel effects are a stage of the fused shader;
+// an effect that reads neighbouring pixels needs its own program and pass,
+// and its input is whatever the chain produced before it.
+struct post_effect_t {
+    std::string name;
+    bool enabled = true;
+    int fusedStage = 0;                  // POST_* stage, 0 for its own pass
+    shader_program_t* program = nullptr; // own pass only, samples "source" on unit 0
+    std::function<void(shader_program_t*)> uniforms;
+};
+
+// Runs the enabled effects over the HDR scene and writes the result to the
+// default framebuffer. Consecutive fused effects collapse into one full-screen
+// pass; intermediates between passes come from the pool.
+class post_chain_t {
+public:
+    explicit post_chain_t(const std::string& shaderDir);
+    ~post_chain_t();
+    void add_effect(post_effect_t effect);
+    post_effect_t* find(const std::string& name);
+    // the last pass draws into outputFBO, the default framebuffer unless headless
+    void run(unsigned int sourceTexture, int width, int height, render_target_pool_t& pool,
+             unsigned int outputFBO = 0);
+    // full-screen passes of the last run()
+    int passes() const { return lastPasses; }
+
+private:
+    struct pass_t {
+        int fusedStages = 0;
+        std::vector<post_effect_t*> effects;
+        shader_program_t* program = nullptr;
+    };
+    void build_passes();
+
+    shader_program_t* fusedProgram;
+    unsigned int emptyVAO = 0;
+    std::vector<post_effect_t> effects;
+    std::vector<pass_t> passList;
+    int lastPasses = 0;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdint>
+#include <string>
+
+// Frame profiler. CPU zones are scoped markers that any thread can open; each
+// thread appends finished zones to its own lock-free ring, which the main
+// thread drains once per frame. GPU zones are GL_TIMESTAMP query pairs around
+// every gpu_timer_t pass, read back a few frames late and moved onto the CPU
+// clock. Both feed per-zone averages for the report and window title, and a
+// Chrome trace (chrome://tracing, Perfetto) while one is being recorded.
+//
+// Built with ICG_PROFILER (CMake option, on by default); without it the
+// macros compile to nothing and the functions below do nothing.
+
+#define PROFILER_THREAD_EVENTS 16384 // per-thread ring; zones beyond it before a drain are dropped
+#define PROFILER_TRACE_EVENTS 4000000 // recording stops here
+
+// names must outlive the profiler: literals, or profiler_intern()
+const char* profiler_intern(const std::string& name);
+uint64_t profiler_now_ns();
+void profiler_thread_name(const char* name);
+void profiler_record(const char* name, uint64_t startNs, uint64_t endNs);
+// GL thread only, no nesting (same rule as gpu_timer_t)
+void profiler_gpu_begin(const char* name);
+void profiler_gpu_end();
+
+// main thread, once per frame after the swap: collects finished zones
+void profiler_new_frame();
+bool profiler_start_trace(const std::string& path);
+// writes the trace file
+void profiler_stop_trace();
+// per-zone milliseconds per frame since the last reset
+void profiler_report();
+// slowest zones in a line short enough for a window title
+std::string profiler_summary();
+void profiler_reset();
+
+#ifdef ICG_PROFILER
+
+struct profile_zone_t {
+    explicit profile_zone_t(const char* zoneName) : name(zoneName), start(profiler_now_ns()) {}
+    ~profile_zone_t() { profiler_record(name, start, profiler_now_ns()); }
+    const char* name;
+    uint64_t start;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) profile_zone_t PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_THREAD(name) profiler_thread_name(name)
+#define PROFILE_GPU_BEGIN(name) profiler_gpu_begin(profiler_intern(name))
+#define PROFILE_GPU_END() profiler_gpu_end()
+
+#else
+
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#define PROFILE_GPU_BEGIN(name) ((void)0)
+#define PROFILE_GPU_END() ((void)0)
+
+#endif
+
+#endif
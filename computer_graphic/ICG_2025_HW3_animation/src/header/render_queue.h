@@ -0,0 +1,130 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "frame_arena.h"
+
+class shader_program_t;
+class gpu_timer_t;
+
+// Passes run in this order, the pass is the top of the sort key
+enum render_pass_t {
+    PASS_BACKGROUND,   // only used by --skybox-first
+    PASS_OPAQUE,
+    PASS_MEASURE,      // re-issued draws under rasterizer discard (--measure-vertex-stage)
+    PASS_SKY,          // after opaque: depth test at the far plane skips covered pixels
+    PASS_TRANSPARENT,
+    PASS_OVERLAY
+};
+
+// 64-bit sort key, most significant field first:
+//   front to back: pass (4) | program (12) | material (12) | texture (12) | depth (24)
+//   back to front: pass (4) | far-first depth (24) | program (12) | material (12) | texture (12)
+// depth is normalized to [0, 1], ids are truncated to 12 bits.
+uint64_t make_sort_key(int pass, unsigned int program, unsigned int material, unsigned int texture,
+                       float depth, bool backToFront = false);
+
+// How blending combines a fragment with the target when blend is on
+enum blend_mode_t {
+    BLEND_ALPHA,       // src alpha over
+    BLEND_OIT          // weighted blended OIT accumulation, see oit.h
+};
+
+// Fixed function state an item needs, applied through the cache before it draws
+struct render_state_t {
+    bool cullFace = true;
+    bool blend = false;
+    int blendMode = BLEND_ALPHA;
+    bool depthTest = true;
+    bool depthWrite = true;
+    bool rasterizerDiscard = false;
+};
+
+// Shadow copy of the GL state the renderer touches. Every request is counted;
+// only the ones that change something reach GL. With the cache disabled every
+// request is issued, which is what the old inline state code did.
+class gl_state_cache_t {
+public:
+    static const int MAX_TEXTURE_UNITS = 16;
+
+    gl_state_cache_t() { invalidate(); }
+    void set_enabled(bool enable) { enabled = enable; invalidate(); }
+    // forget everything, after GL was used directly (skinning, Hi-Z, ...)
+    void invalidate();
+
+    void use_program(shader_program_t* program);
+    void bind_vertex_array(unsigned int vao);
+    void bind_texture(int unit, unsigned int target, unsigned int texture);
+    void apply(const render_state_t& state);
+    void enable(unsigned int cap, bool on);
+    void depth_mask(bool write);
+    void blend_func(unsigned int src, unsigned int dst);
+    void blend_func_separate(unsigned int srcRGB, unsigned int dstRGB, unsigned int srcAlpha, unsigned int dstAlpha);
+
+    void draw_elements(unsigned int mode, int count, int instanceCount = 1);
+    void draw_arrays(unsigned int mode, int first, int count, int instanceCount = 1);
+
+    // counters since the last reset_counters()
+    unsigned long requested = 0;
+    unsigned long issued = 0;
+    unsigned long draws = 0;
+    void reset_counters() { requested = issued = draws = 0; }
+
+private:
+    static const unsigned int UNKNOWN = ~0u;
+    // counts the request, true when it has to reach GL
+    bool should_issue(bool same, int calls = 1);
+
+    bool enabled = true;
+    // UNKNOWN (or -1) until set through the cache, see invalidate()
+    unsigned int program = UNKNOWN;
+    unsigned int vao = UNKNOWN;
+    int activeUnit = -1;
+    unsigned int textures[MAX_TEXTURE_UNITS];
+    int cullFace = -1, blend = -1, depthTest = -1, rasterizerDiscard = -1;
+    int depthWrite = -1;
+    unsigned int blendSrcRGB = UNKNOWN, blendDstRGB = UNKNOWN;
+    unsigned int blendSrcAlpha = UNKNOWN, blendDstAlpha = UNKNOWN;
+};
+
+// One queued draw. bind() sets the uniforms shared by a program + material and
+// only runs when those change between consecutive items; draw() does the rest.
+struct render_item_t {
+    int pass = PASS_OPAQUE;
+    unsigned int material = 0;
+    unsigned int texture = 0;
+    float depth = 0.0f;          // [0, 1], 0 = near plane
+    bool backToFront = false;
+    render_state_t state;
+    shader_program_t* program = nullptr;
+    const char* timer = nullptr; // gpu timer pass, switched when it changes
+    // frame functions: item copies share the capture, which is only valid this frame
+    frame_function_t<void()> bind;
+    frame_function_t<void(gl_state_cache_t&)> draw;
+    uint64_t key = 0;            // filled in by submit()
+};
+
+// Draws submitted during a pass, radix sorted by key and executed in one go
+class render_queue_t {
+public:
+    void submit(render_item_t item);
+    void flush(gl_state_cache_t& cache, gpu_timer_t* timer);
+    size_t size() const { return items.size(); }
+    // called around the items of one pass, only when the pass has items.
+    // Either may change GL behind the cache's back; it is invalidated after.
+    void set_pass_hooks(int pass, std::function<void()> begin, std::function<void()> end);
+
+private:
+    static const int MAX_PASSES = 16;
+    void sort();
+    void run_hook(int pass, bool begin, gl_state_cache_t& cache);
+
+    std::vector<render_item_t> items;
+    std::vector<uint32_t> order, scratch;
+    std::function<void()> passBegin[MAX_PASSES], passEnd[MAX_PASSES];
+};
+
+#endif
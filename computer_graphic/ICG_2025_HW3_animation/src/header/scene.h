@@ -0,0 +1,99 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bounds.h"
+#include "frame_arena.h"
+
+class AnimatedModel;
+
+// A model file loaded once and drawn by any number of instances. All of its
+// instances share one animation clock, so it is posed and skinned once per
+// frame however many there are.
+struct scene_asset_t {
+    std::string name;
+    std::string path;
+    std::string texture;      // used when the model brings none
+    bool whiteTexture = false; // replace the model's texture with plain white
+    float timeScale = 1.0f;   // animation time = scene time * timeScale + timeOffset
+    float timeOffset = 0.0f;
+    AnimatedModel* model = nullptr;
+};
+
+// Instance flags: when an instance is drawn, and with what
+enum scene_flag_t : uint8_t {
+    SCENE_INTRO = 1,     // before the finale, until the balloon explosion has run its course
+    SCENE_EXPLOSION = 2, // before the finale, while the balloon explodes or has exploded
+    SCENE_FINALE = 4,    // in the finale
+    SCENE_METALLIC = 8,  // metallic balloon program with its aura layer, else the crowd program
+};
+
+// A run of consecutive instances of one asset drawn with one instanced draw
+struct scene_batch_t {
+    uint32_t first;
+    uint32_t count;
+    uint16_t asset;
+};
+
+// The characters as data: shared assets plus one column per instance
+// attribute, instances sorted by asset. The systems below each walk the
+// columns they need. Loaded from a text file, paths relative to it:
+//   icg-scene 1
+//   asset NAME FILE [texture FILE] [white] [speed S] [offset SECONDS]
+//   instance ASSET X Y Z [OPTIONS]
+//   grid ASSET COLUMNS ROWS SPACING X Y Z [OPTIONS]   centered on X Y Z in xz
+// with OPTIONS scale S, yaw RADIANS, orbit RADIUS RADIANS_PER_S PHASE (around
+// X Y Z) and the flags intro, explosion, finale, metallic. Names and files
+// with spaces go in double quotes, # starts a comment.
+class scene_t {
+public:
+    bool load(const std::string& path);
+    // loads the model files, GL context current
+    void load_assets();
+    void release_assets();
+
+    size_t size() const { return assetIndex.size(); }
+    AnimatedModel* model(size_t instance) const { return assets[assetIndex[instance]].model; }
+    float asset_time(size_t asset, float time) const {
+        return time * assets[asset].timeScale + assets[asset].timeOffset;
+    }
+
+    // Animation: the pose of every asset at time, safe off the render thread
+    void animate(float time, std::vector<std::vector<glm::mat4>>& palettes, std::vector<aabb_t>& bounds) const;
+    // Motion: transform column at time
+    void update_transforms(float time);
+    // wanted = instances with a flag in phases
+    void select(uint8_t phases);
+    // Culling: bounds of the wanted instances from their model's current
+    // pose, padded by metallicPadding or crowdPadding plus crowdRelative
+    // times the box extent, and the visible column. Returns how many were culled.
+    size_t cull(const glm::mat4& viewProjection, bool frustum, float metallicPadding, float crowdPadding,
+                float crowdRelative);
+    // Draw building: runs of consecutive instances with draw set and the same
+    // asset. With splitCrossfades instances part drawn as impostors get a
+    // batch of their own for their impostorBlend.
+    void build_batches(const uint8_t* draw, bool splitCrossfades, frame_vector_t<scene_batch_t>& batches) const;
+
+    std::vector<scene_asset_t> assets;
+
+    // instance columns, from the file
+    std::vector<uint16_t> assetIndex;
+    std::vector<uint8_t> flags;
+    std::vector<glm::vec3> position;  // orbit center for orbiting instances
+    std::vector<float> yaw;
+    std::vector<float> scale;
+    std::vector<glm::vec3> orbit;     // radius, angular speed, phase; radius 0 stays put
+    // instance columns, per frame on the render thread
+    std::vector<glm::mat4> transform;
+    std::vector<aabb_t> bounds;       // world space, padded for effects
+    std::vector<uint8_t> wanted;      // drawn in this phase of the show
+    std::vector<uint8_t> visible;     // wanted and inside the frustum
+    std::vector<uint8_t> occluded;    // failed the last Hi-Z test
+    std::vector<float> impostorBlend; // share drawn by the impostor, 0 = mesh only
+};
+
+#endif
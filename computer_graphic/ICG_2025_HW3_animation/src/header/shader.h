@@ -6,17 +6,42 @@ public:
     ~shader_program_t();
     void add_shader(const std::string& filepath, unsigned int type);
     void link_shader();
+    // outputs captured by transform feedback, must be set before link_shader()
+    void set_feedback_varyings(const std::vector<const char*>& varyings);
     void create();
     void use();
     void release();
     void set_uniform_value(const char* name, const glm::mat4& mat);
     void set_uniform_value(const char* name, const glm::mat3& mat);
     void set_uniform_value(const char* name, const glm::vec3& vec);
+    void set_uniform_value(const char* name, const glm::vec2& vec);
     void set_uniform_value(const char* name, const float value);
     void set_uniform_value(const char* name, const int value);
     unsigned int get_program_id() const { return program_handle; }
-    
+
+    // async compile: when enabled, add_shader/link_shader only submit work to the
+    // driver and status is resolved later by is_ready() (non-blocking) or wait()
+    static void set_async_compile(bool enable);
+    static bool has_parallel_compile();
+    // number of blocking status resolves allowed this frame when the driver has
+    // no GL_KHR_parallel_shader_compile (called once per presented frame)
+    static void new_frame(int blocking_resolve_budget);
+    static int pending_count() { return pending_programs; }
+    bool is_ready();
+    bool is_failed() const { return link_failed; }
+    void wait();
+
 private:
+    void finish_link();
+
     unsigned int program_handle;
     std::vector<unsigned int> shader_handles;
-};
\ No newline at end of file
+    std::vector<const char*> feedback_varyings;
+    bool link_pending = false;
+    bool link_failed = false;
+
+    static bool async_compile;
+    static int parallel_compile; // -1 = not queried yet
+    static int resolve_budget;
+    static int pending_programs;
+};
@@ -0,0 +1,79 @@
+#ifndef SHADOW_MAP_H
+#define SHADOW_MAP_H
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "frame_arena.h"
+
+class shader_program_t;
+
+// texture unit the shadow map (sampler2DShadow) is bound to for the frame
+#define SHADOW_MAP_TEXTURE_UNIT 7
+#define SHADOW_MAP_SIZE 2048
+// frames a caster has to stay unchanged before it moves into the cached layer
+#define SHADOW_CACHE_AFTER_FRAMES 2
+
+// Something drawn into the shadow map. version changes whenever what it
+// draws changes (pose, transform); draw() issues the draw with the depth
+// program already current and lightViewProjection set.
+struct shadow_caster_t {
+    int id = 0;                 // stable across frames, small
+    uint64_t version = 0;
+    bool preskinned = false;    // vertices from the post-skin buffer, else skinned in shadow_skinned.vert
+    frame_function_t<void(shader_program_t* program)> draw;
+};
+
+// FNV-1a over raw bytes, for building caster versions
+uint64_t shadow_version(const void* data, size_t bytes, uint64_t seed = 14695981039346656037ull);
+
+// Single directional shadow map with a cached layer. Casters that stayed the
+// same for a few frames are drawn once into a static depth map; every frame
+// that map is copied into the shadow map and only the changing casters are
+// drawn on top. The static map is redrawn when a caster joins or leaves the
+// cached set, the light moves or the depth programs finish linking.
+class shadow_map_t {
+public:
+    explicit shadow_map_t(const std::string& shaderDir);
+    ~shadow_map_t();
+    // orthographic light covering the sphere (center, radius), looking along direction
+    void set_light(const glm::vec3& direction, const glm::vec3& center, float radius);
+    // redraws what changed, then binds sceneFBO again
+    void render(const shadow_caster_t* casters, size_t count, unsigned int sceneFBO = 0);
+    void bind();
+    // receiver uniforms: shadowMap, lightViewProjection, shadowsEnabled
+    void set_uniforms(shader_program_t* program) const;
+    const glm::mat4& light_view_projection() const { return lightViewProjection; }
+
+    bool enableCache = true;
+    // counters since the last reset_counters()
+    unsigned long drawnCasters = 0;
+    unsigned long cachedCasters = 0;
+    unsigned long staticRebuilds = 0;
+    void reset_counters() { drawnCasters = cachedCasters = staticRebuilds = 0; }
+
+private:
+    struct caster_state_t {
+        uint64_t version = 0;
+        int stableFrames = 0;
+        bool cached = false;
+        bool seen = false;
+    };
+    void draw_casters(const std::vector<const shadow_caster_t*>& list);
+
+    shader_program_t* preskinnedProgram;
+    shader_program_t* skinnedProgram;
+    unsigned int shadowTexture = 0, shadowFBO = 0;
+    unsigned int staticTexture = 0, staticFBO = 0;
+    glm::mat4 lightViewProjection = glm::mat4(1.0f);
+    // the static map needs redrawing: the light moved, or the last rebuild
+    // ran while a depth program was still compiling and skipped casters
+    bool staticDirty = true;
+    bool staticEmpty = true;
+    std::vector<caster_state_t> states;
+    std::vector<const shadow_caster_t*> cachedList, dynamicList;
+};
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef SIM_THREAD_H
+#define SIM_THREAD_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Triple buffer between one writer and one reader. The writer fills its slot
+// and publishes it; the reader takes the newest published slot and keeps it
+// until its next acquire(), so neither side ever waits for the other or sees
+// a half-written T. A slot published twice before the reader looked is dropped.
+template <typename T>
+class snapshot_buffer_t {
+public:
+    // writer side: the slot to fill, valid until publish()
+    T& write_slot() { return slots[writeIndex]; }
+    void publish() {
+        int previous = middle.exchange(writeIndex | FRESH, std::memory_order_acq_rel);
+        if (previous & FRESH) dropped.fetch_add(1, std::memory_order_relaxed);
+        writeIndex = previous & INDEX;
+    }
+
+    // reader side: newest published slot, the same one again when nothing new came
+    const T& acquire(bool* fresh = nullptr) {
+        bool isFresh = middle.load(std::memory_order_acquire) & FRESH;
+        if (isFresh) {
+            readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & INDEX;
+        }
+        if (fresh) *fresh = isFresh;
+        return slots[readIndex];
+    }
+
+    // published slots the reader never saw, since the last call
+    unsigned long take_dropped() { return dropped.exchange(0, std::memory_order_relaxed); }
+
+private:
+    static const int INDEX = 3;
+    static const int FRESH = 4;
+    T slots[3];
+    int writeIndex = 0;
+    int readIndex = 1;
+    std::atomic<int> middle{2};
+    std::atomic<unsigned long> dropped{0};
+};
+
+// Fixed-step clock for the simulation. advance() turns elapsed wall time into
+// whole steps through an accumulator, at most maxCatchUp per call; time beyond
+// that (a long stall, a breakpoint) is dropped rather than simulated in a
+// burst. Deterministic mode ignores the wall clock and steps once per call.
+// Plain data, so a copy can travel with a snapshot for alpha().
+class sim_clock_t {
+public:
+    explicit sim_clock_t(double stepSeconds = 1.0 / 60.0, int maxCatchUp = 5);
+    void reset(double now);
+    // steps due at wall time now
+    int advance(double now);
+    // how far past the last step wall time now is, in steps: the blend between
+    // the last two states to draw. 1 in deterministic mode.
+    float alpha(double now) const;
+    double step_seconds() const { return stepSeconds; }
+
+    bool deterministic = false;
+    unsigned long steps = 0;     // since reset()
+    double skippedSeconds = 0.0; // wall time dropped by the catch-up cap
+
+private:
+    double stepSeconds;
+    int maxCatchUp;
+    double accumulator = 0.0;
+    double lastWall = 0.0;
+};
+
+// Runs the simulation on its own thread, one step() per request_step(). The
+// render thread requests the next step as soon as it picked up a snapshot, so
+// simulating frame N+1 overlaps drawing frame N.
+class sim_thread_t {
+public:
+    struct stats_t {
+        unsigned long steps = 0;
+        double stepSeconds = 0.0; // time inside step()
+        double idleSeconds = 0.0; // waiting for the next request
+        unsigned long heapAllocations = 0; // operator new calls inside step()
+    };
+
+    explicit sim_thread_t(std::function<void()> step);
+    ~sim_thread_t();
+    void start();
+    void stop();
+    bool running() const { return thread.joinable(); }
+    void request_step();
+    // counters since the last call
+    stats_t take_stats();
+
+private:
+    void loop();
+
+    std::function<void()> step;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    unsigned int requested = 0;
+    bool stopping = false;
+    stats_t stats;
+};
+
+#endif
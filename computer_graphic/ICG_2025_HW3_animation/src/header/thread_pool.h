@@ -0,0 +1,43 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "frame_arena.h"
+
+// Fixed set of worker threads for data-parallel loops. The calling thread takes
+// part in every parallel_for and returns once all chunks are done.
+class thread_pool_t {
+public:
+    // 0 = one worker less than the hardware threads (the caller is the last one)
+    explicit thread_pool_t(unsigned int workerCount = 0);
+    ~thread_pool_t();
+
+    // fn(begin, end) is called on chunks of at most `grain` items. fn's capture
+    // goes to the caller's frame arena, the workers only call it.
+    void parallel_for(size_t count, size_t grain, const frame_function_t<void(size_t, size_t)>& fn);
+    unsigned int size() const { return workers.size() + 1; }
+
+private:
+    void worker_loop();
+    void run_chunks();
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    const frame_function_t<void(size_t, size_t)>* job = nullptr;
+    size_t jobCount = 0;
+    size_t jobGrain = 1;
+    std::atomic<size_t> nextItem{0};
+    unsigned int busyWorkers = 0;
+    unsigned long generation = 0;
+    bool stopping = false;
+};
+
+#endif
@@ -0,0 +1,172 @@
+#include <glad/glad.h>
+#include <cstring>
+#include <iostream>
+
+#include "header/headless_context.h"
+#include "header/gpu_memory.h"
+
+#ifdef ICG_HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static bool has_extension(const char* list, const char* name) {
+    if (!list) return false;
+    size_t length = std::strlen(name);
+    for (const char* p = std::strstr(list, name); p; p = std::strstr(p + length, name)) {
+        if ((p == list || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0')) return true;
+    }
+    return false;
+}
+
+// First display that initializes: a GPU device (no window system at all), Mesa's
+// surfaceless platform, then whatever the default display is
+static EGLDisplay open_display(const char*& platformName) {
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    EGLint major, minor;
+
+    if (getPlatformDisplay && has_extension(clientExtensions, "EGL_EXT_platform_device")) {
+        auto queryDevices = (PFNEGLQUERYDEVICESEXTPROC)eglGetProcAddress("eglQueryDevicesEXT");
+        EGLDeviceEXT devices[8];
+        EGLint count = 0;
+        if (queryDevices && queryDevices(8, devices, &count)) {
+            for (EGLint i = 0; i < count; i++) {
+                EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_DEVICE_EXT, devices[i], NULL);
+                if (display != EGL_NO_DISPLAY && eglInitialize(display, &major, &minor)) {
+                    platformName = "device";
+                    return display;
+                }
+            }
+        }
+    }
+    if (getPlatformDisplay && has_extension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (display != EGL_NO_DISPLAY && eglInitialize(display, &major, &minor)) {
+            platformName = "surfaceless";
+            return display;
+        }
+    }
+    EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (display != EGL_NO_DISPLAY && eglInitialize(display, &major, &minor)) {
+        platformName = "default";
+        return display;
+    }
+    return EGL_NO_DISPLAY;
+}
+
+bool headless_context_t::create() {
+    EGLDisplay eglDisplay = open_display(platformName);
+    if (eglDisplay == EGL_NO_DISPLAY) {
+        std::cerr << "headless: no EGL display" << std::endl;
+        return false;
+    }
+    display = eglDisplay;
+    if (!has_extension(eglQueryString(eglDisplay, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")) {
+        std::cerr << "headless: EGL_KHR_surfaceless_context missing" << std::endl;
+        return false;
+    }
+
+    // no surface will ever be created, so any surface type will do
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_DONT_CARE,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(eglDisplay, configAttribs, &config, 1, &configCount) || configCount == 0) {
+        std::cerr << "headless: no EGL config for desktop GL" << std::endl;
+        return false;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        std::cerr << "headless: EGL has no desktop GL" << std::endl;
+        return false;
+    }
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+        EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+        EGL_NONE
+    };
+    EGLContext eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttribs);
+    if (eglContext == EGL_NO_CONTEXT) {
+        std::cerr << "headless: could not create a GL 3.3 core context" << std::endl;
+        return false;
+    }
+    context = eglContext;
+    if (!eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext)) {
+        std::cerr << "headless: eglMakeCurrent failed" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void headless_context_t::destroy() {
+    if (context) destroy_target();
+    if (display) {
+        eglMakeCurrent((EGLDisplay)display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (context) eglDestroyContext((EGLDisplay)display, (EGLContext)context);
+        eglTerminate((EGLDisplay)display);
+    }
+    display = context = nullptr;
+}
+
+void* headless_context_t::proc_address(const char* name) {
+    return (void*)eglGetProcAddress(name);
+}
+
+#else
+
+bool headless_context_t::create() {
+    std::cerr << "headless: built without EGL (ICG_HEADLESS_EGL)" << std::endl;
+    return false;
+}
+
+void headless_context_t::destroy() {}
+
+void* headless_context_t::proc_address(const char*) {
+    return nullptr;
+}
+
+#endif
+
+headless_context_t::~headless_context_t() {
+    destroy();
+}
+
+// Stands in for the default framebuffer: 8-bit color like a window's, so the
+// post chain output and captures match a windowed run
+bool headless_context_t::create_target(int width, int height) {
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    gpuMemory.track(GL_OBJECT_RENDERBUFFER, colorBuffer, GPU_MEMORY_TARGETS, "headless output");
+    gpuMemory.resize(GL_OBJECT_RENDERBUFFER, colorBuffer, gpu_memory_t::texture_bytes(GL_RGBA8, width, height), GL_RGBA8);
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    gpuMemory.track(GL_OBJECT_RENDERBUFFER, depthBuffer, GPU_MEMORY_TARGETS, "headless output");
+    gpuMemory.resize(GL_OBJECT_RENDERBUFFER, depthBuffer,
+                     gpu_memory_t::texture_bytes(GL_DEPTH24_STENCIL8, width, height), GL_DEPTH24_STENCIL8);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (!complete) {
+        std::cerr << "headless: output framebuffer incomplete" << std::endl;
+    }
+    return complete;
+}
+
+void headless_context_t::destroy_target() {
+    if (!fbo) return;
+    gpuMemory.untrack(GL_OBJECT_RENDERBUFFER, colorBuffer);
+    gpuMemory.untrack(GL_OBJECT_RENDERBUFFER, depthBuffer);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &colorBuffer);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    fbo = colorBuffer = depthBuffer = 0;
+}
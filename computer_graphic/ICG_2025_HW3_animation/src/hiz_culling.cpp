@@ -0,0 +1,249 @@
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "header/shader.h"
+#include "header/hiz_culling.h"
+#include "header/gpu_memory.h"
+
+hiz_pyramid_t::hiz_pyramid_t(const std::string& shaderDir) {
+    program = new shader_program_t();
+    program->create();
+    program->add_shader(shaderDir + "fullscreen.vert", GL_VERTEX_SHADER);
+    program->add_shader(shaderDir + "hiz_downsample.frag", GL_FRAGMENT_SHADER);
+    program->link_shader();
+
+    glGenVertexArrays(1, &emptyVAO);
+    glGenFramebuffers(1, &depthFBO);
+    glGenFramebuffers(1, &pyramidFBO);
+}
+
+hiz_pyramid_t::~hiz_pyramid_t() {
+    delete program;
+    glDeleteVertexArrays(1, &emptyVAO);
+    glDeleteFramebuffers(1, &depthFBO);
+    glDeleteFramebuffers(1, &pyramidFBO);
+    release_slots();
+    gpuMemory.untrack(GL_OBJECT_TEXTURE, depthTexture);
+    gpuMemory.untrack(GL_OBJECT_TEXTURE, pyramidTexture);
+    glDeleteTextures(1, &depthTexture);
+    glDeleteTextures(1, &pyramidTexture);
+}
+
+void hiz_pyramid_t::release_slots() {
+    for (slot_t& slot : slots) {
+        if (slot.fence) glDeleteSync((GLsync)slot.fence);
+        slot.fence = nullptr;
+        if (!slot.pbo) continue;
+        gpuMemory.untrack(GL_OBJECT_BUFFER, slot.pbo);
+        glDeleteBuffers(1, &slot.pbo);
+        slot.pbo = 0;
+    }
+}
+
+void hiz_pyramid_t::resize(int w, int h) {
+    width = w;
+    height = h;
+    readback.clear();
+    release_slots();
+
+    // Depth copy target, same format as the scene framebuffer so the depth
+    // blit is allowed (GLFW's default is 24 bit depth, 8 bit stencil, the
+    // offscreen HDR target matches it)
+    gpuMemory.untrack(GL_OBJECT_TEXTURE, depthTexture);
+    glDeleteTextures(1, &depthTexture);
+    glGenTextures(1, &depthTexture);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+    gpuMemory.track(GL_OBJECT_TEXTURE, depthTexture, GPU_MEMORY_TARGETS, "hi-z depth copy");
+    gpuMemory.resize(GL_OBJECT_TEXTURE, depthTexture,
+                     gpu_memory_t::texture_bytes(GL_DEPTH24_STENCIL8, width, height), GL_DEPTH24_STENCIL8);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+
+    // Pyramid level 0 is half the screen, each level halves (rounding up) until
+    // one fits in the readback width
+    levelWidth.clear();
+    levelHeight.clear();
+    int lw = width, lh = height;
+    do {
+        lw = std::max(1, (lw + 1) / 2);
+        lh = std::max(1, (lh + 1) / 2);
+        levelWidth.push_back(lw);
+        levelHeight.push_back(lh);
+    } while (lw > HIZ_READBACK_WIDTH);
+    readbackLevel = levelWidth.size() - 1;
+
+    gpuMemory.untrack(GL_OBJECT_TEXTURE, pyramidTexture);
+    glDeleteTextures(1, &pyramidTexture);
+    glGenTextures(1, &pyramidTexture);
+    glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+    size_t pyramidBytes = 0;
+    for (int level = 0; level <= readbackLevel; level++) {
+        glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, levelWidth[level], levelHeight[level], 0, GL_RED, GL_FLOAT, NULL);
+        pyramidBytes += gpu_memory_t::texture_bytes(GL_R32F, levelWidth[level], levelHeight[level]);
+    }
+    gpuMemory.track(GL_OBJECT_TEXTURE, pyramidTexture, GPU_MEMORY_TARGETS, "hi-z pyramid");
+    gpuMemory.resize(GL_OBJECT_TEXTURE, pyramidTexture, pyramidBytes, GL_R32F);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, readbackLevel);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    size_t readbackBytes = levelWidth[readbackLevel] * levelHeight[readbackLevel] * sizeof(float);
+    for (slot_t& slot : slots) {
+        glGenBuffers(1, &slot.pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, readbackBytes, NULL, GL_STREAM_READ);
+        gpuMemory.track(GL_OBJECT_BUFFER, slot.pbo, GPU_MEMORY_STREAMING, "hi-z readback");
+        gpuMemory.resize(GL_OBJECT_BUFFER, slot.pbo, readbackBytes);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+// Copies a slot's readback out, with the bounds it was built with
+bool hiz_pyramid_t::collect(slot_t& slot, bool wait) {
+    if (!slot.fence) return false;
+    GLsync fence = (GLsync)slot.fence;
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        if (!wait) return false;
+        waits++;
+        do {
+            status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+        } while (status == GL_TIMEOUT_EXPIRED);
+    }
+    glDeleteSync(fence);
+    slot.fence = nullptr;
+
+    size_t texels = levelWidth[readbackLevel] * levelHeight[readbackLevel];
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    const void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, texels * sizeof(float), GL_MAP_READ_BIT);
+    if (data) {
+        readback.resize(texels);
+        std::memcpy(readback.data(), data, texels * sizeof(float));
+        readbackViewProjection = slot.viewProjection;
+        readbackBounds.swap(slot.bounds);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return data != nullptr;
+}
+
+void hiz_pyramid_t::wait() {
+    collect(slots[(nextSlot + HIZ_READBACK_SLOTS - 1) % HIZ_READBACK_SLOTS], true);
+}
+
+void hiz_pyramid_t::build(int w, int h, const glm::mat4& viewProjection, const std::vector<aabb_t>& bounds,
+                          unsigned int sceneFBO) {
+    if (w <= 0 || h <= 0) return;
+    if (w != width || h != height) resize(w, h);
+    if (!program->is_ready()) return;
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFBO);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    glDisable(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, pyramidFBO);
+    program->use();
+    program->set_uniform_value("source", 0);
+    GLint sourceSizeLocation = glGetUniformLocation(program->get_program_id(), "sourceSize");
+    glActiveTexture(GL_TEXTURE0);
+    glBindVertexArray(emptyVAO);
+
+    for (int level = 0; level <= readbackLevel; level++) {
+        if (level == 0) {
+            glBindTexture(GL_TEXTURE_2D, depthTexture);
+            glUniform2i(sourceSizeLocation, width, height);
+        } else {
+            // only the previous level is visible to the sampler while this one is written
+            glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+            glUniform2i(sourceSizeLocation, levelWidth[level - 1], levelHeight[level - 1]);
+        }
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramidTexture, level);
+        glViewport(0, 0, levelWidth[level], levelHeight[level]);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+    glBindVertexArray(0);
+    program->release();
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+    glViewport(0, 0, width, height);
+    if (depthTest) glEnable(GL_DEPTH_TEST);
+
+    glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, readbackLevel);
+
+    // last frame's readback first, then this one into the other PBO. One
+    // that still hasn't come back by the time its PBO is reused is dropped.
+    collect(slots[(nextSlot + HIZ_READBACK_SLOTS - 1) % HIZ_READBACK_SLOTS], false);
+    slot_t& slot = slots[nextSlot];
+    nextSlot = (nextSlot + 1) % HIZ_READBACK_SLOTS;
+    if (slot.fence) {
+        glDeleteSync((GLsync)slot.fence);
+        dropped++;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glGetTexImage(GL_TEXTURE_2D, readbackLevel, GL_RED, GL_FLOAT, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.viewProjection = viewProjection;
+    slot.bounds.assign(bounds.begin(), bounds.end());
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+bool hiz_pyramid_t::occluded(size_t instance) const {
+    if (readback.empty() || instance >= readbackBounds.size()) return false;
+    const aabb_t& box = readbackBounds[instance];
+    if (box.empty()) return false;
+    const glm::mat4& viewProjection = readbackViewProjection;
+
+    // screen rectangle and nearest depth of the projected box
+    glm::vec3 ndcMin(1e30f), ndcMax(-1e30f);
+    for (int corner = 0; corner < 8; corner++) {
+        glm::vec3 p((corner & 1) ? box.max.x : box.min.x,
+                    (corner & 2) ? box.max.y : box.min.y,
+                    (corner & 4) ? box.max.z : box.min.z);
+        glm::vec4 clip = viewProjection * glm::vec4(p, 1.0f);
+        // touches the near plane, can't be behind anything
+        if (clip.w <= 1e-4f) return false;
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        ndcMin = glm::min(ndcMin, ndc);
+        ndcMax = glm::max(ndcMax, ndc);
+    }
+    if (ndcMin.z <= -1.0f) return false;
+
+    // pixel rectangle, then the readback texels covering it (each texel covers
+    // 2^(readbackLevel + 1) pixels per side)
+    int shift = readbackLevel + 1;
+    int lw = levelWidth[readbackLevel];
+    int lh = levelHeight[readbackLevel];
+    int x0 = std::clamp((int)std::floor((ndcMin.x * 0.5f + 0.5f) * width), 0, width - 1) >> shift;
+    int x1 = std::clamp((int)std::floor((ndcMax.x * 0.5f + 0.5f) * width), 0, width - 1) >> shift;
+    int y0 = std::clamp((int)std::floor((ndcMin.y * 0.5f + 0.5f) * height), 0, height - 1) >> shift;
+    int y1 = std::clamp((int)std::floor((ndcMax.y * 0.5f + 0.5f) * height), 0, height - 1) >> shift;
+    x1 = std::min(x1, lw - 1);
+    y1 = std::min(y1, lh - 1);
+
+    float farthest = 0.0f;
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            farthest = std::max(farthest, readback[y * lw + x]);
+        }
+    }
+    float nearest = ndcMin.z * 0.5f + 0.5f;
+    return nearest > farthest;
+}
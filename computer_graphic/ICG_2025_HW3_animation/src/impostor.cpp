@@ -0,0 +1,184 @@
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+
+#include "header/shader.h"
+#include "header/animated_model.h"
+#include "header/impostor.h"
+#include "header/gpu_memory.h"
+
+static float sign_not_zero(float v) {
+    return v >= 0.0f ? 1.0f : -1.0f;
+}
+
+glm::vec2 impostor_encode(const glm::vec3& direction) {
+    glm::vec3 p = direction / (std::fabs(direction.x) + std::fabs(direction.y) + std::fabs(direction.z));
+    glm::vec2 e(p.x, p.z);
+    if (p.y < 0.0f) {
+        e = glm::vec2((1.0f - std::fabs(p.z)) * sign_not_zero(p.x), (1.0f - std::fabs(p.x)) * sign_not_zero(p.z));
+    }
+    return e * 0.5f + glm::vec2(0.5f);
+}
+
+glm::vec3 impostor_decode(const glm::vec2& uv) {
+    glm::vec2 e = uv * 2.0f - glm::vec2(1.0f);
+    glm::vec3 d(e.x, 1.0f - std::fabs(e.x) - std::fabs(e.y), e.y);
+    if (d.y < 0.0f) {
+        float x = (1.0f - std::fabs(d.z)) * sign_not_zero(d.x);
+        float z = (1.0f - std::fabs(d.x)) * sign_not_zero(d.z);
+        d.x = x;
+        d.z = z;
+    }
+    return glm::normalize(d);
+}
+
+// Same rule as impostor.vert, so baked views and quads share their orientation
+static glm::vec3 impostor_up(const glm::vec3& direction) {
+    return std::fabs(direction.y) > 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+}
+
+impostor_renderer_t::impostor_renderer_t(const std::string& shaderDir) {
+    bakeProgram = new shader_program_t();
+    bakeProgram->create();
+    bakeProgram->add_shader(shaderDir + "impostor_bake.vert", GL_VERTEX_SHADER);
+    bakeProgram->add_shader(shaderDir + "impostor_bake.frag", GL_FRAGMENT_SHADER);
+    bakeProgram->link_shader();
+    // baking happens during setup, right after this
+    bakeProgram->wait();
+
+    drawProgram = new shader_program_t();
+    drawProgram->create();
+    drawProgram->add_shader(shaderDir + "impostor.vert", GL_VERTEX_SHADER);
+    drawProgram->add_shader(shaderDir + "impostor.frag", GL_FRAGMENT_SHADER);
+    drawProgram->link_shader();
+
+    glGenVertexArrays(1, &emptyVAO);
+}
+
+impostor_renderer_t::~impostor_renderer_t() {
+    delete bakeProgram;
+    delete drawProgram;
+    glDeleteVertexArrays(1, &emptyVAO);
+    for (auto& entry : atlases) {
+        gpuMemory.untrack(GL_OBJECT_TEXTURE, entry.second.texture);
+        glDeleteTextures(1, &entry.second.texture);
+    }
+}
+
+const impostor_atlas_t* impostor_renderer_t::bake(AnimatedModel* model,
+                                                  const std::function<void(shader_program_t*)>& uniforms) {
+    if (!bakeProgram->is_ready()) return nullptr;
+
+    impostor_atlas_t atlas;
+    atlas.duration = model->getAnimationDuration();
+    atlas.frames = atlas.duration > 0.0f ? IMPOSTOR_FRAMES : 1;
+
+    // one sphere for all frames, so the quad doesn't change size over the loop
+    aabb_t box;
+    for (int f = 0; f < atlas.frames; f++) {
+        model->updateAnimation(f * atlas.duration / atlas.frames);
+        box.expand(model->m_Bounds);
+    }
+    if (box.empty()) return nullptr;
+    atlas.center = box.center();
+    atlas.radius = glm::length(box.extent());
+
+    int size = IMPOSTOR_VIEWS * IMPOSTOR_CELL;
+    glGenTextures(1, &atlas.texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, atlas.texture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, size, size, atlas.frames, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    gpuMemory.track(GL_OBJECT_TEXTURE, atlas.texture, GPU_MEMORY_TARGETS, "impostor atlas");
+    gpuMemory.resize(GL_OBJECT_TEXTURE, atlas.texture, gpu_memory_t::texture_bytes(GL_RGBA8, size, size, atlas.frames), GL_RGBA8);
+    // no mipmaps, they would bleed neighbouring views into each other
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    unsigned int fbo, depth;
+    glGenRenderbuffers(1, &depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glGenFramebuffers(1, &fbo);
+
+    GLint previousFBO, viewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFBO);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+    glDisable(GL_CULL_FACE);
+
+    bakeProgram->use();
+    uniforms(bakeProgram);
+    bakeProgram->set_uniform_value("ourTexture", 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, model->texture);
+    gpuMemory.touch(model->texture);
+    glBindVertexArray(model->VAO);
+    GLint bonesLocation = glGetUniformLocation(bakeProgram->get_program_id(), "finalBonesMatrices");
+
+    glm::mat4 projection = glm::ortho(-atlas.radius, atlas.radius, -atlas.radius, atlas.radius,
+                                      0.0f, 4.0f * atlas.radius);
+    for (int f = 0; f < atlas.frames; f++) {
+        model->updateAnimation(f * atlas.duration / atlas.frames);
+        if (bonesLocation != -1 && !model->m_FinalBoneMatrices.empty()) {
+            glUniformMatrix4fv(bonesLocation, model->m_FinalBoneMatrices.size(), GL_FALSE,
+                               &model->m_FinalBoneMatrices[0][0][0]);
+        }
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, atlas.texture, 0, f);
+        glViewport(0, 0, size, size);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        for (int j = 0; j < IMPOSTOR_VIEWS; j++) {
+            for (int i = 0; i < IMPOSTOR_VIEWS; i++) {
+                glm::vec3 direction = impostor_decode(glm::vec2((i + 0.5f) / IMPOSTOR_VIEWS, (j + 0.5f) / IMPOSTOR_VIEWS));
+                glm::vec3 eye = atlas.center + direction * (2.0f * atlas.radius);
+                glm::mat4 view = glm::lookAt(eye, atlas.center, impostor_up(direction));
+                bakeProgram->set_uniform_value("viewProjection", projection * view);
+                bakeProgram->set_uniform_value("viewPos", eye);
+                glViewport(i * IMPOSTOR_CELL, j * IMPOSTOR_CELL, IMPOSTOR_CELL, IMPOSTOR_CELL);
+                glDrawElements(GL_TRIANGLES, model->indices.size(), GL_UNSIGNED_INT, 0);
+            }
+        }
+    }
+
+    glBindVertexArray(0);
+    bakeProgram->release();
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFBO);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glEnable(GL_CULL_FACE);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &depth);
+
+    atlases[model] = atlas;
+    return &atlases[model];
+}
+
+const impostor_atlas_t* impostor_renderer_t::find(const AnimatedModel* model) const {
+    auto it = atlases.find(model);
+    return it == atlases.end() ? nullptr : &it->second;
+}
+
+void impostor_renderer_t::set_instance_uniforms(const impostor_atlas_t& atlas, const glm::mat4& model,
+                                                float time, float blend) {
+    float frame = 0.0f;
+    if (atlas.duration > 0.0f) {
+        frame = std::fmod(time, atlas.duration) / atlas.duration * atlas.frames;
+    }
+    int frame0 = (int)frame % atlas.frames;
+    drawProgram->set_uniform_value("model", model);
+    drawProgram->set_uniform_value("boundsCenter", atlas.center);
+    drawProgram->set_uniform_value("boundsRadius", atlas.radius);
+    drawProgram->set_uniform_value("frame0", frame0);
+    drawProgram->set_uniform_value("frame1", (frame0 + 1) % atlas.frames);
+    drawProgram->set_uniform_value("frameBlend", frame - std::floor(frame));
+    drawProgram->set_uniform_value("impostorBlend", blend);
+}
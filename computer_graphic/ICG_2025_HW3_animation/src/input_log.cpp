@@ -0,0 +1,85 @@
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "header/input_log.h"
+
+bool input_log_t::load(const std::string& path) {
+    FILE* file = std::fopen(path.c_str(), "r");
+    if (!file) {
+        std::cerr << "input log: cannot read " << path << std::endl;
+        return false;
+    }
+    events.clear();
+    cursor = 0;
+    orbit = glm::vec2(0.0f);
+    zoom = 0.0f;
+
+    int version = 0;
+    bool ok = std::fscanf(file, " icg-input %d %d", &version, &stepRate) == 2 && version == 1 && stepRate > 0;
+    char type[4];
+    while (ok && std::fscanf(file, " %3s", type) == 1) {
+        event_t event = { 0, 0, glm::vec2(0.0f), 0.0f };
+        if (std::strcmp(type, "a") == 0) {
+            ok = std::fscanf(file, "%lu %f %f %f", &event.step, &event.orbit.x, &event.orbit.y, &event.zoom) == 4;
+        } else if (std::strcmp(type, "k") == 0) {
+            ok = std::fscanf(file, "%lu %d", &event.step, &event.key) == 2 && event.key != 0;
+        } else {
+            ok = false;
+        }
+        ok = ok && (events.empty() || event.step >= events.back().step);
+        if (ok) events.push_back(event);
+    }
+    std::fclose(file);
+    if (!ok) {
+        std::cerr << "input log: " << path << " is not a valid log (event " << events.size() << ")" << std::endl;
+        events.clear();
+    }
+    return ok;
+}
+
+bool input_log_t::save(const std::string& path) const {
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        std::cerr << "input log: cannot write " << path << std::endl;
+        return false;
+    }
+    std::fprintf(file, "icg-input 1 %d\n", stepRate);
+    for (const event_t& event : events) {
+        if (event.key == 0) {
+            // %.9g round-trips a float exactly
+            std::fprintf(file, "a %lu %.9g %.9g %.9g\n", event.step, event.orbit.x, event.orbit.y, event.zoom);
+        } else {
+            std::fprintf(file, "k %lu %d\n", event.step, event.key);
+        }
+    }
+    bool ok = std::fclose(file) == 0;
+    if (!ok) std::cerr << "input log: error writing " << path << std::endl;
+    return ok;
+}
+
+void input_log_t::record(unsigned long step, const glm::vec2& stepOrbit, float stepZoom, const std::vector<int>& presses) {
+    if (stepOrbit != orbit || stepZoom != zoom) {
+        events.push_back({ step, 0, stepOrbit, stepZoom });
+        orbit = stepOrbit;
+        zoom = stepZoom;
+    }
+    for (int key : presses) {
+        events.push_back({ step, key, glm::vec2(0.0f), 0.0f });
+    }
+}
+
+void input_log_t::replay(unsigned long step, glm::vec2& stepOrbit, float& stepZoom, std::vector<int>& presses) {
+    presses.clear();
+    for (; cursor < events.size() && events[cursor].step <= step; cursor++) {
+        const event_t& event = events[cursor];
+        if (event.key == 0) {
+            orbit = event.orbit;
+            zoom = event.zoom;
+        } else if (event.step == step) {
+            presses.push_back(event.key);
+        }
+    }
+    stepOrbit = orbit;
+    stepZoom = zoom;
+}
@@ -0,0 +1,153 @@
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <iostream>
+
+#include "header/instance_buffer.h"
+#include "header/gpu_memory.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define INSTANCE_TRANSFORMS_SSE 1
+#include <emmintrin.h>
+#endif
+
+static_assert(sizeof(instance_transform_t) == INSTANCE_TEXELS * sizeof(glm::vec4),
+              "instance_transform_t must match the shader texel layout");
+
+#ifdef INSTANCE_TRANSFORMS_SSE
+static inline __m128 cross3(__m128 a, __m128 b) {
+    __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+    return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+static inline float dot3(__m128 a, __m128 b) {
+    __m128 m = _mm_mul_ps(a, b);
+    __m128 y = _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1));
+    __m128 z = _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 2, 2, 2));
+    return _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(m, y), z));
+}
+
+// matrices are column-major float[16] (glm layout)
+static void transform_sse(const float* vp, const float* model, float* mvp, float* normal) {
+    __m128 vp0 = _mm_loadu_ps(vp);
+    __m128 vp1 = _mm_loadu_ps(vp + 4);
+    __m128 vp2 = _mm_loadu_ps(vp + 8);
+    __m128 vp3 = _mm_loadu_ps(vp + 12);
+
+    for (int c = 0; c < 4; c++) {
+        const float* col = model + 4 * c;
+        __m128 r = _mm_mul_ps(vp0, _mm_set1_ps(col[0]));
+        r = _mm_add_ps(r, _mm_mul_ps(vp1, _mm_set1_ps(col[1])));
+        r = _mm_add_ps(r, _mm_mul_ps(vp2, _mm_set1_ps(col[2])));
+        r = _mm_add_ps(r, _mm_mul_ps(vp3, _mm_set1_ps(col[3])));
+        _mm_storeu_ps(mvp + 4 * c, r);
+    }
+
+    // transpose(inverse(A)) = cofactor(A) / det(A), cofactor columns are cross products
+    __m128 a0 = _mm_loadu_ps(model);
+    __m128 a1 = _mm_loadu_ps(model + 4);
+    __m128 a2 = _mm_loadu_ps(model + 8);
+    __m128 n0 = cross3(a1, a2);
+    __m128 n1 = cross3(a2, a0);
+    __m128 n2 = cross3(a0, a1);
+    float det = dot3(a0, n0);
+    __m128 invDet = _mm_set1_ps(det != 0.0f ? 1.0f / det : 1.0f);
+    _mm_storeu_ps(normal, _mm_mul_ps(n0, invDet));
+    _mm_storeu_ps(normal + 4, _mm_mul_ps(n1, invDet));
+    _mm_storeu_ps(normal + 8, _mm_mul_ps(n2, invDet));
+}
+#endif
+
+void compute_instance_transforms(const glm::mat4& viewProjection, const glm::mat4* models,
+                                 instance_transform_t* out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        out[i].model = models[i];
+#ifdef INSTANCE_TRANSFORMS_SSE
+        transform_sse(&viewProjection[0][0], &models[i][0][0], &out[i].mvp[0][0], &out[i].normalMatrix[0].x);
+#else
+        out[i].mvp = viewProjection * models[i];
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(models[i])));
+        for (int c = 0; c < 3; c++) {
+            out[i].normalMatrix[c] = glm::vec4(normalMatrix[c], 0.0f);
+        }
+#endif
+    }
+}
+
+instance_buffer_t::instance_buffer_t() {
+    glGenBuffers(1, &buffer);
+    glGenTextures(1, &texture);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(instance_transform_t), NULL, GL_STREAM_DRAW);
+    // the buffer texture is a view of it and holds nothing of its own
+    gpuMemory.track(GL_OBJECT_BUFFER, buffer, GPU_MEMORY_STREAMING, "instance transforms");
+    gpuMemory.resize(GL_OBJECT_BUFFER, buffer, sizeof(instance_transform_t));
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    capacity = 1;
+
+    GLint maxTexels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    // the GL 3.3 minimum should the query fail
+    maxInstances = std::max(maxTexels, 65536) / INSTANCE_TEXELS;
+}
+
+instance_buffer_t::~instance_buffer_t() {
+    gpuMemory.untrack(GL_OBJECT_BUFFER, buffer);
+    glDeleteTextures(1, &texture);
+    glDeleteBuffers(1, &buffer);
+}
+
+void instance_buffer_t::upload(const glm::mat4& viewProjection, const std::vector<glm::mat4>& models,
+                               uint8_t* selected) {
+    size_t count = models.size();
+    bases.assign(count, -1);
+    transforms.clear();
+    size_t wanted = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!selected[i]) continue;
+        wanted++;
+        if (transforms.size() == maxInstances) {
+            selected[i] = 0;
+            continue;
+        }
+        bases[i] = (int)transforms.size();
+        transforms.emplace_back();
+    }
+    if (wanted > transforms.size() && !warnedLimit) {
+        warnedLimit = true;
+        std::cout << "[instances] " << wanted << " instances drawn, the buffer texture holds " << maxInstances
+                  << " (GL_MAX_TEXTURE_BUFFER_SIZE), the rest are not drawn" << std::endl;
+    }
+    if (transforms.empty()) return;
+
+    // one batched call per run of consecutive uploaded instances
+    for (size_t i = 0; i < count;) {
+        if (bases[i] < 0) {
+            i++;
+            continue;
+        }
+        size_t end = i + 1;
+        while (end < count && bases[end] >= 0) end++;
+        compute_instance_transforms(viewProjection, &models[i], &transforms[bases[i]], end - i);
+        i = end;
+    }
+
+    // orphan every frame, last frame's draws may still be reading
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    capacity = std::max(capacity, transforms.size());
+    glBufferData(GL_TEXTURE_BUFFER, capacity * sizeof(instance_transform_t), NULL, GL_STREAM_DRAW);
+    gpuMemory.resize(GL_OBJECT_BUFFER, buffer, capacity * sizeof(instance_transform_t));
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, transforms.size() * sizeof(instance_transform_t), transforms.data());
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void instance_buffer_t::bind() {
+    glActiveTexture(GL_TEXTURE0 + INSTANCE_BUFFER_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glActiveTexture(GL_TEXTURE0);
+}
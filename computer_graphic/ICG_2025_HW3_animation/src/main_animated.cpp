@@ -9,12 +9,30 @@
 #include "header/cube.h"
 #include "header/animated_model.h"
 #include "header/shader.h"
+#include "header/gpu_timer.h"
+#include "header/cpu_skinning.h"
+#include "header/instance_buffer.h"
+#include "header/hiz_culling.h"
+#include "header/render_queue.h"
+#include "header/oit.h"
+#include "header/post_process.h"
+#include "header/clustered_lighting.h"
+#include "header/shadow_map.h"
+#include "header/impostor.h"
+#include "header/sim_thread.h"
+#include "header/headless_context.h"
+#include "header/frame_capture.h"
+#include "header/profiler.h"
+#include "header/input_log.h"
+#include "header/gpu_memory.h"
+#include "header/frame_arena.h"
+#include "header/scene.h"
 #include "header/stb_image.h"
 
 void framebufferSizeCallback(GLFWwindow *window, int width, int height);
 void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods);
 void processInput(GLFWwindow *window);
-unsigned int loadCubemap(std::vector<std::string> &mFileName);
+void loadCubemap(std::vector<std::string> &mFileName, gl_object_t& texture);
 
 struct material_t{
     glm::vec3 ambient;
@@ -55,21 +73,101 @@ struct camera_t{
 // settings
 int SCR_WIDTH = 800;
 int SCR_HEIGHT = 600;
+bool asyncShaderCompile = true; // submit all programs at startup, resolve link status lazily
+// Where skinning runs. TF and CPU skin each visible model once per frame into its
+// post-skin buffer and the draw passes use the preskinned_*.vert shaders; VS is the
+// old path that skins inside every draw. AUTO picks CPU on software renderers.
+// Forced with --skinning=auto|vs|tf|cpu
+enum skinning_backend_t {
+    SKINNING_AUTO,
+    SKINNING_VERTEX_SHADER,
+    SKINNING_TRANSFORM_FEEDBACK,
+    SKINNING_CPU
+};
+skinning_backend_t skinningBackend = SKINNING_AUTO;
+// Explosion/pulse/aura run in the vertex stage off the face stream; the old
+// geometry shaders are only used when asked for (--gs-effects) or when there
+// is no post-skin buffer to read faces from (--skinning=vs)
+bool useGeometryShaderEffects = false;
+const float GPU_TIMER_REPORT_INTERVAL = 2.0f; // seconds between per-pass GPU timing prints
+const float PROFILE_TITLE_INTERVAL = 0.5f;    // seconds between window title profile updates
+// Re-issue the crowd draws with the rasterizer discarded under their own timer
+// ("crowd-vs"), which isolates the vertex stage cost (--measure-vertex-stage)
+bool measureVertexStage = false;
+bool enableFrustumCulling = true; // --no-cull draws every enabled instance
+bool enableOcclusionCulling = true; // --no-occlusion skips the Hi-Z phase
+bool skyboxFirst = false; // --skybox-first: old order, to compare fragment counts
+bool enableStateCache = true; // --no-state-cache issues every state change like the old inline code
+bool enableOIT = true; // --no-oit: sorted alpha blending for transparent layers instead
+// The scene is drawn into an HDR target and resolved by the post chain;
+// --no-post draws straight into the backbuffer with the old fade overlay
+bool enablePostProcess = true;
+const float CAMERA_FAR = 1000.0f;
+const float CAMERA_FOV = glm::radians(45.0f);
+const float CAMERA_NEAR = 0.1f;
+int finaleLightCount = 128; // --lights=N: moving point/spot lights in the finale
+bool enableShadows = true; // --no-shadows
+bool enableShadowCache = true; // --no-shadow-cache redraws every caster every frame
+const float SHADOW_RADIUS = 80.0f; // sun shadow covers the crowd's orbit around the origin
+// Distant crowd members become impostors once an atlas cell has at least this
+// many texels per screen pixel across the character (--impostor-texel-ratio=R);
+// the crossfade runs until IMPOSTOR_FADE_RANGE times that. --no-impostors
+bool enableImpostors = true;
+float impostorTexelRatio = 1.0f;
+const float IMPOSTOR_FADE_RANGE = 1.5f;
+// Simulation (input, animation, camera, effect timers) steps on its own thread
+// one frame ahead of rendering; --no-sim-thread steps it inline before each frame
+bool enableSimThread = true;
+// The simulation advances in fixed steps of 1/simRate seconds (--sim-rate=HZ)
+// and rendering blends the last two states. --deterministic takes exactly one
+// step per rendered frame regardless of wall time, for reproducible runs.
+int simRate = 60;
+const int SIM_MAX_CATCH_UP_STEPS = 5; // per update; more than that is dropped
+bool deterministicClock = false;
+// --headless: no window, a surfaceless EGL context drawing --frames=N frames
+// at --size=WxH into an offscreen target, deterministic and synchronous
+bool headless = false;
+int headlessFrames = 300;
+unsigned int outputFBO = 0; // default framebuffer, or the headless target
+// Frame recording: --capture=DIR writes a PNG sequence, --capture-pipe=CMD
+// pipes raw I420 into an encoder, e.g.
+// --capture-pipe="ffmpeg -f rawvideo -pix_fmt yuv420p -s 1920x1080 -r 60 -i - show.mp4"
+std::string captureTarget;
+capture_format_t captureFormat = CAPTURE_PNG;
+// --trace=FILE: Chrome trace of every profiler zone until exit
+std::string tracePath;
+// --bench-json=FILE: frame time distribution at exit, for the benchmark target
+std::string benchJsonPath;
+// --record=FILE saves the input of every simulation step at exit,
+// --replay=FILE feeds a saved log back instead of the keyboard
+std::string recordPath;
+std::string replayPath;
+input_log_t inputLog;
+// --vram-budget=MB evicts streamable textures past the budget,
+// --gpu-memory-list prints every tracked GL object at exit
+bool listGpuMemory = false;
+// --scene=FILE: the characters and where they dance, see header/scene.h
+std::string scenePath = "../../src/asset/default.scene";
+
+// Seconds since startup. A steady clock instead of glfwGetTime(), which
+// headless runs can't use since they never initialize GLFW.
+const std::chrono::steady_clock::time_point appStart = std::chrono::steady_clock::now();
+double app_time(){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - appStart).count();
+}
 
 // cube map 
-unsigned int cubemapTexture;
-unsigned int cubemapTextureRyder; // [NEW] Second skybox
-unsigned int cubemapVAO, cubemapVBO;
+gl_object_t cubemapTexture;
+gl_object_t cubemapTextureRyder; // [NEW] Second skybox
+gl_object_t cubemapVAO, cubemapVBO;
 
 // fade overlay
 shader_program_t* fadeShader = nullptr;
-unsigned int fadeVAO, fadeVBO;
+gl_object_t fadeVAO, fadeVBO;
 float fadeAlpha = 0.0f;
-bool isFadingOut = false;
-bool isFadingIn = false;
 bool isFinaleMode = false; // [NEW] Triggers scene switch
-bool enableCrowdGS = false; // [NEW] Toggle geometry shader effect in finale
-bool enableCrowdGSPulse = false; // [NEW] Alternate geometry shader effect
+bool enableCrowdExplosion = false; // [NEW] Toggle explosion effect in finale
+bool enableCrowdPulse = false; // [NEW] Alternate pulse effect
 const float FADE_SPEED = 1.0f;
 
 // shader programs
@@ -82,12 +180,8 @@ material_t material;
 camera_t camera;
 
 // --- Global Variables ---
-// animated model
-AnimatedModel* animatedModel;
-AnimatedModel* dogModel;
-AnimatedModel* bananaModel;
-AnimatedModel* allosaurusModel;
-AnimatedModel* gromitModel;
+// animated models and their instances
+scene_t scene;
 bool isExploded = false;
 float explosionLevel = 0.0f; // 0.0 = Normal Dog, >0.0 = Exploding Dog
 const float MAX_EXPLOSION = 7.0f;
@@ -97,73 +191,172 @@ glm::mat4 modelMatrix;
 // Shaders
 // std::vector<shader_program_t*> shaderPrograms; // Removed duplicate
 shader_program_t* flairShader = nullptr; // Dedicated shader for Flair (Toon, No GS)
-shader_program_t* flairShaderGS = nullptr; // [NEW] Flair shader with geometry effect
-shader_program_t* flairShaderGSPulse = nullptr; // [NEW] Flair shader with pulse GS
-shader_program_t* dogShader = nullptr;   // Dedicated shader for Dog (Metallic + GS)
+shader_program_t* flairShaderExplosion = nullptr; // [NEW] Flair shader with explosion effect
+shader_program_t* flairShaderPulse = nullptr; // [NEW] Flair shader with pulse effect
+shader_program_t* dogShader = nullptr;   // Dedicated shader for Dog (Metallic + Explosion + Aura)
+shader_program_t* skinningShader = nullptr; // Transform feedback skinning pre-pass
+cpu_skinner_t* cpuSkinner = nullptr;         // CPU skinning backend
+gpu_timer_t* gpuTimer = nullptr;
+instance_buffer_t* instanceBuffer = nullptr; // per-instance model/mvp/normal matrices
+hiz_pyramid_t* hizPyramid = nullptr;         // occlusion culling depth pyramid
+oit_target_t* oitTarget = nullptr;           // weighted blended transparency targets
+render_target_pool_t* renderTargetPool = nullptr; // HDR scene + post intermediates
+post_chain_t* postChain = nullptr;
+unsigned int sceneFBO = 0;                   // what this frame draws into
+light_clusters_t* lightClusters = nullptr;   // dynamic lights binned per view cluster
+std::vector<dynamic_light_t> sceneLights;
+shadow_map_t* shadowMap = nullptr;           // sun shadow with cached static casters
+impostor_renderer_t* impostorRenderer = nullptr; // baked atlases for distant characters
+frame_capture_t* frameCapture = nullptr;     // asynchronous readback of finished frames
+render_queue_t renderQueue;
+gl_state_cache_t glStateCache;
 // int shaderProgramIndex = 0; // Removed duplicate
 shader_program_t* cubemapShader;
 
-// animation timing
+// animation time of the frame being drawn
 float currentTime = 0.0f;
-float deltaTime = 0.0f;
-float lastFrame = 0.0f;
 
-void model_setup(){
-#if defined(__linux__) || defined(__APPLE__)
-    std::string fbx_file = "../../src/asset/Dancing_Twerk.fbx";
-    std::string texture_dir = "../../src/asset/texture/";
-#else
-    std::string fbx_file = "../../src/asset/Flair.fbx";
-    std::string texture_dir = "../../src/asset/texture/";
-#endif
+bool usePostSkinBuffer(){
+    return skinningBackend != SKINNING_VERTEX_SHADER;
+}
 
-    // Load the animated FBX model
-    animatedModel = new AnimatedModel(fbx_file);
-    // animatedModel->loadTexture(texture_dir + "Mei_TEX.png"); // Using existing texture
-    
-    // Load the DogBalloon model
-    std::string dog_file = "../../src/asset/obj/DogBalloon/DogBalloon.obj";
-    dogModel = new AnimatedModel(dog_file);
-
-    // Create a 1x1 white texture for DogBalloon because shaders multiply texture color
-    unsigned int whiteTexture;
-    glGenTextures(1, &whiteTexture);
-    glBindTexture(GL_TEXTURE_2D, whiteTexture);
-    unsigned char whiteData[] = { 255, 255, 255, 255 }; // RGBA, all white
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, whiteData);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    dogModel->texture = whiteTexture; // Assign to dogModel
-
-    // Load the Banana dancing model
-    std::string banana_file = "../../src/asset/BananaDancing.fbx";
-    bananaModel = new AnimatedModel(banana_file);
-    if (bananaModel->texture == 0) {
-        bananaModel->loadTexture(texture_dir + "T_M_MED_Banana_Smooth_Body_D.tga");
-    }
-
-    // Load the Dancing Allosaurus model
-    std::string allosaurus_file = "../../src/asset/Samba Dancing.fbx";
-    allosaurusModel = new AnimatedModel(allosaurus_file);
-    if (allosaurusModel->texture == 0) {
-        allosaurusModel->loadTexture(texture_dir + "Allosaurus_colorize_d.png");
-    }
-
-    // Load the Gromit model
-    std::string gromit_file = "../../src/asset/gromit doing the metro man dance.fbx";
-    gromitModel = new AnimatedModel(gromit_file);
-    if (gromitModel->texture == 0) {
-        gromitModel->loadTexture(texture_dir + "Tex_0028_0_dds_Base_Color_image.png");
+bool useFaceStreamEffects(){
+    return usePostSkinBuffer() && !useGeometryShaderEffects;
+}
+
+// Frustum culling counters, printed and reset with the GPU timer report
+struct cull_stats_t {
+    unsigned long drawn = 0;
+    unsigned long culled = 0;          // outside the frustum
+    unsigned long occlusionTested = 0;
+    unsigned long occluded = 0;        // behind the Hi-Z of the phase 1 draws
+    unsigned long frames = 0;
+    double lightBinning = 0.0;         // seconds spent binning lights
+    unsigned long impostors = 0;       // drawn as impostor only
+    unsigned long crossfading = 0;     // drawn as both
+};
+cull_stats_t cullStats;
+
+// Input sampled on the main thread (GLFW only allows it there) for the next
+// simulation step
+struct input_frame_t {
+    glm::vec2 orbit = glm::vec2(0.0f); // held keys, -1..1
+    float zoom = 0.0f;
+    std::vector<int> presses;          // toggle keys pressed since the last step
+    double sampled = 0.0;              // oldest sample not yet simulated, 0 = none
+};
+std::mutex inputMutex;
+input_frame_t pendingInput;
+
+// One simulation state as the renderer sees it
+struct sim_view_t {
+    camera_t camera;
+    float time = 0.0f;
+    float explosionLevel = 0.0f;
+    float fadeAlpha = 0.0f;
+    bool isFinaleMode = false;
+    bool isExploded = false;
+    bool enableCrowdExplosion = false;
+    bool enableCrowdPulse = false;
+    int shaderProgramIndex = 0;
+    // per scene asset, instance transforms follow from time
+    std::vector<std::vector<glm::mat4>> palettes; // empty for unanimated models
+    std::vector<aabb_t> poseBounds;
+    std::vector<dynamic_light_t> lights;
+};
+
+// Everything the simulation advances. Only simulate() touches it.
+struct sim_state_t {
+    camera_t camera;
+    float time = 0.0f;               // steps * step length, not wall time
+    float explosionLevel = 0.0f;
+    float fadeAlpha = 0.0f;
+    bool isFadingOut = false;
+    bool isFadingIn = false;
+    bool isFinaleMode = false;
+    bool isExploded = false;
+    bool enableCrowdExplosion = false;
+    bool enableCrowdPulse = false;
+    int shaderProgramIndex = 0;
+    unsigned long frame = 0;
+    sim_view_t views[2];             // the last two steps, views[current] is the newer
+    int current = 0;
+};
+sim_state_t simState;
+sim_clock_t simClock;
+
+// What the render thread draws from: the last two simulation states and the
+// clock to blend them by. Written by simulate(), never changed while the
+// render thread holds it.
+struct frame_snapshot_t {
+    unsigned long frame = 0;         // steps simulated so far
+    double inputSampled = 0.0;       // oldest input sample it includes, 0 = none
+    sim_clock_t clock;
+    sim_view_t previous;
+    sim_view_t current;
+};
+snapshot_buffer_t<frame_snapshot_t> snapshots;
+std::vector<std::vector<glm::mat4>> blendedPalettes; // render side scratch, per asset
+
+// Per-thread frame timing, printed and reset with the GPU timer report
+struct frame_stats_t {
+    unsigned long frames = 0;
+    double renderSeconds = 0.0;      // render(): culling, skinning, submission
+    double swapSeconds = 0.0;        // blocked in glfwSwapBuffers (glFinish headless)
+    unsigned long repeated = 0;      // frames without a new simulation state
+    unsigned long inlineSteps = 0;   // --no-sim-thread
+    double inlineStepSeconds = 0.0;
+    unsigned long inputFrames = 0;
+    double inputLatency = 0.0;       // input sampled -> frame with it presented
+    unsigned long heapAllocations = 0; // operator new calls from simulate() to the swap
+};
+frame_stats_t frameStats;
+
+const char* skinning_backend_name(skinning_backend_t backend){
+    switch (backend) {
+        case SKINNING_VERTEX_SHADER: return "vs";
+        case SKINNING_TRANSFORM_FEEDBACK: return "tf";
+        case SKINNING_CPU: return "cpu";
+        default: return "auto";
+    }
+}
+
+// Software rasterizers run vertex shaders on the CPU anyway, and the 200-entry
+// uniform palette makes in-shader skinning especially slow there.
+void skinning_backend_setup(){
+    const char* renderer = (const char*)glGetString(GL_RENDERER);
+    std::string rendererName = renderer ? renderer : "";
+    if (skinningBackend == SKINNING_AUTO) {
+        bool softwareGL = rendererName.find("llvmpipe") != std::string::npos ||
+                          rendererName.find("softpipe") != std::string::npos ||
+                          rendererName.find("SWR") != std::string::npos ||
+                          rendererName.find("Software Rasterizer") != std::string::npos;
+        skinningBackend = softwareGL ? SKINNING_CPU : SKINNING_TRANSFORM_FEEDBACK;
     }
 
+    if (skinningBackend == SKINNING_CPU) {
+        cpuSkinner = new cpu_skinner_t();
+    }
+    std::cout << "GL_RENDERER: " << rendererName << ", skinning backend: "
+              << skinning_backend_name(skinningBackend);
+    if (cpuSkinner) {
+        std::cout << " (" << cpuSkinner->thread_count() << " threads, "
+                  << (cpu_skinner_t::has_avx2() ? "avx2" : "scalar") << ")";
+    }
+    std::cout << std::endl;
+}
+
+void model_setup(){
+    // Load every model of the scene (read in main) with its fallback texture
+    scene.load_assets();
+    blendedPalettes.resize(scene.assets.size());
+
     modelMatrix = glm::mat4(1.0f);
     modelMatrix = glm::scale(modelMatrix, glm::vec3(10.0f, 10.0f, 10.0f)); // Initial scale (will be overridden in render)
     modelMatrix = glm::translate(modelMatrix, glm::vec3(0.0f, -0.6f, 0.0f)); 
 }
 
-void updateCamera(){
+void updateCamera(camera_t& camera){
     // Convert spherical orbit definition to cartesian camera position
     float yawRad = glm::radians(camera.yaw);
     float pitchRad = glm::radians(camera.pitch);
@@ -178,11 +371,11 @@ void updateCamera(){
     camera.up = glm::normalize(glm::cross(camera.right, camera.front));
 }
 
-void applyOrbitDelta(float yawDelta, float pitchDelta, float radiusDelta) {
+void applyOrbitDelta(camera_t& camera, float yawDelta, float pitchDelta, float radiusDelta) {
     camera.yaw += yawDelta;
     camera.pitch = glm::clamp(camera.pitch + pitchDelta, camera.minOrbitPitch, camera.maxOrbitPitch);
     camera.radius = glm::clamp(camera.radius + radiusDelta, camera.minRadius, camera.maxRadius);
-    updateCamera();
+    updateCamera(camera);
 }
 
 void processInput(GLFWwindow *window) {
@@ -205,11 +398,12 @@ void processInput(GLFWwindow *window) {
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
         zoomInput += 1.0f;
 
-    if (orbitInput.x != 0.0f || orbitInput.y != 0.0f || zoomInput != 0.0f) {
-        float yawDelta = orbitInput.x * camera.orbitRotateSpeed * deltaTime;
-        float pitchDelta = orbitInput.y * camera.orbitRotateSpeed * deltaTime;
-        float radiusDelta = zoomInput * camera.orbitZoomSpeed * deltaTime;
-        applyOrbitDelta(yawDelta, pitchDelta, radiusDelta);
+    // held keys are rates, the simulation scales them by its own step
+    std::lock_guard<std::mutex> lock(inputMutex);
+    pendingInput.orbit = orbitInput;
+    pendingInput.zoom = zoomInput;
+    if ((orbitInput.x != 0.0f || orbitInput.y != 0.0f || zoomInput != 0.0f) && pendingInput.sampled == 0.0) {
+        pendingInput.sampled = app_time();
     }
 }
 
@@ -232,7 +426,7 @@ void camera_setup(){
     camera.enableAutoOrbit = true;
     camera.autoOrbitSpeed = 20.0f;
 
-    updateCamera();
+    updateCamera(camera);
 }
 
 void light_setup(){
@@ -261,6 +455,14 @@ void shader_setup(){
         "default", "bling-phong", "gouraud", "metallic", "glass_schlick", "toon"
     };
 
+    // Programs are only submitted here; with async compile the driver builds them
+    // in the background and render() falls back until each one is ready.
+    shader_program_t::set_async_compile(asyncShaderCompile);
+    if (asyncShaderCompile) {
+        std::cout << "async shader compile, GL_KHR_parallel_shader_compile: "
+                  << (shader_program_t::has_parallel_compile() ? "yes" : "no") << std::endl;
+    }
+
     // Create animated versions of all original shaders
     for(int i=0; i<shadingMethod.size(); i++){
         std::string vpath = shaderDir + "animated_" + shadingMethod[i] + ".vert";
@@ -271,8 +473,9 @@ void shader_setup(){
         shaderProgram->add_shader(vpath, GL_VERTEX_SHADER);
         shaderProgram->add_shader(fpath, GL_FRAGMENT_SHADER);
         
-        // Add Explosion Geometry Shader (skip gouraud due to interface mismatch)
-        if (shadingMethod[i] != "gouraud") {
+        // Add Explosion Geometry Shader (skip gouraud due to interface mismatch).
+        // Nothing drives its magnitude, so it is pure overhead unless requested.
+        if (useGeometryShaderEffects && shadingMethod[i] != "gouraud") {
             std::string gspath = shaderDir + "explosion.gs";
             shaderProgram->add_shader(gspath, GL_GEOMETRY_SHADER);
         }
@@ -281,38 +484,130 @@ void shader_setup(){
         shaderPrograms.push_back(shaderProgram);
     }
 
+    // Draw passes read the post-skin buffer when the skinning pre-pass is on
+    std::string crowdVert = usePostSkinBuffer() ? "preskinned_default.vert" : "animated_default.vert";
+    std::string dogVert = usePostSkinBuffer() ? "preskinned_metallic.vert" : "animated_metallic.vert";
+
+    // --- Setup Skinning Pre-pass (transform feedback, no rasterization) ---
+    skinningShader = new shader_program_t();
+    skinningShader->create();
+    skinningShader->add_shader(shaderDir + "skinning.vert", GL_VERTEX_SHADER);
+    skinningShader->set_feedback_varyings({"skinnedPosition", "skinnedNormal"});
+    skinningShader->link_shader();
+    skinningShader->wait();
+
+    // --- Setup Hi-Z pyramid for crowd occlusion culling ---
+    hizPyramid = new hiz_pyramid_t(shaderDir);
+
+    // --- Setup OIT targets, transparent items are drawn into them and composited ---
+    if (enableOIT) {
+        oitTarget = new oit_target_t(shaderDir);
+        renderQueue.set_pass_hooks(PASS_TRANSPARENT,
+            []() { oitTarget->begin(SCR_WIDTH, SCR_HEIGHT, sceneFBO); },
+            []() { oitTarget->composite(); });
+    }
+
+    // --- Setup clustered light buffers (bound for the whole frame) ---
+    lightClusters = new light_clusters_t();
+
+    // --- Setup sun shadow map ---
+    if (enableShadows) {
+        shadowMap = new shadow_map_t(shaderDir);
+        shadowMap->enableCache = enableShadowCache;
+    }
+
+    // --- Setup post chain: tonemap, grade, vignette and fade fuse into one pass ---
+    renderTargetPool = new render_target_pool_t();
+    if (enablePostProcess) {
+        postChain = new post_chain_t(shaderDir);
+
+        post_effect_t tonemap;
+        tonemap.name = "tonemap";
+        tonemap.fusedStage = POST_TONEMAP;
+        tonemap.uniforms = [](shader_program_t* program) {
+            program->set_uniform_value("exposure", 1.0f);
+            program->set_uniform_value("toneKnee", 0.8f);
+        };
+        postChain->add_effect(tonemap);
+
+        post_effect_t grade;
+        grade.name = "grade";
+        grade.fusedStage = POST_GRADE;
+        grade.uniforms = [](shader_program_t* program) {
+            program->set_uniform_value("saturation", isFinaleMode ? 1.15f : 1.05f);
+            program->set_uniform_value("contrast", 1.05f);
+            program->set_uniform_value("gain", glm::vec3(1.0f));
+        };
+        postChain->add_effect(grade);
+
+        post_effect_t vignette;
+        vignette.name = "vignette";
+        vignette.fusedStage = POST_VIGNETTE;
+        vignette.uniforms = [](shader_program_t* program) {
+            program->set_uniform_value("vignetteStrength", 0.35f);
+            program->set_uniform_value("vignetteRadius", 0.55f);
+        };
+        postChain->add_effect(vignette);
+
+        post_effect_t fade;
+        fade.name = "fade";
+        fade.fusedStage = POST_FADE;
+        fade.uniforms = [](shader_program_t* program) { program->set_uniform_value("fade", fadeAlpha); };
+        postChain->add_effect(fade);
+    }
+
     // --- Setup Flair Dedicated Shader (Toon, No GS) ---
+    // Also the fallback for the crowd variants, so it is the only one waited on.
     flairShader = new shader_program_t();
     flairShader->create();
-    flairShader->add_shader(shaderDir + "animated_default.vert", GL_VERTEX_SHADER);
+    flairShader->add_shader(shaderDir + crowdVert, GL_VERTEX_SHADER);
     flairShader->add_shader(shaderDir + "toon.frag", GL_FRAGMENT_SHADER);
     flairShader->link_shader();
+    flairShader->wait();
+
+    if (useFaceStreamEffects()) {
+        // --- Setup Flair Explosion / Pulse (vertex stage, face stream) ---
+        flairShaderExplosion = new shader_program_t();
+        flairShaderExplosion->create();
+        flairShaderExplosion->add_shader(shaderDir + "fx_explosion.vert", GL_VERTEX_SHADER);
+        flairShaderExplosion->add_shader(shaderDir + "toon.frag", GL_FRAGMENT_SHADER);
+        flairShaderExplosion->link_shader();
+
+        flairShaderPulse = new shader_program_t();
+        flairShaderPulse->create();
+        flairShaderPulse->add_shader(shaderDir + "fx_pulse.vert", GL_VERTEX_SHADER);
+        flairShaderPulse->add_shader(shaderDir + "toon.frag", GL_FRAGMENT_SHADER);
+        flairShaderPulse->link_shader();
+
+        // --- Setup Dog Dedicated Shader (Metallic + Explosion + Aura, vertex stage) ---
+        dogShader = new shader_program_t();
+        dogShader->create();
+        dogShader->add_shader(shaderDir + "fx_metallic.vert", GL_VERTEX_SHADER);
+        dogShader->add_shader(shaderDir + "metallic.frag", GL_FRAGMENT_SHADER);
+        dogShader->link_shader();
+        return;
+    }
 
     // --- Setup Flair Shader with Geometry Shader ---
-    flairShaderGS = new shader_program_t();
-    flairShaderGS->create();
-    flairShaderGS->add_shader(shaderDir + "animated_default.vert", GL_VERTEX_SHADER);
-    flairShaderGS->add_shader(shaderDir + "toon.frag", GL_FRAGMENT_SHADER);
-    flairShaderGS->add_shader(shaderDir + "explosion.gs", GL_GEOMETRY_SHADER);
-    flairShaderGS->link_shader();
+    flairShaderExplosion = new shader_program_t();
+    flairShaderExplosion->create();
+    flairShaderExplosion->add_shader(shaderDir + crowdVert, GL_VERTEX_SHADER);
+    flairShaderExplosion->add_shader(shaderDir + "toon.frag", GL_FRAGMENT_SHADER);
+    flairShaderExplosion->add_shader(shaderDir + "explosion.gs", GL_GEOMETRY_SHADER);
+    flairShaderExplosion->link_shader();
 
     // --- Setup Flair Shader with Pulse Geometry Shader ---
-    flairShaderGSPulse = new shader_program_t();
-    flairShaderGSPulse->create();
-    flairShaderGSPulse->add_shader(shaderDir + "animated_default.vert", GL_VERTEX_SHADER);
-    flairShaderGSPulse->add_shader(shaderDir + "toon.frag", GL_FRAGMENT_SHADER);
-    flairShaderGSPulse->add_shader(shaderDir + "pulse.gs", GL_GEOMETRY_SHADER);
-    flairShaderGSPulse->link_shader();
+    flairShaderPulse = new shader_program_t();
+    flairShaderPulse->create();
+    flairShaderPulse->add_shader(shaderDir + crowdVert, GL_VERTEX_SHADER);
+    flairShaderPulse->add_shader(shaderDir + "toon.frag", GL_FRAGMENT_SHADER);
+    flairShaderPulse->add_shader(shaderDir + "pulse.gs", GL_GEOMETRY_SHADER);
+    flairShaderPulse->link_shader();
 
     // --- Setup Dog Dedicated Shader (Metallic + Combined GS) ---
     dogShader = new shader_program_t();
     dogShader->create();
-    // Re-use animated_metallic.vert (if it exists) or animated_default.vert
-    // Usually metallic uses standard animated vert if no special needs. 
-    // Let's assume animated_metallic.vert was used by original metallic setup if it exists, otherwise default.
-    // In shader_setup loop: "animated_" + shadingMethod[i] + ".vert". Method is "metallic".
-    // So "animated_metallic.vert" should exist.
-    dogShader->add_shader(shaderDir + "animated_metallic.vert", GL_VERTEX_SHADER);
+    dogShader->add_shader(shaderDir + dogVert, GL_VERTEX_SHADER);
     dogShader->add_shader(shaderDir + "metallic.frag", GL_FRAGMENT_SHADER);
     // Use the UPDATED metallic.gs which now has explosion logic
     dogShader->add_shader(shaderDir + "metallic.gs", GL_GEOMETRY_SHADER);
@@ -340,7 +635,7 @@ void cubemap_setup(){
         cubemapDir + "front.png",
         cubemapDir + "back.png"
     };
-    cubemapTexture = loadCubemap(faces);   
+    loadCubemap(faces, cubemapTexture);   
 
     // setup shader for cubemap
     std::string vpath = shaderDir + "cubemap.vert";
@@ -351,12 +646,14 @@ void cubemap_setup(){
     cubemapShader->add_shader(vpath, GL_VERTEX_SHADER);
     cubemapShader->add_shader(fpath, GL_FRAGMENT_SHADER);
     cubemapShader->link_shader();
+    cubemapShader->wait();
 
-    glGenVertexArrays(1, &cubemapVAO);
-    glGenBuffers(1, &cubemapVBO);
+    cubemapVAO.create(GL_OBJECT_VERTEX_ARRAY, GPU_MEMORY_MESHES, "skybox cube");
+    cubemapVBO.create(GL_OBJECT_BUFFER, GPU_MEMORY_MESHES, "skybox cube");
     glBindVertexArray(cubemapVAO);
     glBindBuffer(GL_ARRAY_BUFFER, cubemapVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(cubemapVertices), &cubemapVertices, GL_STATIC_DRAW);
+    cubemapVBO.resize(sizeof(cubemapVertices));
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glBindVertexArray(0);
@@ -371,7 +668,7 @@ void cubemap_setup(){
         texture_dir + "ryder/front.png",
         texture_dir + "ryder/back.png"
     };
-    cubemapTextureRyder = loadCubemap(facesRyder);
+    loadCubemap(facesRyder, cubemapTextureRyder);
 }
 
 void fade_setup() {
@@ -399,21 +696,22 @@ void fade_setup() {
          1.0f,  1.0f, 0.0f
     };
 
-    glGenVertexArrays(1, &fadeVAO);
-    glGenBuffers(1, &fadeVBO);
+    fadeVAO.create(GL_OBJECT_VERTEX_ARRAY, GPU_MEMORY_MESHES, "fade quad");
+    fadeVBO.create(GL_OBJECT_BUFFER, GPU_MEMORY_MESHES, "fade quad");
     glBindVertexArray(fadeVAO);
     glBindBuffer(GL_ARRAY_BUFFER, fadeVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
+    fadeVBO.resize(sizeof(quadVertices));
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glBindVertexArray(0);
 }
 
-void renderAnimatedCharacter(shader_program_t* shader, AnimatedModel* model, const glm::mat4& modelMat) {
-    shader->set_uniform_value("model", modelMat);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, model->texture);
-    shader->set_uniform_value("ourTexture", 0);
+// A batch of instances of one character as one instanced draw, state changes
+// go through the cache. Crossfading instances come in batches of one.
+void draw_character(gl_state_cache_t& cache, shader_program_t* shader, AnimatedModel* model, scene_batch_t batch, bool faceStream) {
+    shader->set_uniform_value("instanceBase", instanceBuffer->base(batch.first));
+    shader->set_uniform_value("impostorBlend", scene.impostorBlend[batch.first]);
 
     GLint boneMatricesLocation = glGetUniformLocation(shader->get_program_id(), "finalBonesMatrices");
     if (boneMatricesLocation != -1) {
@@ -423,11 +721,278 @@ void renderAnimatedCharacter(shader_program_t* shader, AnimatedModel* model, con
         }
     }
 
-    model->render();
+    cache.bind_texture(0, GL_TEXTURE_2D, model->texture);
+    if (faceStream) {
+        cache.bind_texture(SKINNED_BUFFER_TEXTURE_UNIT, GL_TEXTURE_BUFFER, model->skinnedTBO);
+        cache.bind_vertex_array(model->faceVAO);
+        cache.draw_arrays(GL_TRIANGLES, 0, (model->indices.size() / 3) * 3, batch.count);
+    } else {
+        cache.bind_vertex_array(usePostSkinBuffer() ? model->skinnedVAO : model->VAO);
+        cache.draw_elements(GL_TRIANGLES, model->indices.size(), batch.count);
+    }
+}
+
+// Skin every model drawn this frame once into its post-skin buffer, so extra
+// draws of the same mesh (GS variants, repeated instances) don't redo the blend.
+void skinning_pass(const frame_vector_t<AnimatedModel*>& models) {
+    if (skinningBackend == SKINNING_CPU) {
+        for (AnimatedModel* model : models) {
+            if (model->skinnedValid) continue;
+            cpuSkinner->skin(model);
+            model->skinnedValid = true;
+        }
+        return;
+    }
+
+    skinningShader->use();
+    GLint boneMatricesLocation = glGetUniformLocation(skinningShader->get_program_id(), "finalBonesMatrices");
+    glEnable(GL_RASTERIZER_DISCARD);
+
+    for (AnimatedModel* model : models) {
+        if (model->skinnedValid) continue;
+
+        const std::vector<glm::mat4>& transforms = model->m_FinalBoneMatrices;
+        if (!transforms.empty()) {
+            glUniformMatrix4fv(boneMatricesLocation, transforms.size(), GL_FALSE, &transforms[0][0][0]);
+        }
+
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, model->skinnedVBO);
+        glBindVertexArray(model->VAO);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, model->vertices.size());
+        glEndTransformFeedback();
+        model->skinnedValid = true;
+    }
+
+    glBindVertexArray(0);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glDisable(GL_RASTERIZER_DISCARD);
+    skinningShader->release();
+}
+
+// Resolve programs that finished compiling in the background. Without the
+// parallel compile extension this spends the per-frame blocking budget.
+void poll_shader_programs(){
+    if (shader_program_t::pending_count() == 0) return;
+    flairShaderExplosion->is_ready();
+    flairShaderPulse->is_ready();
+    dogShader->is_ready();
+    fadeShader->is_ready();
+    for (auto shader : shaderPrograms) {
+        shader->is_ready();
+    }
+}
+
+// Layers of the dog, two draws of one mesh in separate passes that differ only
+// in the layer uniform (metallic.gs / fx_metallic.vert)
+const int DOG_LAYER_SURFACE = 0;
+const int DOG_LAYER_AURA = 1;
+
+// Material ids of the render queue sort key
+enum material_id_t {
+    MATERIAL_CROWD,
+    MATERIAL_DOG_SURFACE,
+    MATERIAL_DOG_AURA,
+    MATERIAL_IMPOSTOR
+};
+
+// The shadow sampler always gets its own unit, even unused a sampler2DShadow
+// sharing unit 0 with ourTexture fails draw validation
+void set_shadow_uniforms(shader_program_t* program) {
+    if (shadowMap) {
+        shadowMap->set_uniforms(program);
+    } else {
+        program->set_uniform_value("shadowMap", SHADOW_MAP_TEXTURE_UNIT);
+        program->set_uniform_value("shadowsEnabled", 0);
+    }
+}
+
+bool dogUniformsSet = false; // cleared every frame by render()
+
+// Uniforms of one dog layer, run by the queue when the dog program or layer
+// becomes current. Everything but the layer is the same for both, so only the
+// first layer of the frame sets it.
+void bind_dog_uniforms(const glm::mat4& viewProjection, int layer) {
+    dogShader->set_uniform_value("layer", layer);
+    if (dogUniformsSet) return;
+    dogUniformsSet = true;
+
+    dogShader->set_uniform_value("magnitude", explosionLevel); 
+    dogShader->set_uniform_value("viewProjection", viewProjection);
+    dogShader->set_uniform_value("instanceData", INSTANCE_BUFFER_TEXTURE_UNIT);
+    dogShader->set_uniform_value("viewPos", camera.position);
+    dogShader->set_uniform_value("time", currentTime);
+
+    dogShader->set_uniform_value("material.diffuse", glm::vec3(0.012777f, 0.011200f, 0.800000f));
+    dogShader->set_uniform_value("material.ambient", glm::vec3(0.012777f, 0.011200f, 0.800000f) * 0.5f); 
+    dogShader->set_uniform_value("material.specular", glm::vec3(0.5f, 0.5f, 0.5f));
+    dogShader->set_uniform_value("material.gloss", 64.0f); 
+
+    dogShader->set_uniform_value("light.position", light.position);
+    dogShader->set_uniform_value("light.ambient", light.ambient);
+    dogShader->set_uniform_value("light.diffuse", light.diffuse);
+    dogShader->set_uniform_value("light.specular", light.specular);
+    dogShader->set_uniform_value("alpha", 0.4f); // Base alpha for metallic
+    dogShader->set_uniform_value("lightIntensity", 1.0f);
+    dogShader->set_uniform_value("bias", 0.2f); 
+    lightClusters->set_uniforms(dogShader, SCR_WIDTH, SCR_HEIGHT);
+    set_shadow_uniforms(dogShader);
+
+    dogShader->set_uniform_value("skybox", 1);
+    dogShader->set_uniform_value("ourTexture", 0);
+    dogShader->set_uniform_value("skinnedVertices", SKINNED_BUFFER_TEXTURE_UNIT);
+    dogShader->set_uniform_value("auraOIT", (int)enableOIT);
+}
+
+// One metallic instance, one draw: the layers can't share a draw across passes
+void draw_dog_layer(gl_state_cache_t& cache, int instance) {
+    AnimatedModel* model = scene.model(instance);
+    dogShader->set_uniform_value("instanceBase", instanceBuffer->base(instance));
+    cache.bind_texture(1, GL_TEXTURE_CUBE_MAP, cubemapTexture);
+    cache.bind_texture(0, GL_TEXTURE_2D, model->texture);
+    if (useFaceStreamEffects()) {
+        cache.bind_texture(SKINNED_BUFFER_TEXTURE_UNIT, GL_TEXTURE_BUFFER, model->skinnedTBO);
+        cache.bind_vertex_array(model->faceVAO);
+        cache.draw_arrays(GL_TRIANGLES, 0, (model->indices.size() / 3) * 3);
+    } else {
+        cache.bind_vertex_array(usePostSkinBuffer() ? model->skinnedVAO : model->VAO);
+        cache.draw_elements(GL_TRIANGLES, model->indices.size());
+    }
+}
+
+// Queue one layer of a metallic instance
+void submit_dog_layer(render_queue_t& queue, const glm::mat4& viewProjection, int instance, int layer) {
+    render_item_t item;
+    item.program = dogShader;
+    item.material = MATERIAL_DOG_SURFACE + layer;
+    item.texture = scene.model(instance)->texture;
+    item.depth = glm::length(scene.bounds[instance].center() - camera.position) / CAMERA_FAR;
+    item.state.cullFace = false; // See inside of explosion
+    if (layer == DOG_LAYER_SURFACE) {
+        item.pass = PASS_OPAQUE;
+        item.timer = "dog";
+    } else {
+        // blended over all opaque geometry, depth tested but not written so it
+        // doesn't hide the surface or itself. With OIT the order doesn't matter.
+        item.pass = PASS_TRANSPARENT;
+        item.backToFront = !enableOIT;
+        item.state.blend = true;
+        item.state.blendMode = enableOIT ? BLEND_OIT : BLEND_ALPHA;
+        item.state.depthWrite = false;
+        item.timer = "aura";
+    }
+    item.bind = [viewProjection, layer]() { bind_dog_uniforms(viewProjection, layer); };
+    item.draw = [instance](gl_state_cache_t& cache) { draw_dog_layer(cache, instance); };
+    queue.submit(std::move(item));
+}
+
+// The normal matrix and mvp are derived once per instance on the CPU instead
+// of once per vertex, for the instances some draw of the frame can use: the
+// ones in the frustum (phase 1 or 2) and the shadow casters. Whatever doesn't
+// fit in the buffer is dropped from both.
+void upload_instances(const glm::mat4& viewProjection, uint8_t* cast){
+    size_t count = scene.size();
+    frame_vector_t<uint8_t> selected(count);
+    for (size_t i = 0; i < count; i++) {
+        selected[i] = scene.visible[i] || cast[i];
+    }
+    instanceBuffer->upload(viewProjection, scene.transform, selected.data());
+    for (size_t i = 0; i < count; i++) {
+        scene.visible[i] = scene.visible[i] && selected[i];
+        cast[i] = cast[i] && selected[i];
+    }
+    instanceBuffer->bind();
+}
+
+glm::vec3 hue_color(float hue){
+    glm::vec3 c(std::fabs(hue * 6.0f - 3.0f) - 1.0f,
+                2.0f - std::fabs(hue * 6.0f - 2.0f),
+                2.0f - std::fabs(hue * 6.0f - 4.0f));
+    return glm::clamp(c, 0.0f, 1.0f);
+}
+
+// Concert lights for the finale: rings of point lights drifting around the
+// crowd and spot lights sweeping the stage from above, cycling through colors
+void update_scene_lights(float time, bool finale, std::vector<dynamic_light_t>& lights){
+    lights.clear();
+    if (!finale) return;
+
+    lights.resize(finaleLightCount);
+    for (int i = 0; i < finaleLightCount; i++) {
+        dynamic_light_t& l = lights[i];
+        float phase = i * 2.39996f; // golden angle spreads them evenly
+        float ring = 8.0f + 52.0f * (float)(i % 16) / 15.0f;
+        float angle = phase + time * (0.2f + 0.05f * (i % 7)) * ((i & 1) ? 1.0f : -1.0f);
+        l.color = hue_color(std::fmod(i * 0.137f + time * 0.1f, 1.0f)) * 2.0f;
+
+        if (i % 4 == 0) {
+            // spot hanging above the ring, aimed at a point sweeping the floor
+            l.position = glm::vec3(cos(angle) * ring, 25.0f, sin(angle) * ring);
+            glm::vec3 target(cos(angle + sin(time + phase)) * ring * 0.5f, -1.0f,
+                             sin(angle + sin(time + phase)) * ring * 0.5f);
+            l.direction = glm::normalize(target - l.position);
+            l.radius = 60.0f;
+            l.cosOuter = std::cos(glm::radians(18.0f));
+            l.cosInner = std::cos(glm::radians(12.0f));
+            l.color *= 2.0f;
+        } else {
+            l.position = glm::vec3(cos(angle) * ring, 1.0f + 4.0f * (0.5f + 0.5f * sin(time * 1.3f + phase)),
+                                   sin(angle) * ring);
+            l.radius = 12.0f;
+        }
+    }
+}
+
+// Test the instances this frame wants to draw against the view frustum, using
+// each model's posed bounds. Effects push vertices off the skinned surface
+// (along face normals, in world units), so the boxes are padded by that much.
+void cull_instances(const glm::mat4& viewProjection){
+    // fx_metallic.vert: aura goes 1.5x the explosion plus up to 1.5 units
+    float metallicPadding = explosionLevel * 20.0f * 1.5f + 1.5f;
+    float crowdPadding = 0.0f;
+    float crowdRelative = 0.0f;
+    if (isFinaleMode && enableCrowdExplosion) {
+        crowdPadding = 0.35f * 20.0f;
+    } else if (isFinaleMode && enableCrowdPulse) {
+        // fx_pulse.vert scales each face by up to 15% around its center
+        crowdRelative = 0.15f;
+    }
+    cullStats.culled += scene.cull(viewProjection, enableFrustumCulling, metallicPadding, crowdPadding, crowdRelative);
+    cullStats.frames++;
+}
+
+// Bake every crowd character into an impostor atlas, shaded with the same
+// sun and material as the mesh
+void impostor_setup(){
+    if (!enableImpostors) return;
+#if defined(__linux__) || defined(__APPLE__)
+    std::string shaderDir = "../../src/shaders/";
+#else
+    std::string shaderDir = "../../src/shaders/";
+#endif
+    impostorRenderer = new impostor_renderer_t(shaderDir);
+    auto uniforms = [](shader_program_t* program) {
+        program->set_uniform_value("material.diffuse", material.diffuse);
+        program->set_uniform_value("material.ambient", material.ambient);
+        program->set_uniform_value("material.specular", material.specular);
+        program->set_uniform_value("material.gloss", material.gloss);
+        program->set_uniform_value("light.position", light.position);
+        program->set_uniform_value("light.ambient", light.ambient);
+        program->set_uniform_value("light.diffuse", light.diffuse);
+        program->set_uniform_value("light.specular", light.specular);
+    };
+    std::vector<uint8_t> crowd(scene.assets.size(), 0);
+    for (size_t i = 0; i < scene.size(); i++) {
+        crowd[scene.assetIndex[i]] |= !(scene.flags[i] & SCENE_METALLIC);
+    }
+    for (size_t a = 0; a < scene.assets.size(); a++) {
+        if (crowd[a]) impostorRenderer->bake(scene.assets[a].model, uniforms);
+    }
 }
 
 void setup(){
     // initialize shader model camera light material
+    skinning_backend_setup();
     light_setup();
     model_setup();
     shader_setup();
@@ -435,6 +1000,8 @@ void setup(){
     cubemap_setup();
     fade_setup(); // [NEW]
     material_setup();
+    instanceBuffer = new instance_buffer_t();
+    impostor_setup();
 
     // enable depth test, face culling
     glEnable(GL_DEPTH_TEST);
@@ -455,134 +1022,274 @@ void setup(){
     // }, nullptr);
 }
 
-void update(){
-    // Update timing
-    currentTime = glfwGetTime();
-    deltaTime = currentTime - lastFrame;
-    lastFrame = currentTime;
-    
-    // Update animation
-    animatedModel->updateAnimation(currentTime);
-    bananaModel->updateAnimation(currentTime);
-    allosaurusModel->updateAnimation(currentTime);
-    gromitModel->updateAnimation(currentTime);
+// One fixed step of the simulation: input, camera and effect timers
+void sim_step(sim_state_t& s, const input_frame_t& input, float dt){
+    PROFILE_ZONE("sim_step");
+    s.time += dt;
+
+    for (int key : input.presses) {
+        // shader program selection, keys past the last program pick the last one
+        if (key >= GLFW_KEY_0 && key <= GLFW_KEY_8) {
+            s.shaderProgramIndex = std::min(key - GLFW_KEY_0, 5);
+        }
+        // k key for explosion (switch model) toggle
+        if (key == GLFW_KEY_K) {
+            s.isExploded = !s.isExploded;
+        } else if (key == GLFW_KEY_1) {
+            s.enableCrowdExplosion = !s.enableCrowdExplosion;
+            if (s.enableCrowdExplosion) s.enableCrowdPulse = false;
+        } else if (key == GLFW_KEY_2) {
+            s.enableCrowdPulse = !s.enableCrowdPulse;
+            if (s.enableCrowdPulse) s.enableCrowdExplosion = false;
+        }
+    }
+    if (input.orbit.x != 0.0f || input.orbit.y != 0.0f || input.zoom != 0.0f) {
+        float yawDelta = input.orbit.x * s.camera.orbitRotateSpeed * dt;
+        float pitchDelta = input.orbit.y * s.camera.orbitRotateSpeed * dt;
+        float radiusDelta = input.zoom * s.camera.orbitZoomSpeed * dt;
+        applyOrbitDelta(s.camera, yawDelta, pitchDelta, radiusDelta);
+    }
 
     // Auto-orbit camera around target
-    if (camera.enableAutoOrbit) {
-        // float yawDelta = camera.autoOrbitSpeed * deltaTime;
-        float yawDelta = camera.autoOrbitSpeed * 0;
-        applyOrbitDelta(yawDelta, 0.0f, 0.0f);
+    if (s.camera.enableAutoOrbit) {
+        // float yawDelta = camera.autoOrbitSpeed * dt;
+        float yawDelta = s.camera.autoOrbitSpeed * 0;
+        applyOrbitDelta(s.camera, yawDelta, 0.0f, 0.0f);
     }
 
     // [NEW] Logic: Camera Proximity Event
     // If not already in finale mode and not fading out, check distance.
-    if (!isFinaleMode && !isFadingOut && !isFadingIn) {
-        if (camera.radius < 100.0f) {
-            isFadingOut = true; // Trigger Event
+    if (!s.isFinaleMode && !s.isFadingOut && !s.isFadingIn) {
+        if (s.camera.radius < 100.0f) {
+            s.isFadingOut = true; // Trigger Event
         }
     }
 
     // [NEW] Fade Animation Logic
-    if (isFadingOut) {
-        fadeAlpha += FADE_SPEED * deltaTime;
-        if (fadeAlpha >= 1.0f) {
-            fadeAlpha = 1.0f;
-            isFinaleMode = true; // SWITCH SCENE
-            isFadingOut = false;
-            isFadingIn = true;   // Start Fading In
+    if (s.isFadingOut) {
+        s.fadeAlpha += FADE_SPEED * dt;
+        if (s.fadeAlpha >= 1.0f) {
+            s.fadeAlpha = 1.0f;
+            s.isFinaleMode = true; // SWITCH SCENE
+            s.isFadingOut = false;
+            s.isFadingIn = true;   // Start Fading In
         }
-    } else if (isFadingIn) {
-        fadeAlpha -= FADE_SPEED * deltaTime;
-        if (fadeAlpha <= 0.0f) {
-            fadeAlpha = 0.0f;
-            isFadingIn = false;
+    } else if (s.isFadingIn) {
+        s.fadeAlpha -= FADE_SPEED * dt;
+        if (s.fadeAlpha <= 0.0f) {
+            s.fadeAlpha = 0.0f;
+            s.isFadingIn = false;
         }
     }
+
+    // Explosion Animation
+    if (s.isExploded) {
+        s.explosionLevel += dt * EXPLOSION_SPEED;
+        if (s.explosionLevel > MAX_EXPLOSION) s.explosionLevel = MAX_EXPLOSION;
+    } else {
+        s.explosionLevel -= dt * EXPLOSION_SPEED;
+        if (s.explosionLevel < 0.0f) s.explosionLevel = 0.0f;
+    }
+    s.frame++;
 }
 
-void render(){
-    glClearColor(0.0, 0.0, 0.0, 1.0);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+// What the renderer needs of the current state: poses, lights
+void capture_view(const sim_state_t& s, sim_view_t& view){
+    PROFILE_ZONE("capture_view");
+    scene.animate(s.time, view.palettes, view.poseBounds);
+    update_scene_lights(s.time, s.isFinaleMode, view.lights);
+    view.camera = s.camera;
+    view.time = s.time;
+    view.explosionLevel = s.explosionLevel;
+    view.fadeAlpha = s.fadeAlpha;
+    view.isFinaleMode = s.isFinaleMode;
+    view.isExploded = s.isExploded;
+    view.enableCrowdExplosion = s.enableCrowdExplosion;
+    view.enableCrowdPulse = s.enableCrowdPulse;
+    view.shaderProgramIndex = s.shaderProgramIndex;
+}
 
-    // calculate view, projection matrix using new camera system
-    glm::mat4 view = glm::lookAt(camera.position + glm::vec3(0.0f, -0.2f, -0.1f), camera.position + camera.front, camera.up);
-    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 1000.0f);
+// Runs the fixed steps that are due and publishes the last two states. Runs on
+// the simulation thread (inline with --no-sim-thread) and reads nothing the
+// render thread writes. Input waits until a step is due.
+void simulate(){
+    int steps = simClock.advance(app_time());
+    if (steps == 0) return;
+    PROFILE_ZONE("simulate");
 
+    sim_state_t& s = simState;
+    input_frame_t input;
+    {
+        std::lock_guard<std::mutex> lock(inputMutex);
+        input = pendingInput;
+        pendingInput.presses.clear();
+        pendingInput.sampled = 0.0;
+    }
+    float dt = (float)simClock.step_seconds();
+    for (int k = 0; k < steps; k++) {
+        // presses apply once, held keys to every step; the log sees exactly that
+        input_frame_t stepInput = input;
+        if (k > 0) stepInput.presses.clear();
+        if (!replayPath.empty()) {
+            inputLog.replay(s.frame, stepInput.orbit, stepInput.zoom, stepInput.presses);
+        } else if (!recordPath.empty()) {
+            inputLog.record(s.frame, stepInput.orbit, stepInput.zoom, stepInput.presses);
+        }
+        sim_step(s, stepInput, dt);
+        // only the last two states are ever drawn
+        if (steps - k <= 2) {
+            s.current ^= 1;
+            capture_view(s, s.views[s.current]);
+        }
+    }
 
-    
-    // --- RENDER LOGIC START ---
-    
-    // 0. Render Skybox FIRST (Background)
-    glDepthMask(GL_FALSE);
-    glDisable(GL_DEPTH_TEST); // Ensure skybox passes depth test (since it's background)
-    glDisable(GL_CULL_FACE);  // Ensure inside faces are visible
+    frame_snapshot_t& out = snapshots.write_slot();
+    out.frame = s.frame;
+    out.inputSampled = input.sampled;
+    out.clock = simClock;
+    out.previous = s.views[s.current ^ 1];
+    out.current = s.views[s.current];
+    snapshots.publish();
+}
 
-    cubemapShader->use();
-    // Remove translation from view matrix for skybox ensuring it stays centered
-    glm::mat4 skyboxView = glm::mat4(glm::mat3(view)); 
-    cubemapShader->set_uniform_value("view", skyboxView); 
-    cubemapShader->set_uniform_value("projection", projection);
-    cubemapShader->set_uniform_value("skybox", 0);
-    glActiveTexture(GL_TEXTURE0);
-    // [NEW] Switch Skybox Texture based on Mode
-    if (isFinaleMode) {
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTextureRyder);
-    } else {
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+// Render side view of a snapshot, alpha of the way from its previous to its
+// current state: the globals and poses the draw code reads
+void apply_snapshot(const frame_snapshot_t& frame, float alpha){
+    PROFILE_ZONE("apply_snapshot");
+    const sim_view_t& a = frame.previous;
+    const sim_view_t& b = frame.current;
+    camera = b.camera;
+    camera.yaw = glm::mix(a.camera.yaw, b.camera.yaw, alpha);
+    camera.pitch = glm::mix(a.camera.pitch, b.camera.pitch, alpha);
+    camera.radius = glm::mix(a.camera.radius, b.camera.radius, alpha);
+    updateCamera(camera);
+    currentTime = glm::mix(a.time, b.time, alpha);
+    explosionLevel = glm::mix(a.explosionLevel, b.explosionLevel, alpha);
+    fadeAlpha = glm::mix(a.fadeAlpha, b.fadeAlpha, alpha);
+    isFinaleMode = b.isFinaleMode;
+    isExploded = b.isExploded;
+    enableCrowdExplosion = b.enableCrowdExplosion;
+    enableCrowdPulse = b.enableCrowdPulse;
+    shaderProgramIndex = b.shaderProgramIndex;
+
+    // instances move by time alone, their assets carry the poses
+    scene.update_transforms(currentTime);
+    for (size_t i = 0; i < b.palettes.size(); i++) {
+        AnimatedModel* model = scene.assets[i].model;
+        if (b.palettes[i].empty()) continue;
+        if (a.palettes.size() != b.palettes.size() || a.palettes[i].size() != b.palettes[i].size()) {
+            model->applyPose(b.palettes[i], b.poseBounds[i]);
+            continue;
+        }
+        // matrix blend of two close poses; the box covers both
+        std::vector<glm::mat4>& palette = blendedPalettes[i];
+        palette.resize(b.palettes[i].size());
+        for (size_t k = 0; k < palette.size(); k++) {
+            palette[k] = a.palettes[i][k] * (1.0f - alpha) + b.palettes[i][k] * alpha;
+        }
+        aabb_t bounds = a.poseBounds[i];
+        bounds.expand(b.poseBounds[i]);
+        model->applyPose(palette, bounds);
     }
-    glBindVertexArray(cubemapVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
-    cubemapShader->release();
-    
-    glDepthMask(GL_TRUE); 
-    glEnable(GL_DEPTH_TEST); // Restore for rest of scene
 
-    // Visibility Logic
-    // User Request: 
-    // 1. "isExplode=True -> Immediately spawn Flair" -> Draw Flair if isExploded.
-    // 2. "False -> Disappear later" -> Draw Flair while explosionLevel > 0.
-    // 3. "Explosion前后都能看到Flair" -> Overlap allowed.
-    
-    // 3. "Explosion前后都能看到Flair" -> Overlap allowed.
-    
-    // [MODIFIED] Finale Mode: Only Flair is visible (and Skybox)
-    bool drawFlair = isFinaleMode || (isExploded || (explosionLevel > 0.0f));
-    
-    // [MODIFIED] Hide Dog in Finale Mode
-    bool drawDog = !isFinaleMode && (explosionLevel < MAX_EXPLOSION);
+    sceneLights = b.lights;
+    if (a.lights.size() == b.lights.size()) {
+        for (size_t l = 0; l < sceneLights.size(); l++) {
+            sceneLights[l].position = glm::mix(a.lights[l].position, b.lights[l].position, alpha);
+            glm::vec3 direction = glm::mix(a.lights[l].direction, b.lights[l].direction, alpha);
+            if (glm::length(direction) > 1e-4f) sceneLights[l].direction = glm::normalize(direction);
+        }
+    }
+}
 
-    // 1. Update Explosion Animation
-    if (isExploded) {
-        explosionLevel += deltaTime * EXPLOSION_SPEED;
-        if (explosionLevel > MAX_EXPLOSION) explosionLevel = MAX_EXPLOSION;
-    } else {
-        explosionLevel -= deltaTime * EXPLOSION_SPEED;
-        if (explosionLevel < 0.0f) explosionLevel = 0.0f;
+// Screen size decides how much of each crowd member is drawn by its impostor.
+// Quality metric: atlas texels per screen pixel across the bounding sphere;
+// below impostorTexelRatio the impostor would be magnified and blurry.
+void update_impostor_blends(){
+    float pixelsPerUnit = SCR_HEIGHT * 0.5f / std::tan(CAMERA_FOV * 0.5f); // at distance 1
+    bool ready = impostorRenderer && impostorRenderer->program()->is_ready();
+    // explosion/pulse move faces the atlas doesn't have
+    bool effects = isFinaleMode && (enableCrowdExplosion || enableCrowdPulse);
+    for (size_t i = 0; i < scene.size(); i++) {
+        float& blend = scene.impostorBlend[i];
+        blend = 0.0f;
+        if (!ready || effects || !scene.visible[i] || (scene.flags[i] & SCENE_METALLIC)) continue;
+        const impostor_atlas_t* atlas = impostorRenderer->find(scene.model(i));
+        if (!atlas) continue;
+
+        const glm::mat4& model = scene.transform[i];
+        glm::vec3 center = glm::vec3(model * glm::vec4(atlas->center, 1.0f));
+        float radius = atlas->radius * glm::length(glm::vec3(model[0]));
+        float distance = std::max(glm::length(center - camera.position), 1e-3f);
+        float radiusPixels = radius / distance * pixelsPerUnit;
+        float texelRatio = (IMPOSTOR_CELL * 0.5f) / std::max(radiusPixels, 1e-3f);
+
+        float t = (texelRatio - impostorTexelRatio) / (impostorTexelRatio * (IMPOSTOR_FADE_RANGE - 1.0f));
+        t = glm::clamp(t, 0.0f, 1.0f);
+        blend = t * t * (3.0f - 2.0f * t);
+        cullStats.impostors += blend >= 1.0f;
+        cullStats.crossfading += blend > 0.0f && blend < 1.0f;
     }
+}
 
-    // 2. Render Opaque Objects First (Flair + Finale Dancers)
-    if (drawFlair) {
-        shader_program_t* crowdShader = flairShader;
-        float crowdMagnitude = 0.0f;
-        if (isFinaleMode && enableCrowdGSPulse) {
-            crowdShader = flairShaderGSPulse;
-        } else if (isFinaleMode && enableCrowdGS) {
-            crowdShader = flairShaderGS;
-            crowdMagnitude = 0.25f + 0.1f * sin(currentTime * 3.0f);
-        }
+void submit_impostor(render_queue_t& queue, const glm::mat4& viewProjection, int instance, const char* timerName){
+    const impostor_atlas_t* atlas = impostorRenderer->find(scene.model(instance));
+    shader_program_t* program = impostorRenderer->program();
+
+    render_item_t item;
+    item.pass = PASS_OPAQUE;
+    item.program = program;
+    item.material = MATERIAL_IMPOSTOR;
+    item.texture = atlas->texture;
+    item.depth = glm::length(scene.bounds[instance].center() - camera.position) / CAMERA_FAR;
+    item.state.cullFace = false;
+    item.timer = timerName;
+    item.bind = [program, viewProjection]() {
+        program->set_uniform_value("viewProjection", viewProjection);
+        program->set_uniform_value("viewPos", camera.position);
+        program->set_uniform_value("atlas", 0);
+    };
+    item.draw = [atlas, instance](gl_state_cache_t& cache) {
+        cache.bind_texture(0, GL_TEXTURE_2D_ARRAY, atlas->texture);
+        impostorRenderer->set_instance_uniforms(*atlas, scene.transform[instance],
+                                                scene.asset_time(scene.assetIndex[instance], currentTime),
+                                                scene.impostorBlend[instance]);
+        cache.bind_vertex_array(impostorRenderer->quad_vao());
+        cache.draw_arrays(GL_TRIANGLE_STRIP, 0, 4);
+    };
+    queue.submit(std::move(item));
+}
 
-        crowdShader->use();
+// Queue the crowd instances flagged in draw: one instanced draw per run of an
+// asset's meshes, one impostor draw per instance far enough away. The meshes
+// and the impostors are timed apart, a GPU timer can't be begun twice a frame.
+void submit_crowd(render_queue_t& queue, const glm::mat4& viewProjection, const uint8_t* draw, const char* timerName,
+                  const char* impostorTimerName, const char* measureTimerName){
+    shader_program_t* crowdShader = flairShader;
+    float crowdMagnitude = 0.0f;
+    if (isFinaleMode && enableCrowdPulse) {
+        crowdShader = flairShaderPulse;
+    } else if (isFinaleMode && enableCrowdExplosion) {
+        crowdShader = flairShaderExplosion;
+        crowdMagnitude = 0.25f + 0.1f * sin(currentTime * 3.0f);
+    }
+    // Variant still compiling: draw the plain toon program meanwhile
+    if (!crowdShader->is_ready()) {
+        crowdShader = flairShader;
+        crowdMagnitude = 0.0f;
+    }
+    // Effect variants draw the de-indexed face stream instead of the indexed mesh
+    bool crowdFaceStream = crowdShader != flairShader && useFaceStreamEffects();
 
-        crowdShader->set_uniform_value("view", view);
-        crowdShader->set_uniform_value("projection", projection);
+    // one arena copy of the capture, shared by every crowd item
+    frame_function_t<void()> bind = [crowdShader, crowdMagnitude, viewProjection]() {
+        crowdShader->set_uniform_value("viewProjection", viewProjection);
+        crowdShader->set_uniform_value("instanceData", INSTANCE_BUFFER_TEXTURE_UNIT);
         crowdShader->set_uniform_value("viewPos", camera.position);
         crowdShader->set_uniform_value("magnitude", crowdMagnitude);
         crowdShader->set_uniform_value("time", currentTime);
-
-        glEnable(GL_CULL_FACE);
-        glDisable(GL_BLEND); // Solid
-        glDepthMask(GL_TRUE); // Write Depth
+        crowdShader->set_uniform_value("ourTexture", 0);
+        crowdShader->set_uniform_value("skinnedVertices", SKINNED_BUFFER_TEXTURE_UNIT);
 
         crowdShader->set_uniform_value("material.diffuse", material.diffuse);
         crowdShader->set_uniform_value("material.ambient", material.ambient);
@@ -594,179 +1301,766 @@ void render(){
         crowdShader->set_uniform_value("light.diffuse", light.diffuse);
         crowdShader->set_uniform_value("light.specular", light.specular);
         crowdShader->set_uniform_value("lightIntensity", 1.0f); 
+        lightClusters->set_uniforms(crowdShader, SCR_WIDTH, SCR_HEIGHT);
+        set_shadow_uniforms(crowdShader);
+    };
 
-        modelMatrix = glm::mat4(1.0f);
-        modelMatrix = glm::scale(modelMatrix, glm::vec3(0.5f));
-        renderAnimatedCharacter(crowdShader, animatedModel, modelMatrix);
+    frame_vector_t<scene_batch_t> batches;
+    batches.reserve(scene.size());
+    scene.build_batches(draw, true, batches);
+    for (const scene_batch_t& batch : batches) {
+        AnimatedModel* model = scene.assets[batch.asset].model;
+        float blend = scene.impostorBlend[batch.first];
+        if (blend > 0.0f) {
+            submit_impostor(queue, viewProjection, batch.first, impostorTimerName);
+        }
+        if (blend >= 1.0f) continue;
+
+        render_item_t item;
+        item.pass = PASS_OPAQUE;
+        item.program = crowdShader;
+        item.material = MATERIAL_CROWD;
+        item.texture = model->texture;
+        item.depth = glm::length(scene.bounds[batch.first].center() - camera.position) / CAMERA_FAR;
+        item.timer = timerName;
+        item.bind = bind;
+        item.draw = [crowdShader, model, batch, crowdFaceStream](gl_state_cache_t& cache) {
+            draw_character(cache, crowdShader, model, batch, crowdFaceStream);
+        };
+
+        // Same draw with nothing rasterized: the time left is the vertex stage
+        if (measureVertexStage) {
+            render_item_t measure = item;
+            measure.pass = PASS_MEASURE;
+            measure.state.rasterizerDiscard = true;
+            measure.timer = measureTimerName;
+            queue.submit(std::move(measure));
+        }
+        queue.submit(std::move(item));
+    }
+}
 
-        if (isFinaleMode) {
-            float bananaAngle = currentTime * 2.5f;
-            float dinoAngle = bananaAngle + 3.1415926f;
-            glm::vec3 orbitCenter(0.0f, -0.6f, 0.0f);
+// Sun shadow casters: every wanted instance inside the light's box
+void select_shadow_casters(uint8_t* cast){
+    shadowMap->set_light(-light.position, glm::vec3(0.0f), SHADOW_RADIUS);
+    size_t count = scene.size();
+    frustum_cull(extract_frustum(shadowMap->light_view_projection()), scene.bounds.data(), count, cast);
+    for (size_t i = 0; i < count; i++) {
+        // exploding faces are moved in fx_metallic.vert, which the depth shaders don't do
+        bool exploding = (scene.flags[i] & SCENE_METALLIC) && explosionLevel > 0.0f;
+        cast[i] = cast[i] && scene.wanted[i] && !exploding;
+    }
+}
 
-            // Banana: position/scale (finale crowd)
-            glm::vec3 bananaPos(
-                orbitCenter.x + cos(bananaAngle) * 50.0f,
-                -0.8f,
-                orbitCenter.z + sin(bananaAngle) * 50.0f
-            );
-            modelMatrix = glm::mat4(1.0f);
-            modelMatrix = glm::translate(modelMatrix, bananaPos);
-            modelMatrix = glm::scale(modelMatrix, glm::vec3(0.5f));
-            renderAnimatedCharacter(crowdShader, bananaModel, modelMatrix);
-
-            // Allosaurus: position/scale (finale crowd)
-            glm::vec3 dinoPos(
-                orbitCenter.x + cos(dinoAngle) * 36.0f,
-                -1.2f,
-                orbitCenter.z + sin(dinoAngle) * 36.0f
-            );
-            modelMatrix = glm::mat4(1.0f);
-            modelMatrix = glm::translate(modelMatrix, dinoPos);
-            modelMatrix = glm::scale(modelMatrix, glm::vec3(0.15f));
-            renderAnimatedCharacter(crowdShader, allosaurusModel, modelMatrix);
-
-            // Gromit: position/scale (finale crowd)
-            modelMatrix = glm::mat4(1.0f);
-            modelMatrix = glm::translate(modelMatrix, glm::vec3(10.0f, -0.8f, -57.0f));
-            modelMatrix = glm::scale(modelMatrix, glm::vec3(0.8f));
-            renderAnimatedCharacter(crowdShader, gromitModel, modelMatrix);
-        }
-
-        crowdShader->release();
-    }
-
-    // 3. Render Transparent/Blended Objects Second (Dog with Aura)
-    if (drawDog) {
-        // --- RENDER DOG (Metallic + Explosion GS + Aura) ---
-        dogShader->use();
-        dogShader->set_uniform_value("magnitude", explosionLevel); 
-        dogShader->set_uniform_value("view", view);
-        dogShader->set_uniform_value("projection", projection);
-        dogShader->set_uniform_value("viewPos", camera.position);
-        dogShader->set_uniform_value("time", currentTime);
-        
-        modelMatrix = glm::mat4(1.0f);
-        modelMatrix = glm::scale(modelMatrix, glm::vec3(600.0f)); 
-        modelMatrix = glm::translate(modelMatrix, glm::vec3(0.0f, -0.2f, 0.0f)); 
-        dogShader->set_uniform_value("model", modelMatrix);
-
-        // Alpha Blending for Aura!
-        glDisable(GL_CULL_FACE); // See inside of explosion
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); // Standard transparency
-        glDepthMask(GL_TRUE); // Write Depth (Required for Solid Inner Layer)
-        // Note: Transparent Aura will also write depth, but it's acceptable here.
-
-        dogShader->set_uniform_value("material.diffuse", glm::vec3(0.012777f, 0.011200f, 0.800000f));
-        dogShader->set_uniform_value("material.ambient", glm::vec3(0.012777f, 0.011200f, 0.800000f) * 0.5f); 
-        dogShader->set_uniform_value("material.specular", glm::vec3(0.5f, 0.5f, 0.5f));
-        dogShader->set_uniform_value("material.gloss", 64.0f); 
-
-        dogShader->set_uniform_value("light.position", light.position);
-        dogShader->set_uniform_value("light.ambient", light.ambient);
-        dogShader->set_uniform_value("light.diffuse", light.diffuse);
-        dogShader->set_uniform_value("light.specular", light.specular);
-        dogShader->set_uniform_value("alpha", 0.4f); // Base alpha for metallic
-        dogShader->set_uniform_value("lightIntensity", 1.0f);
-        dogShader->set_uniform_value("bias", 0.2f); 
-
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        dogShader->set_uniform_value("skybox", 1);
-        
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, dogModel->texture);
-        dogShader->set_uniform_value("ourTexture", 0);
+// One caster per run of an asset's casters. Assets skinned this frame draw
+// their post-skin vertices, the rest (off camera, occluded, --skinning=vs)
+// go through the depth-only skinning shader.
+void render_shadows(const uint8_t* cast, const uint8_t* skinnedAssets){
+    PROFILE_ZONE("shadows");
+    size_t count = scene.size();
+    frame_vector_t<scene_batch_t> batches;
+    batches.reserve(count);
+    scene.build_batches(cast, false, batches);
+
+    frame_vector_t<shadow_caster_t> casters;
+    casters.reserve(batches.size());
+    for (const scene_batch_t& batch : batches) {
+        AnimatedModel* model = scene.assets[batch.asset].model;
+        const std::vector<glm::mat4>& bones = model->m_FinalBoneMatrices;
+
+        // the first instance names the run, which only changes when the set does
+        shadow_caster_t caster;
+        caster.id = batch.first;
+        caster.preskinned = usePostSkinBuffer() && skinnedAssets[batch.asset];
+        caster.version = shadow_version(&scene.transform[batch.first], batch.count * sizeof(glm::mat4));
+        caster.version = shadow_version(&batch.count, sizeof(batch.count), caster.version);
+        if (!bones.empty()) {
+            caster.version = shadow_version(bones.data(), bones.size() * sizeof(glm::mat4), caster.version);
+        }
+        bool preskinned = caster.preskinned;
+        caster.draw = [model, batch, preskinned](shader_program_t* program) {
+            program->set_uniform_value("instanceBase", instanceBuffer->base(batch.first));
+            if (!preskinned && !model->m_FinalBoneMatrices.empty()) {
+                GLint location = glGetUniformLocation(program->get_program_id(), "finalBonesMatrices");
+                glUniformMatrix4fv(location, model->m_FinalBoneMatrices.size(), GL_FALSE,
+                                   &model->m_FinalBoneMatrices[0][0][0]);
+            }
+            glBindVertexArray(preskinned ? model->skinnedVAO : model->VAO);
+            glDrawElementsInstanced(GL_TRIANGLES, model->indices.size(), GL_UNSIGNED_INT, 0, batch.count);
+        };
+        casters.push_back(std::move(caster));
+    }
 
-        dogModel->render();
-        dogShader->release();
-        
-        // Restore Depth Mask
-        glDepthMask(GL_TRUE);
-        // Restore Depth Mask
-        glDepthMask(GL_TRUE);
+    gpuTimer->begin("shadow");
+    shadowMap->render(casters.data(), casters.size(), sceneFBO);
+    gpuTimer->end();
+    glBindVertexArray(0);
+    shadowMap->bind();
+}
+
+// Skins each asset with an instance in draw once; skinnedAssets collects them
+void skin_instances(const uint8_t* draw, uint8_t* skinnedAssets, const char* timerName){
+    if (!usePostSkinBuffer()) return;
+    frame_vector_t<AnimatedModel*> skinned;
+    skinned.reserve(scene.assets.size());
+    for (size_t i = 0; i < scene.size(); i++) {
+        uint16_t asset = scene.assetIndex[i];
+        if (!draw[i] || skinnedAssets[asset]) continue;
+        skinnedAssets[asset] = 1;
+        skinned.push_back(scene.assets[asset].model);
     }
+    if (skinned.empty()) return;
 
-    // [NEW] 4. Render Fade Overlay
-    if (fadeAlpha > 0.0f) {
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glDisable(GL_DEPTH_TEST); // Draw over everything
-        
-        fadeShader->use();
-        fadeShader->set_uniform_value("alpha", fadeAlpha);
-        
-        glBindVertexArray(fadeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        glBindVertexArray(0);
-        
-        fadeShader->release();
-        
-        glEnable(GL_DEPTH_TEST);
-        glDisable(GL_BLEND);
+    PROFILE_ZONE("skinning");
+    gpuTimer->begin(timerName);
+    skinning_pass(skinned);
+    gpuTimer->end();
+}
+
+// One skybox pass for both scenes, only the cubemap differs.
+// cubemap.vert writes z = w, so the skybox sits exactly on the far plane and
+// GL_LEQUAL against the cleared depth passes only where nothing was drawn.
+void submit_skybox(render_queue_t& queue, const glm::mat4& view, const glm::mat4& projection){
+    render_item_t item;
+    item.program = cubemapShader;
+    item.state.cullFace = false; // inside faces
+    item.state.depthWrite = false;
+    item.timer = "skybox";
+    if (skyboxFirst) {
+        // old order: shade the whole screen, characters overdraw it
+        item.pass = PASS_BACKGROUND;
+        item.state.depthTest = false;
+    } else {
+        item.pass = PASS_SKY;
+        item.state.depthTest = true;
     }
+    // Remove translation from view matrix for skybox ensuring it stays centered
+    glm::mat4 skyboxView = glm::mat4(glm::mat3(view)); 
+    item.bind = [skyboxView, projection]() {
+        cubemapShader->set_uniform_value("view", skyboxView); 
+        cubemapShader->set_uniform_value("projection", projection);
+        cubemapShader->set_uniform_value("skybox", 0);
+    };
+    item.draw = [](gl_state_cache_t& cache) {
+        // [NEW] Switch Skybox Texture based on Mode
+        cache.bind_texture(0, GL_TEXTURE_CUBE_MAP, isFinaleMode ? cubemapTextureRyder : cubemapTexture);
+        cache.bind_vertex_array(cubemapVAO);
+        cache.draw_arrays(GL_TRIANGLES, 0, 36);
+    };
+    queue.submit(std::move(item));
 }
 
-int main() {
-    // glfw: initialize and configure
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+void render(){
+    PROFILE_ZONE("render");
+    render_target_t* sceneTarget = nullptr;
+    if (postChain) {
+        sceneTarget = renderTargetPool->acquire(SCR_WIDTH, SCR_HEIGHT, GL_RGBA16F, true);
+        sceneFBO = sceneTarget->fbo;
+    } else {
+        sceneFBO = outputFBO;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
 
-#ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
+    // glClear honours the depth mask, which the last blended item left off
+    glStateCache.invalidate();
+    glStateCache.depth_mask(true);
+    glClearColor(0.0, 0.0, 0.0, 1.0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // glfw window creation
-    GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "HW3-Animated Model", NULL, NULL);
-    if (window == NULL) {
-        std::cerr << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+    // calculate view, projection matrix using new camera system
+    glm::mat4 view = glm::lookAt(camera.position + glm::vec3(0.0f, -0.2f, -0.1f), camera.position + camera.front, camera.up);
+    glm::mat4 projection = glm::perspective(CAMERA_FOV, (float)SCR_WIDTH / (float)SCR_HEIGHT, CAMERA_NEAR, CAMERA_FAR);
+    glm::mat4 viewProjection = projection * view;
+
+    
+    // --- RENDER LOGIC START ---
+    
+    if (skyboxFirst) {
+        submit_skybox(renderQueue, view, projection);
+    }
+
+    // Visibility Logic
+    // User Request: 
+    // 1. "isExplode=True -> Immediately spawn Flair" -> Draw Flair if isExploded.
+    // 2. "False -> Disappear later" -> Draw Flair while explosionLevel > 0.
+    // 3. "Explosion前后都能看到Flair" -> Overlap allowed.
+    
+    // Each instance is tagged in the scene file with the phases it shows in:
+    // Flair from the moment the dog explodes (SCENE_EXPLOSION), the dog until
+    // the finale or a full explosion (SCENE_INTRO), the dancers in the finale
+    uint8_t phases = 0;
+    if (isFinaleMode) {
+        phases = SCENE_FINALE;
+    } else {
+        if (isExploded || explosionLevel > 0.0f) phases |= SCENE_EXPLOSION;
+        if (explosionLevel < MAX_EXPLOSION) phases |= SCENE_INTRO;
+    }
+
+    // Cull before anything is uploaded for the instances
+    frame_vector_t<uint8_t> cast(scene.size(), 0);
+    {
+        PROFILE_ZONE("cull+upload");
+        scene.select(phases);
+        cull_instances(viewProjection);
+        if (shadowMap) select_shadow_casters(cast.data());
+        upload_instances(viewProjection, cast.data());
+        dogUniformsSet = false;
+    }
+
+    // Bin this frame's dynamic lights into the camera's clusters
+    {
+        PROFILE_ZONE("light binning");
+        double binningStart = app_time();
+        lightClusters->update(sceneLights, view, CAMERA_FOV, (float)SCR_WIDTH / (float)SCR_HEIGHT, CAMERA_NEAR, CAMERA_FAR);
+        lightClusters->bind();
+        cullStats.lightBinning += app_time() - binningStart;
+    }
+
+    // Two-phase occlusion culling. Phase 1 draws the dog and the crowd members
+    // that were not occluded last frame; those are the occluders for the Hi-Z
+    // test, and phase 2 draws whatever else passes it.
+    size_t count = scene.size();
+    frame_vector_t<uint8_t> early(count);
+    frame_vector_t<uint8_t> late(count, 0);
+    for (size_t i = 0; i < count; i++) {
+        early[i] = scene.visible[i] && !(enableOcclusionCulling && scene.occluded[i]);
+    }
+
+    // Impostors replace the mesh of distant crowd members, those skip skinning
+    update_impostor_blends();
+    frame_vector_t<uint8_t> earlyMesh(count);
+    frame_vector_t<uint8_t> earlyCrowd(count);
+    for (size_t i = 0; i < count; i++) {
+        earlyMesh[i] = early[i] && scene.impostorBlend[i] < 1.0f;
+        earlyCrowd[i] = early[i] && !(scene.flags[i] & SCENE_METALLIC);
+    }
+
+    // Skinning pre-pass for everything drawn below
+    frame_vector_t<uint8_t> skinnedAssets(scene.assets.size(), 0);
+    skin_instances(earlyMesh.data(), skinnedAssets.data(), "skinning");
+    if (shadowMap) {
+        render_shadows(cast.data(), skinnedAssets.data());
+    }
+    // the instance upload, skinning and shadow pass used GL directly
+    glStateCache.invalidate();
+
+    // 2. Opaque objects (Flair + Finale Dancers, dog metal surface)
+    submit_crowd(renderQueue, viewProjection, earlyCrowd.data(), "crowd", "impostor", "crowd-vs");
+    // The dog has no substitute program, it is skipped until its program is ready
+    bool dogReady = dogShader->is_ready();
+    for (size_t i = 0; i < count; i++) {
+        if (dogReady && early[i] && (scene.flags[i] & SCENE_METALLIC)) {
+            submit_dog_layer(renderQueue, viewProjection, (int)i, DOG_LAYER_SURFACE);
+        }
+    }
+    renderQueue.flush(glStateCache, gpuTimer);
+
+    // Phase 2: build the pyramid of the depth drawn so far and test every
+    // crowd member in the frustum against it. The result is also next frame's
+    // phase 1 set; an instance never hides itself since its nearest box depth
+    // is in front of its own pixels. Only the late draws need this frame's
+    // pyramid, without candidates for them the readback isn't waited for and
+    // the phase 1 instances are tested against the last one that came back.
+    if (enableOcclusionCulling) {
+        PROFILE_ZONE("occlusion");
+        gpuTimer->begin("hiz");
+        hizPyramid->build(SCR_WIDTH, SCR_HEIGHT, viewProjection, scene.bounds, sceneFBO);
+        gpuTimer->end();
+
+        bool lateCandidates = false;
+        for (size_t i = 0; i < count && !lateCandidates; i++) {
+            lateCandidates = scene.visible[i] && !early[i] && !(scene.flags[i] & SCENE_METALLIC);
+        }
+        if (lateCandidates) hizPyramid->wait();
+
+        for (size_t i = 0; i < count; i++) {
+            if (scene.flags[i] & SCENE_METALLIC) continue;
+            if (!scene.visible[i]) {
+                scene.occluded[i] = 0;
+                continue;
+            }
+            scene.occluded[i] = hizPyramid->occluded(i);
+            late[i] = !early[i] && !scene.occluded[i];
+            cullStats.occlusionTested++;
+            cullStats.occluded += scene.occluded[i];
+        }
+
+        frame_vector_t<uint8_t> lateMesh(count);
+        for (size_t i = 0; i < count; i++) {
+            lateMesh[i] = late[i] && scene.impostorBlend[i] < 1.0f;
+        }
+        skin_instances(lateMesh.data(), skinnedAssets.data(), "skinning-late");
+        glStateCache.invalidate();
+        submit_crowd(renderQueue, viewProjection, late.data(), "crowd-late", "impostor-late", "crowd-late-vs");
+    }
+    for (size_t i = 0; i < count; i++) {
+        cullStats.drawn += early[i] || late[i];
+    }
+
+    // 3. Skybox after all opaque geometry, only where nothing was drawn
+    if (!skyboxFirst) {
+        submit_skybox(renderQueue, view, projection);
+    }
+
+    // 4. Dog aura
+    for (size_t i = 0; i < count; i++) {
+        if (dogReady && early[i] && (scene.flags[i] & SCENE_METALLIC)) {
+            submit_dog_layer(renderQueue, viewProjection, (int)i, DOG_LAYER_AURA);
+        }
+    }
+
+    // [NEW] 5. Fade Overlay, drawn over everything (part of the post pass otherwise),
+    // skipped like the dog until its program is ready
+    if (!postChain && fadeAlpha > 0.0f && fadeShader->is_ready()) {
+        render_item_t item;
+        item.pass = PASS_OVERLAY;
+        item.program = fadeShader;
+        item.state.cullFace = false;
+        item.state.blend = true;
+        item.state.depthTest = false;
+        item.state.depthWrite = false;
+        item.timer = "fade";
+        item.bind = []() { fadeShader->set_uniform_value("alpha", fadeAlpha); };
+        item.draw = [](gl_state_cache_t& cache) {
+            cache.bind_vertex_array(fadeVAO);
+            cache.draw_arrays(GL_TRIANGLES, 0, 6);
+        };
+        renderQueue.submit(std::move(item));
+    }
+    renderQueue.flush(glStateCache, gpuTimer);
+
+    // 6. Post chain resolves the HDR scene into the backbuffer
+    if (postChain) {
+        PROFILE_ZONE("post");
+        gpuTimer->begin("post");
+        postChain->run(sceneTarget->color, SCR_WIDTH, SCR_HEIGHT, *renderTargetPool, outputFBO);
+        gpuTimer->end();
+        renderTargetPool->release(sceneTarget);
+        glStateCache.invalidate();
+    }
+    renderTargetPool->end_frame();
+}
+
+// Whole-frame times of this run as JSON: the full-frame case of the benchmark
+// target, which runs this executable with --headless
+void write_bench_json(const std::string& path, std::vector<double> frameTimes){
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "cannot write " << path << std::endl;
+        return;
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
-    glfwSetKeyCallback(window, keyCallback);
-    glfwSwapInterval(1);
+    std::sort(frameTimes.begin(), frameTimes.end());
+    auto percentile = [&](double p) {
+        if (frameTimes.empty()) return 0.0;
+        return 1000.0 * frameTimes[std::min(frameTimes.size() - 1, (size_t)(p * frameTimes.size()))];
+    };
+    double total = std::accumulate(frameTimes.begin(), frameTimes.end(), 0.0);
+    out << "{\"frames\": " << frameTimes.size()
+        << ", \"width\": " << SCR_WIDTH << ", \"height\": " << SCR_HEIGHT
+        << ", \"headless\": " << (headless ? "true" : "false")
+        << ", \"skinning\": \"" << skinning_backend_name(skinningBackend) << "\""
+        << ", \"unit\": \"ms\""
+        << ", \"mean\": " << (frameTimes.empty() ? 0.0 : 1000.0 * total / frameTimes.size())
+        << ", \"median\": " << percentile(0.5) << ", \"p95\": " << percentile(0.95)
+        << ", \"p99\": " << percentile(0.99) << ", \"max\": " << percentile(1.0) << "}" << std::endl;
+}
 
-    // glad: load all OpenGL function pointers
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-        std::cout << "Failed to initialize GLAD" << std::endl;
+int main(int argc, char** argv) {
+    bool framesGiven = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--skinning=vs") skinningBackend = SKINNING_VERTEX_SHADER;
+        else if (arg == "--skinning=tf") skinningBackend = SKINNING_TRANSFORM_FEEDBACK;
+        else if (arg == "--skinning=cpu") skinningBackend = SKINNING_CPU;
+        else if (arg == "--skinning=auto") skinningBackend = SKINNING_AUTO;
+        else if (arg == "--gs-effects") useGeometryShaderEffects = true;
+        else if (arg == "--measure-vertex-stage") measureVertexStage = true;
+        else if (arg == "--no-cull") enableFrustumCulling = false;
+        else if (arg == "--no-occlusion") enableOcclusionCulling = false;
+        else if (arg == "--no-state-cache") enableStateCache = false;
+        else if (arg == "--skybox-first") skyboxFirst = true;
+        else if (arg == "--no-oit") enableOIT = false;
+        else if (arg == "--no-post") enablePostProcess = false;
+        else if (arg == "--no-shadows") enableShadows = false;
+        else if (arg == "--no-shadow-cache") enableShadowCache = false;
+        else if (arg == "--no-impostors") enableImpostors = false;
+        else if (arg == "--no-sim-thread") enableSimThread = false;
+        else if (arg == "--deterministic") deterministicClock = true;
+        else if (arg == "--headless") headless = true;
+        else if (arg.rfind("--capture=", 0) == 0) {
+            captureTarget = arg.substr(10);
+            captureFormat = CAPTURE_PNG;
+        }
+        else if (arg.rfind("--capture-pipe=", 0) == 0) {
+            captureTarget = arg.substr(15);
+            captureFormat = CAPTURE_YUV_PIPE;
+        }
+        else if (arg.rfind("--trace=", 0) == 0) tracePath = arg.substr(8);
+        else if (arg.rfind("--bench-json=", 0) == 0) benchJsonPath = arg.substr(13);
+        else if (arg.rfind("--record=", 0) == 0) recordPath = arg.substr(9);
+        else if (arg.rfind("--replay=", 0) == 0) replayPath = arg.substr(9);
+        else if (arg.rfind("--frames=", 0) == 0) {
+            headlessFrames = std::max(1, std::atoi(arg.c_str() + 9));
+            framesGiven = true;
+        }
+        else if (arg.rfind("--size=", 0) == 0) {
+            int w = 0, h = 0;
+            if (std::sscanf(arg.c_str() + 7, "%dx%d", &w, &h) == 2 && w > 0 && h > 0) {
+                SCR_WIDTH = w;
+                SCR_HEIGHT = h;
+            } else {
+                std::cout << "bad size " << arg << ", expected --size=WxH" << std::endl;
+            }
+        }
+        else if (arg.rfind("--sim-rate=", 0) == 0) simRate = std::max(1, std::atoi(arg.c_str() + 11));
+        else if (arg.rfind("--impostor-texel-ratio=", 0) == 0) impostorTexelRatio = std::max(0.05f, (float)std::atof(arg.c_str() + 23));
+        else if (arg.rfind("--lights=", 0) == 0) finaleLightCount = std::max(0, std::atoi(arg.c_str() + 9));
+        else if (arg.rfind("--vram-budget=", 0) == 0) gpuMemory.budget = (size_t)std::max(0.0, std::atof(arg.c_str() + 14) * 1024.0 * 1024.0);
+        else if (arg == "--gpu-memory-list") listGpuMemory = true;
+        else if (arg.rfind("--scene=", 0) == 0) scenePath = arg.substr(8);
+        else std::cout << "unknown argument " << arg << std::endl;
+    }
+    if (!replayPath.empty()) {
+        if (!inputLog.load(replayPath)) {
+            return -1;
+        }
+        // the steps only line up at the rate they were recorded at
+        if (simRate != inputLog.stepRate) {
+            std::cout << "replay: simulating at the recorded " << inputLog.stepRate << " Hz" << std::endl;
+            simRate = inputLog.stepRate;
+        }
+        // headless runs draw one step per frame: until the last event by default
+        if (headless && !framesGiven) {
+            headlessFrames = (int)inputLog.last_step() + 1;
+        }
+        std::cout << "replay: " << inputLog.size() << " input events over " << inputLog.last_step() + 1
+                  << " steps from " << replayPath << std::endl;
+        recordPath.clear();
+    }
+    inputLog.stepRate = simRate;
+    // the file is read before any window opens, the models load in setup()
+    if (!scene.load(scenePath)) {
         return -1;
     }
 
+    GLFWwindow *window = nullptr;
+    headless_context_t headlessContext;
+    if (headless) {
+        // every frame of a batch run is complete and reproducible: programs
+        // link up front and the simulation steps once per frame
+        asyncShaderCompile = false;
+        deterministicClock = true;
+        if (!headlessContext.create()) {
+            return -1;
+        }
+        if (!gladLoadGLLoader((GLADloadproc)headless_context_t::proc_address)) {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
+        if (!headlessContext.create_target(SCR_WIDTH, SCR_HEIGHT)) {
+            return -1;
+        }
+        outputFBO = headlessContext.output_fbo();
+        std::cout << "headless (" << headlessContext.platform() << " EGL): " << headlessFrames
+                  << " frames at " << SCR_WIDTH << "x" << SCR_HEIGHT << std::endl;
+    } else {
+        // glfw: initialize and configure
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+        // glfw window creation
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "HW3-Animated Model", NULL, NULL);
+        if (window == NULL) {
+            std::cerr << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
+        glfwSetKeyCallback(window, keyCallback);
+        glfwSwapInterval(1);
+
+        // glad: load all OpenGL function pointers
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
+        glfwGetFramebufferSize(window, &SCR_WIDTH, &SCR_HEIGHT);
+    }
+
     // set viewport
-    glfwGetFramebufferSize(window, &SCR_WIDTH, &SCR_HEIGHT);
     glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
 
     // setup texture, model, shader ...e.t.c
     setup();
+    gpuTimer = new gpu_timer_t();
+    std::cout << "fragment invocation counts (GL_ARB_pipeline_statistics_query): "
+              << (gpu_timer_t::has_pipeline_statistics() ? "yes" : "no") << std::endl;
+    glStateCache.set_enabled(enableStateCache);
+    if (!captureTarget.empty()) {
+        frameCapture = new frame_capture_t(SCR_WIDTH, SCR_HEIGHT, captureFormat, captureTarget);
+        if (!frameCapture->ok()) {
+            delete frameCapture;
+            frameCapture = nullptr;
+        }
+    }
+    if (!tracePath.empty()) {
+        profiler_start_trace(tracePath);
+    }
+    PROFILE_THREAD("main");
+    float lastTimerReport = app_time();
+    float lastTitleUpdate = lastTimerReport;
     
     // render loop
-    while (!glfwWindowShouldClose(window)) {
-        processInput(window);
-        update(); 
-        render(); 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+    // No blocking shader resolves before the first frame is presented
+    shader_program_t::new_frame(0);
+    bool reportedShadersReady = false;
+
+    // The first snapshot is made here with two steps already due, so the first
+    // frame has both states to draw. Deterministic runs step in lockstep with
+    // the frames, which only the inline simulation does.
+    simClock = sim_clock_t(1.0 / simRate, SIM_MAX_CATCH_UP_STEPS);
+    simClock.deterministic = deterministicClock;
+    simClock.reset(app_time() - 2.0 * simClock.step_seconds());
+    simState.camera = camera;
+    simState.shaderProgramIndex = shaderProgramIndex;
+    simulate();
+    if (deterministicClock) simulate();
+    sim_thread_t simThread(simulate);
+    if (enableSimThread && !deterministicClock) {
+        simThread.start();
+    }
+    unsigned long reportedSteps = 0;
+    double reportedSkipped = 0.0;
+    unsigned long frameIndex = 0;
+    std::vector<double> frameTimes;
+    while (headless ? frameIndex < (unsigned long)headlessFrames : !glfwWindowShouldClose(window)) {
+        frameIndex++;
+        PROFILE_ZONE("frame");
+        double frameStart = app_time();
+        if (window) {
+            processInput(window);
+        }
+        unsigned long allocationsBefore = heap_allocations();
+        if (!simThread.running()) {
+            double stepStart = app_time();
+            simulate();
+            frameStats.inlineSteps++;
+            frameStats.inlineStepSeconds += app_time() - stepStart;
+        }
+        bool fresh = false;
+        const frame_snapshot_t& frame = snapshots.acquire(&fresh);
+        // simulate the next frame while this one is drawn
+        if (simThread.running()) {
+            simThread.request_step();
+        }
+        // a frame without a new state still moves on between the last two
+        apply_snapshot(frame, frame.clock.alpha(app_time()));
+        if (!fresh) {
+            frameStats.repeated++;
+        }
+
+        double renderStart = app_time();
+        render();
+        if (frameCapture) {
+            PROFILE_ZONE("capture");
+            frameCapture->capture(outputFBO, SCR_WIDTH, SCR_HEIGHT);
+        }
+        double swapStart = app_time();
+        {
+            PROFILE_ZONE("swap");
+            if (window) {
+                glfwSwapBuffers(window);
+            } else {
+                // nothing paces a headless run, so the frame ends when the GPU is done
+                glFinish();
+            }
+        }
+        double presented = app_time();
+        frameStats.frames++;
+        frameStats.renderSeconds += swapStart - renderStart;
+        frameStats.swapSeconds += presented - swapStart;
+        frameStats.heapAllocations += heap_allocations() - allocationsBefore;
+        // the render queue and shadow casters are done with this frame's data
+        frame_arena().reset();
+        if (fresh && frame.inputSampled > 0.0) {
+            frameStats.inputFrames++;
+            frameStats.inputLatency += presented - frame.inputSampled;
+        }
+        if (window) {
+            glfwPollEvents();
+        }
+
+        shader_program_t::new_frame(1);
+        poll_shader_programs();
+
+        // Per-pass GPU timings; compare runs with --skinning=vs|tf|cpu
+        gpuTimer->resolve();
+        profiler_new_frame();
+        // evictions and reloads bind GL_TEXTURE_2D behind the state cache,
+        // which render() invalidates first thing
+        gpuMemory.end_frame();
+        // the window title doubles as a live profile readout
+        if (window && app_time() - lastTitleUpdate > PROFILE_TITLE_INTERVAL) {
+            std::string summary = profiler_summary();
+            if (!summary.empty()) {
+                glfwSetWindowTitle(window, ("HW3-Animated Model | " + summary).c_str());
+            }
+            lastTitleUpdate = app_time();
+        }
+        bool lastHeadlessFrame = headless && frameIndex == (unsigned long)headlessFrames;
+        if (app_time() - lastTimerReport > GPU_TIMER_REPORT_INTERVAL || lastHeadlessFrame) {
+            gpuTimer->report(std::string(skinning_backend_name(skinningBackend)) + "-skinning");
+            gpuTimer->reset();
+            if (cullStats.frames > 0) {
+                std::cout << "[cull] per frame: drawn " << (float)cullStats.drawn / cullStats.frames
+                          << ", frustum culled " << (float)cullStats.culled / cullStats.frames;
+                if (cullStats.occlusionTested > 0) {
+                    std::cout << ", occluded " << 100.0f * cullStats.occluded / cullStats.occlusionTested << "%"
+                              << ", hi-z waits " << hizPyramid->waits << ", dropped " << hizPyramid->dropped;
+                    hizPyramid->reset_counters();
+                }
+                std::cout << std::endl;
+                std::cout << "[gl] per frame: state calls requested " << (float)glStateCache.requested / cullStats.frames
+                          << ", issued " << (float)glStateCache.issued / cullStats.frames
+                          << ", draws " << (float)glStateCache.draws / cullStats.frames << std::endl;
+                if (impostorRenderer) {
+                    std::cout << "[impostor] per frame: impostor only " << (float)cullStats.impostors / cullStats.frames
+                              << ", crossfading " << (float)cullStats.crossfading / cullStats.frames
+                              << " (texel ratio " << impostorTexelRatio << ")" << std::endl;
+                }
+                if (lightClusters->light_count() > 0) {
+                    std::cout << "[lights] " << lightClusters->light_count() << " lights, "
+                              << lightClusters->index_count() << " cluster entries, max "
+                              << lightClusters->max_cluster_lights() << " per cluster, binning "
+                              << 1000.0 * cullStats.lightBinning / cullStats.frames << " ms" << std::endl;
+                }
+                if (shadowMap) {
+                    std::cout << "[shadow] per frame: casters drawn " << (float)shadowMap->drawnCasters / cullStats.frames
+                              << ", cached " << (float)shadowMap->cachedCasters / cullStats.frames
+                              << ", static map rebuilds " << shadowMap->staticRebuilds << std::endl;
+                    shadowMap->reset_counters();
+                }
+                sim_thread_t::stats_t simStats = simThread.take_stats();
+                if (!simThread.running()) {
+                    simStats.steps = frameStats.inlineSteps;
+                    simStats.stepSeconds = frameStats.inlineStepSeconds;
+                }
+                double elapsed = app_time() - lastTimerReport;
+                std::cout << "[threads] sim (" << (simThread.running() ? "thread" : "inline") << ", "
+                          << simRate << " Hz" << (deterministicClock ? ", deterministic" : "") << "): "
+                          << (frame.frame - reportedSteps) / elapsed << " steps/s, update "
+                          << 1000.0 * simStats.stepSeconds / std::max(simStats.steps, 1ul) << " ms, skipped "
+                          << 1000.0 * (frame.clock.skippedSeconds - reportedSkipped) << " ms"
+                          << " | render: " << frameStats.frames / elapsed << " fps, cpu "
+                          << 1000.0 * frameStats.renderSeconds / std::max(frameStats.frames, 1ul) << " ms, swap "
+                          << 1000.0 * frameStats.swapSeconds / std::max(frameStats.frames, 1ul) << " ms, repeated "
+                          << frameStats.repeated << ", dropped " << snapshots.take_dropped();
+                if (frameStats.inputFrames > 0) {
+                    std::cout << " | input to present " << 1000.0 * frameStats.inputLatency / frameStats.inputFrames << " ms";
+                }
+                std::cout << std::endl;
+                std::cout << "[arena] heap allocations per frame: render "
+                          << (float)frameStats.heapAllocations / std::max(frameStats.frames, 1ul);
+                if (simThread.running()) {
+                    std::cout << ", sim " << (float)simStats.heapAllocations / std::max(simStats.steps, 1ul);
+                }
+                std::cout << " | render arena " << frame_arena().high_water() / 1024.0 << " KB peak of "
+                          << frame_arena().capacity() / 1024.0 << " KB" << std::endl;
+                reportedSteps = frame.frame;
+                reportedSkipped = frame.clock.skippedSeconds;
+                if (frameCapture) {
+                    unsigned long captured = std::max(frameCapture->captured, 1ul);
+                    double frameMs = 1000.0 * elapsed / std::max(frameStats.frames, 1ul);
+                    double captureMs = 1000.0 * frameCapture->captureSeconds / captured;
+                    std::cout << "[capture] " << frameCapture->captured << " frames, "
+                              << frameCapture->written() << " written in total, " << captureMs << " ms per frame ("
+                              << 100.0 * captureMs / frameMs << "% of frame time), stalled "
+                              << 1000.0 * frameCapture->stallSeconds / captured << " ms";
+                    if (frameCapture->skipped > 0) {
+                        std::cout << ", skipped " << frameCapture->skipped << " (size changed)";
+                    }
+                    std::cout << std::endl;
+                    frameCapture->reset_counters();
+                }
+                if (postChain) {
+                    std::cout << "[post] full-screen passes " << postChain->passes()
+                              << ", pooled targets " << renderTargetPool->size() << std::endl;
+                }
+                gpuMemory.report();
+                profiler_report();
+            }
+            gpuMemory.reset_counters();
+            profiler_reset();
+            cullStats = cull_stats_t();
+            frameStats = frame_stats_t();
+            glStateCache.reset_counters();
+            lastTimerReport = app_time();
+        }
+        if (!reportedShadersReady && shader_program_t::pending_count() == 0) {
+            std::cout << "all shader programs ready at t = " << app_time() << "s" << std::endl;
+            reportedShadersReady = true;
+        }
+        if (!benchJsonPath.empty()) {
+            frameTimes.push_back(app_time() - frameStart);
+        }
+    }
+    if (!benchJsonPath.empty()) {
+        write_bench_json(benchJsonPath, frameTimes);
     }
 
     // cleanup
-    delete animatedModel;
-    delete dogModel;
-    delete bananaModel;
-    delete allosaurusModel;
-    delete gromitModel;
-    delete flairShaderGS;
-    delete flairShaderGSPulse;
+    simThread.stop();
+    if (!recordPath.empty() && inputLog.save(recordPath)) {
+        std::cout << "recorded " << inputLog.size() << " input events over " << simState.frame
+                  << " steps to " << recordPath << std::endl;
+    }
+    delete frameCapture; // writes out what is still in flight
+    profiler_new_frame();
+    profiler_stop_trace();
+
+    scene.release_assets();
+    delete flairShader;
+    delete flairShaderExplosion;
+    delete flairShaderPulse;
+    delete dogShader;
+    delete skinningShader;
+    delete cpuSkinner;
+    delete gpuTimer;
+    delete instanceBuffer;
+    delete hizPyramid;
+    delete oitTarget;
+    delete postChain;
+    delete lightClusters;
+    delete shadowMap;
+    delete impostorRenderer;
+    delete renderTargetPool;
     for (auto shader : shaderPrograms) {
         delete shader;
     }
     delete cubemapShader;
-
-    glfwTerminate();
+    delete fadeShader;
+    cubemapTexture.reset();
+    cubemapTextureRyder.reset();
+    cubemapVAO.reset();
+    cubemapVBO.reset();
+    fadeVAO.reset();
+    fadeVBO.reset();
+    if (!window) headlessContext.destroy_target();
+    // whatever is left here leaked
+    if (listGpuMemory) gpuMemory.list();
+
+    if (window) {
+        glfwTerminate();
+    } else {
+        headlessContext.destroy();
+    }
     return 0;
 }
 
@@ -775,40 +2069,13 @@ void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
-    // shader program selection
-    if (key == GLFW_KEY_0 && (action == GLFW_REPEAT || action == GLFW_PRESS)) 
-        shaderProgramIndex = 0;
-    if (key == GLFW_KEY_1 && (action == GLFW_REPEAT || action == GLFW_PRESS)) 
-        shaderProgramIndex = 1;
-    if (key == GLFW_KEY_1 && action == GLFW_PRESS)
-    {
-        enableCrowdGS = !enableCrowdGS;
-        if (enableCrowdGS) enableCrowdGSPulse = false;
+    // 0-8 shader program selection, 1/2 crowd effects, k explosion: applied
+    // by the next simulation step, so recorded input logs replay them
+    if (((key >= GLFW_KEY_0 && key <= GLFW_KEY_8) || key == GLFW_KEY_K) && action == GLFW_PRESS) {
+        std::lock_guard<std::mutex> lock(inputMutex);
+        pendingInput.presses.push_back(key);
+        if (pendingInput.sampled == 0.0) pendingInput.sampled = app_time();
     }
-    if (key == GLFW_KEY_2 && (action == GLFW_REPEAT || action == GLFW_PRESS)) 
-        shaderProgramIndex = 2;
-    if (key == GLFW_KEY_2 && action == GLFW_PRESS)
-    {
-        enableCrowdGSPulse = !enableCrowdGSPulse;
-        if (enableCrowdGSPulse) enableCrowdGS = false;
-    }
-    if (key == GLFW_KEY_3 && action == GLFW_PRESS)
-        shaderProgramIndex = 3;
-    if (key == GLFW_KEY_4 && action == GLFW_PRESS)
-        shaderProgramIndex = 4;
-    if (key == GLFW_KEY_5 && action == GLFW_PRESS)
-        shaderProgramIndex = 5;
-    // Clamp any higher keys to the last shader to avoid selecting an invalid index
-    if (key == GLFW_KEY_6 && action == GLFW_PRESS)
-        shaderProgramIndex = 5;
-    if (key == GLFW_KEY_7 && action == GLFW_PRESS)
-        shaderProgramIndex = 5;
-    if (key == GLFW_KEY_8 && action == GLFW_PRESS)
-        shaderProgramIndex = 5;
-
-    // k key for explosion (switch model) toggle
-    if (key == GLFW_KEY_K && action == GLFW_PRESS)
-        isExploded = !isExploded;
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -819,13 +2086,13 @@ void framebufferSizeCallback(GLFWwindow *window, int width, int height) {
 }
 
 // loading cubemap texture
-unsigned int loadCubemap(std::vector<std::string>& faces)
+void loadCubemap(std::vector<std::string>& faces, gl_object_t& texture)
 {
-    unsigned int texture;
-    glGenTextures(1, &texture);
+    texture.create(GL_OBJECT_TEXTURE, GPU_MEMORY_TEXTURES, "skybox cubemap");
     glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
 
     int width, height, nrChannels;
+    size_t bytes = 0;
     for (unsigned int i = 0; i < faces.size(); i++)
     {
         stbi_set_flip_vertically_on_load(false);
@@ -835,6 +2102,7 @@ unsigned int loadCubemap(std::vector<std::string>& faces)
             glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 
                          0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data
             );
+            bytes += gpu_memory_t::texture_bytes(GL_RGB, width, height);
             stbi_image_free(data);
         }
         else
@@ -848,6 +2116,5 @@ unsigned int loadCubemap(std::vector<std::string>& faces)
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    return texture;
+    texture.resize(bytes, GL_RGB);
 }
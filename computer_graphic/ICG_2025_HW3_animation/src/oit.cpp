@@ -0,0 +1,117 @@
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "header/shader.h"
+#include "header/oit.h"
+#include "header/gpu_memory.h"
+
+oit_target_t::oit_target_t(const std::string& shaderDir) {
+    program = new shader_program_t();
+    program->create();
+    program->add_shader(shaderDir + "fullscreen.vert", GL_VERTEX_SHADER);
+    program->add_shader(shaderDir + "oit_composite.frag", GL_FRAGMENT_SHADER);
+    program->link_shader();
+
+    glGenVertexArrays(1, &emptyVAO);
+    glGenFramebuffers(1, &fbo);
+}
+
+oit_target_t::~oit_target_t() {
+    delete program;
+    glDeleteVertexArrays(1, &emptyVAO);
+    glDeleteFramebuffers(1, &fbo);
+    gpuMemory.untrack(GL_OBJECT_TEXTURE, accumTexture);
+    gpuMemory.untrack(GL_OBJECT_TEXTURE, weightTexture);
+    gpuMemory.untrack(GL_OBJECT_RENDERBUFFER, depthBuffer);
+    glDeleteTextures(1, &accumTexture);
+    glDeleteTextures(1, &weightTexture);
+    glDeleteRenderbuffers(1, &depthBuffer);
+}
+
+static unsigned int make_target(int width, int height, GLenum internalFormat, GLenum format) {
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_FLOAT, NULL);
+    gpuMemory.track(GL_OBJECT_TEXTURE, texture, GPU_MEMORY_TARGETS, "oit");
+    gpuMemory.resize(GL_OBJECT_TEXTURE, texture, gpu_memory_t::texture_bytes(internalFormat, width, height), internalFormat);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    return texture;
+}
+
+void oit_target_t::resize(int w, int h) {
+    width = w;
+    height = h;
+
+    gpuMemory.untrack(GL_OBJECT_TEXTURE, accumTexture);
+    gpuMemory.untrack(GL_OBJECT_TEXTURE, weightTexture);
+    gpuMemory.untrack(GL_OBJECT_RENDERBUFFER, depthBuffer);
+    glDeleteTextures(1, &accumTexture);
+    glDeleteTextures(1, &weightTexture);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    accumTexture = make_target(width, height, GL_RGBA16F, GL_RGBA);
+    weightTexture = make_target(width, height, GL_R16F, GL_RED);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // same format as the scene framebuffer so its depth can be blitted in
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    gpuMemory.track(GL_OBJECT_RENDERBUFFER, depthBuffer, GPU_MEMORY_TARGETS, "oit");
+    gpuMemory.resize(GL_OBJECT_RENDERBUFFER, depthBuffer,
+                     gpu_memory_t::texture_bytes(GL_DEPTH24_STENCIL8, width, height), GL_DEPTH24_STENCIL8);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, weightTexture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "OIT framebuffer incomplete" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void oit_target_t::begin(int w, int h, unsigned int scene) {
+    if (w != width || h != height) resize(w, h);
+    sceneFBO = scene;
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+    // accumulation starts at revealage 1 (nothing covers the background)
+    const float clearAccum[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    const float clearWeight[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glClearBufferfv(GL_COLOR, 0, clearAccum);
+    glClearBufferfv(GL_COLOR, 1, clearWeight);
+}
+
+void oit_target_t::composite() {
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+    if (!program->is_ready()) return;
+
+    glDisable(GL_DEPTH_TEST);
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    program->use();
+    program->set_uniform_value("accumulation", 0);
+    program->set_uniform_value("weights", 1);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, accumTexture);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, weightTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    glBindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    program->release();
+}
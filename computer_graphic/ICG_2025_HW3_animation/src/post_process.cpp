@@ -0,0 +1,195 @@
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "header/shader.h"
+#include "header/post_process.h"
+#include "header/gpu_memory.h"
+
+//////////////////////////////////////////////////////////////////////////
+// render_target_pool_t
+
+static void delete_target(render_target_t* target) {
+    gpuMemory.untrack(GL_OBJECT_TEXTURE, target->color);
+    gpuMemory.untrack(GL_OBJECT_RENDERBUFFER, target->depth);
+    glDeleteFramebuffers(1, &target->fbo);
+    glDeleteTextures(1, &target->color);
+    glDeleteRenderbuffers(1, &target->depth);
+    delete target;
+}
+
+render_target_pool_t::~render_target_pool_t() {
+    for (render_target_t* target : targets) delete_target(target);
+}
+
+render_target_t* render_target_pool_t::acquire(int width, int height, unsigned int format, bool depth) {
+    for (render_target_t* target : targets) {
+        if (!target->inUse && target->width == width && target->height == height &&
+            target->format == format && (target->depth != 0) == depth) {
+            target->inUse = true;
+            target->idleFrames = 0;
+            return target;
+        }
+    }
+
+    render_target_t* target = new render_target_t();
+    target->width = width;
+    target->height = height;
+    target->format = format;
+    target->inUse = true;
+
+    glGenTextures(1, &target->color);
+    glBindTexture(GL_TEXTURE_2D, target->color);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+    gpuMemory.track(GL_OBJECT_TEXTURE, target->color, GPU_MEMORY_TARGETS, "render target pool");
+    gpuMemory.resize(GL_OBJECT_TEXTURE, target->color, gpu_memory_t::texture_bytes(format, width, height), format);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &target->fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target->color, 0);
+    if (depth) {
+        // same format as the default framebuffer, so Hi-Z and OIT can blit it
+        glGenRenderbuffers(1, &target->depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, target->depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        gpuMemory.track(GL_OBJECT_RENDERBUFFER, target->depth, GPU_MEMORY_TARGETS, "render target pool");
+        gpuMemory.resize(GL_OBJECT_RENDERBUFFER, target->depth,
+                         gpu_memory_t::texture_bytes(GL_DEPTH24_STENCIL8, width, height), GL_DEPTH24_STENCIL8);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, target->depth);
+    }
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "render target " << width << "x" << height << " incomplete" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    targets.push_back(target);
+    return target;
+}
+
+void render_target_pool_t::release(render_target_t* target) {
+    if (target) target->inUse = false;
+}
+
+void render_target_pool_t::end_frame() {
+    size_t kept = 0;
+    for (render_target_t* target : targets) {
+        if (!target->inUse && ++target->idleFrames > POOL_MAX_IDLE_FRAMES) {
+            delete_target(target);
+            continue;
+        }
+        targets[kept++] = target;
+    }
+    targets.resize(kept);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// post_chain_t
+
+post_chain_t::post_chain_t(const std::string& shaderDir) {
+    fusedProgram = new shader_program_t();
+    fusedProgram->create();
+    fusedProgram->add_shader(shaderDir + "fullscreen.vert", GL_VERTEX_SHADER);
+    fusedProgram->add_shader(shaderDir + "post_fused.frag", GL_FRAGMENT_SHADER);
+    fusedProgram->link_shader();
+    // every frame goes through it, there is nothing to show without it
+    fusedProgram->wait();
+
+    glGenVertexArrays(1, &emptyVAO);
+}
+
+post_chain_t::~post_chain_t() {
+    delete fusedProgram;
+    glDeleteVertexArrays(1, &emptyVAO);
+}
+
+void post_chain_t::add_effect(post_effect_t effect) {
+    effects.push_back(std::move(effect));
+}
+
+post_effect_t* post_chain_t::find(const std::string& name) {
+    for (post_effect_t& effect : effects) {
+        if (effect.name == name) return &effect;
+    }
+    return nullptr;
+}
+
+// Group the enabled effects into passes. A fused effect joins the previous
+// pass when that one is fused too and doesn't already run a later stage.
+void post_chain_t::build_passes() {
+    passList.clear();
+    for (post_effect_t& effect : effects) {
+        if (!effect.enabled) continue;
+        if (effect.fusedStage == 0) {
+            if (!effect.program || !effect.program->is_ready()) continue;
+            pass_t pass;
+            pass.program = effect.program;
+            pass.effects.push_back(&effect);
+            passList.push_back(pass);
+            continue;
+        }
+        bool fuse = !passList.empty() && passList.back().program == fusedProgram &&
+                    passList.back().fusedStages < effect.fusedStage;
+        if (!fuse) {
+            pass_t pass;
+            pass.program = fusedProgram;
+            passList.push_back(pass);
+        }
+        passList.back().fusedStages |= effect.fusedStage;
+        passList.back().effects.push_back(&effect);
+    }
+    // the last pass writes the backbuffer, so there is always one
+    if (passList.empty()) {
+        pass_t pass;
+        pass.program = fusedProgram;
+        passList.push_back(pass);
+    }
+}
+
+void post_chain_t::run(unsigned int sourceTexture, int width, int height, render_target_pool_t& pool,
+                       unsigned int outputFBO) {
+    build_passes();
+
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+    glDisable(GL_CULL_FACE);
+    glActiveTexture(GL_TEXTURE0);
+    glBindVertexArray(emptyVAO);
+    glViewport(0, 0, width, height);
+
+    unsigned int input = sourceTexture;
+    render_target_t* inputTarget = nullptr;
+    for (size_t i = 0; i < passList.size(); i++) {
+        const pass_t& pass = passList[i];
+        bool last = i + 1 == passList.size();
+        render_target_t* output = last ? nullptr : pool.acquire(width, height, GL_RGBA16F);
+        glBindFramebuffer(GL_FRAMEBUFFER, output ? output->fbo : outputFBO);
+
+        pass.program->use();
+        pass.program->set_uniform_value("source", 0);
+        if (pass.program == fusedProgram) {
+            pass.program->set_uniform_value("stages", pass.fusedStages);
+        }
+        for (post_effect_t* effect : pass.effects) {
+            if (effect->uniforms) effect->uniforms(pass.program);
+        }
+        glBindTexture(GL_TEXTURE_2D, input);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        // this pass was the only reader of its input
+        pool.release(inputTarget);
+        inputTarget = output;
+        if (output) input = output->color;
+    }
+
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    fusedProgram->release();
+    glEnable(GL_DEPTH_TEST);
+    lastPasses = passList.size();
+}
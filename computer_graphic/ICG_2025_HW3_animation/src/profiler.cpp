@@ -0,0 +1,336 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "header/profiler.h"
+
+#ifdef ICG_PROFILER
+
+namespace {
+
+struct cpu_event_t {
+    const char* name;
+    uint64_t start, end;
+};
+
+// Single producer (the owning thread), single consumer (profiler_new_frame on
+// the main thread): the producer only moves head, the consumer only tail
+struct thread_events_t {
+    cpu_event_t events[PROFILER_THREAD_EVENTS];
+    std::atomic<uint64_t> head{0}, tail{0};
+    std::atomic<unsigned long> dropped{0};
+    std::string name;
+    unsigned int id = 0;
+};
+
+struct trace_event_t {
+    const char* name;
+    uint64_t start, end;
+    unsigned int thread;
+};
+
+struct zone_stats_t {
+    uint64_t totalNs = 0;
+    unsigned long calls = 0;
+    bool gpu = false;
+};
+
+struct gpu_query_t {
+    unsigned int begin = 0, end = 0;
+    const char* name = nullptr;
+};
+
+const unsigned int GPU_THREAD_ID = 1000;
+
+std::mutex registryMutex;
+std::vector<std::unique_ptr<thread_events_t>> threads;
+thread_local thread_events_t* localEvents = nullptr;
+
+std::mutex internMutex;
+std::unordered_set<std::string> interned;
+
+// main thread only from here on
+std::unordered_map<std::string_view, zone_stats_t> stats;
+unsigned long statFrames = 0;
+unsigned long droppedReported = 0;
+
+std::vector<gpu_query_t> freeQueries;
+std::deque<gpu_query_t> pendingQueries;
+gpu_query_t openQuery;
+bool gpuOpen = false;
+int64_t gpuToCpuNs = 0;
+bool gpuCalibrated = false;
+
+bool tracing = false;
+std::string tracePath;
+std::vector<trace_event_t> traceEvents;
+bool traceFull = false;
+
+const auto epoch = std::chrono::steady_clock::now();
+
+thread_events_t* local_events() {
+    if (!localEvents) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        threads.emplace_back(new thread_events_t());
+        localEvents = threads.back().get();
+        localEvents->id = (unsigned int)threads.size();
+        localEvents->name = "thread " + std::to_string(localEvents->id);
+    }
+    return localEvents;
+}
+
+void collect(const char* name, uint64_t start, uint64_t end, unsigned int thread, bool gpu) {
+    zone_stats_t& zone = stats[name];
+    zone.totalNs += end - start;
+    zone.calls++;
+    zone.gpu = gpu;
+    if (!tracing) return;
+    if (traceEvents.size() >= PROFILER_TRACE_EVENTS) {
+        if (!traceFull) std::cerr << "profiler: trace full, recording stopped" << std::endl;
+        traceFull = true;
+        return;
+    }
+    traceEvents.push_back({ name, start, end, thread });
+}
+
+void write_json_string(FILE* file, const char* text) {
+    std::fputc('"', file);
+    for (const char* c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') std::fputc('\\', file);
+        if ((unsigned char)*c >= 0x20) std::fputc(*c, file);
+    }
+    std::fputc('"', file);
+}
+
+} // namespace
+
+const char* profiler_intern(const std::string& name) {
+    std::lock_guard<std::mutex> lock(internMutex);
+    return interned.insert(name).first->c_str();
+}
+
+uint64_t profiler_now_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - epoch).count();
+}
+
+void profiler_thread_name(const char* name) {
+    thread_events_t* events = local_events();
+    std::lock_guard<std::mutex> lock(registryMutex);
+    events->name = name;
+}
+
+void profiler_record(const char* name, uint64_t startNs, uint64_t endNs) {
+    thread_events_t* events = local_events();
+    uint64_t head = events->head.load(std::memory_order_relaxed);
+    if (head - events->tail.load(std::memory_order_acquire) >= PROFILER_THREAD_EVENTS) {
+        events->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    events->events[head % PROFILER_THREAD_EVENTS] = { name, startNs, endNs };
+    events->head.store(head + 1, std::memory_order_release);
+}
+
+void profiler_gpu_begin(const char* name) {
+    if (gpuOpen) profiler_gpu_end();
+    if (freeQueries.empty()) {
+        gpu_query_t query;
+        glGenQueries(1, &query.begin);
+        glGenQueries(1, &query.end);
+        freeQueries.push_back(query);
+    }
+    openQuery = freeQueries.back();
+    freeQueries.pop_back();
+    openQuery.name = name;
+    glQueryCounter(openQuery.begin, GL_TIMESTAMP);
+    gpuOpen = true;
+}
+
+void profiler_gpu_end() {
+    if (!gpuOpen) return;
+    glQueryCounter(openQuery.end, GL_TIMESTAMP);
+    pendingQueries.push_back(openQuery);
+    gpuOpen = false;
+}
+
+void profiler_new_frame() {
+    // GPU timestamps run on their own clock; the offset is taken when the
+    // command stream is idle enough not to matter at trace resolution
+    GLint64 gpuNow = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+    int64_t offset = (int64_t)profiler_now_ns() - (int64_t)gpuNow;
+    gpuToCpuNs = gpuCalibrated ? gpuToCpuNs + (offset - gpuToCpuNs) / 8 : offset;
+    gpuCalibrated = true;
+
+    // in submission order, so stop at the first one the GPU has not reached
+    while (!pendingQueries.empty()) {
+        gpu_query_t& query = pendingQueries.front();
+        GLint available = 0;
+        glGetQueryObjectiv(query.end, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) break;
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(query.begin, GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(query.end, GL_QUERY_RESULT, &end);
+        int64_t start = (int64_t)begin + gpuToCpuNs;
+        if (start >= 0 && end >= begin) {
+            collect(query.name, (uint64_t)start, (uint64_t)start + (end - begin), GPU_THREAD_ID, true);
+        }
+        freeQueries.push_back(query);
+        pendingQueries.pop_front();
+    }
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (auto& events : threads) {
+        uint64_t tail = events->tail.load(std::memory_order_relaxed);
+        uint64_t head = events->head.load(std::memory_order_acquire);
+        for (; tail != head; tail++) {
+            const cpu_event_t& event = events->events[tail % PROFILER_THREAD_EVENTS];
+            collect(event.name, event.start, event.end, events->id, false);
+        }
+        events->tail.store(tail, std::memory_order_release);
+    }
+    statFrames++;
+}
+
+bool profiler_start_trace(const std::string& path) {
+    FILE* probe = std::fopen(path.c_str(), "w");
+    if (!probe) {
+        std::cerr << "profiler: cannot write " << path << std::endl;
+        return false;
+    }
+    std::fclose(probe);
+    tracePath = path;
+    traceEvents.clear();
+    traceEvents.reserve(1 << 16);
+    traceFull = false;
+    tracing = true;
+    return true;
+}
+
+void profiler_stop_trace() {
+    if (!tracing) return;
+    tracing = false;
+    FILE* file = std::fopen(tracePath.c_str(), "w");
+    if (!file) {
+        std::cerr << "profiler: cannot write " << tracePath << std::endl;
+        return;
+    }
+    // complete ("X") events in microseconds; nesting per thread is implied
+    std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    std::fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"GPU\"}}",
+        GPU_THREAD_ID);
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (auto& events : threads) {
+            std::fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+                events->id);
+            write_json_string(file, events->name.c_str());
+            std::fprintf(file, "}}");
+        }
+    }
+    for (const trace_event_t& event : traceEvents) {
+        std::fprintf(file, ",\n{\"name\":");
+        write_json_string(file, event.name);
+        std::fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+            event.thread, event.start / 1000.0, (event.end - event.start) / 1000.0);
+    }
+    std::fprintf(file, "\n]}\n");
+    std::fclose(file);
+    std::cout << "[profile] trace: " << traceEvents.size() << " zones -> " << tracePath << std::endl;
+    traceEvents.clear();
+    traceEvents.shrink_to_fit();
+}
+
+namespace {
+
+std::vector<std::pair<std::string_view, const zone_stats_t*>> sorted_zones(bool gpu) {
+    std::vector<std::pair<std::string_view, const zone_stats_t*>> zones;
+    for (const auto& zone : stats) {
+        if (zone.second.gpu == gpu) zones.push_back({ zone.first, &zone.second });
+    }
+    std::sort(zones.begin(), zones.end(), [](const auto& a, const auto& b) {
+        return a.second->totalNs > b.second->totalNs;
+    });
+    return zones;
+}
+
+} // namespace
+
+void profiler_report() {
+    if (statFrames == 0) return;
+    unsigned long dropped = 0;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (auto& events : threads) dropped += events->dropped.load(std::memory_order_relaxed);
+    }
+    for (int gpu = 0; gpu < 2; gpu++) {
+        auto zones = sorted_zones(gpu != 0);
+        if (zones.empty()) continue;
+        std::cout << "[profile] " << (gpu ? "gpu" : "cpu") << " ms/frame:";
+        char buffer[96];
+        for (const auto& zone : zones) {
+            std::snprintf(buffer, sizeof(buffer), " %.*s %.2f",
+                (int)zone.first.size(), zone.first.data(), zone.second->totalNs / 1e6 / statFrames);
+            std::cout << buffer;
+            if (zone.second->calls > statFrames) std::cout << "(x" << zone.second->calls / statFrames << ")";
+        }
+        std::cout << std::endl;
+    }
+    if (dropped != droppedReported) {
+        std::cout << "[profile] " << dropped - droppedReported << " zones dropped (ring full)" << std::endl;
+        droppedReported = dropped;
+    }
+}
+
+std::string profiler_summary() {
+    std::string summary;
+    if (statFrames == 0) return summary;
+    char buffer[96];
+    for (int gpu = 0; gpu < 2; gpu++) {
+        auto zones = sorted_zones(gpu != 0);
+        summary += gpu ? " | gpu" : "cpu";
+        for (size_t i = 0; i < zones.size() && i < 3; i++) {
+            std::snprintf(buffer, sizeof(buffer), " %.*s %.1f",
+                (int)zones[i].first.size(), zones[i].first.data(), zones[i].second->totalNs / 1e6 / statFrames);
+            summary += buffer;
+        }
+    }
+    return summary;
+}
+
+void profiler_reset() {
+    stats.clear();
+    statFrames = 0;
+}
+
+#else
+
+const char* profiler_intern(const std::string&) { return ""; }
+uint64_t profiler_now_ns() { return 0; }
+void profiler_thread_name(const char*) {}
+void profiler_record(const char*, uint64_t, uint64_t) {}
+void profiler_gpu_begin(const char*) {}
+void profiler_gpu_end() {}
+void profiler_new_frame() {}
+
+bool profiler_start_trace(const std::string&) {
+    std::cerr << "profiler: built without ICG_PROFILER" << std::endl;
+    return false;
+}
+
+void profiler_stop_trace() {}
+void profiler_report() {}
+std::string profiler_summary() { return std::string(); }
+void profiler_reset() {}
+
+#endif
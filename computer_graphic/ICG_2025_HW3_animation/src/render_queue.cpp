@@ -0,0 +1,215 @@
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cstring>
+
+#include "header/shader.h"
+#include "header/gpu_timer.h"
+#include "header/render_queue.h"
+#include "header/profiler.h"
+#include "header/gpu_memory.h"
+
+uint64_t make_sort_key(int pass, unsigned int program, unsigned int material, unsigned int texture,
+                       float depth, bool backToFront) {
+    uint64_t d = (uint64_t)(std::min(std::max(depth, 0.0f), 1.0f) * 0xFFFFFF);
+    uint64_t p = (uint64_t)(pass & 0xF) << 60;
+    uint64_t id = ((uint64_t)(program & 0xFFF) << 24) | ((uint64_t)(material & 0xFFF) << 12) | (texture & 0xFFF);
+    if (backToFront) {
+        return p | ((0xFFFFFF - d) << 36) | id;
+    }
+    return p | (id << 24) | d;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// gl_state_cache_t
+
+void gl_state_cache_t::invalidate() {
+    program = vao = UNKNOWN;
+    activeUnit = -1;
+    for (auto& texture : textures) texture = UNKNOWN;
+    cullFace = blend = depthTest = rasterizerDiscard = depthWrite = -1;
+    blendSrcRGB = blendDstRGB = blendSrcAlpha = blendDstAlpha = UNKNOWN;
+}
+
+bool gl_state_cache_t::should_issue(bool same, int calls) {
+    requested += calls;
+    if (enabled && same) return false;
+    issued += calls;
+    return true;
+}
+
+void gl_state_cache_t::use_program(shader_program_t* shader) {
+    unsigned int id = shader ? shader->get_program_id() : 0;
+    if (!should_issue(program == id)) return;
+    // use() also finishes a pending async link
+    if (shader) shader->use();
+    else glUseProgram(0);
+    program = id;
+}
+
+void gl_state_cache_t::bind_vertex_array(unsigned int array) {
+    if (!should_issue(vao == array)) return;
+    glBindVertexArray(array);
+    vao = array;
+}
+
+// Inline code selects the unit and binds every time: two calls per request.
+// Texture names are unique across targets, so the name alone tells a change.
+void gl_state_cache_t::bind_texture(int unit, unsigned int target, unsigned int texture) {
+    bool tracked = unit >= 0 && unit < MAX_TEXTURE_UNITS;
+    requested += 2;
+    gpuMemory.touch(texture);
+    if (enabled && tracked && textures[unit] == texture) return;
+    if (!enabled || activeUnit != unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+        issued++;
+    }
+    glBindTexture(target, texture);
+    issued++;
+    if (tracked) textures[unit] = texture;
+}
+
+void gl_state_cache_t::enable(unsigned int cap, bool on) {
+    int* shadow = nullptr;
+    switch (cap) {
+        case GL_CULL_FACE: shadow = &cullFace; break;
+        case GL_BLEND: shadow = &blend; break;
+        case GL_DEPTH_TEST: shadow = &depthTest; break;
+        case GL_RASTERIZER_DISCARD: shadow = &rasterizerDiscard; break;
+    }
+    if (!should_issue(shadow && *shadow == (int)on)) return;
+    if (on) glEnable(cap);
+    else glDisable(cap);
+    if (shadow) *shadow = on;
+}
+
+void gl_state_cache_t::depth_mask(bool write) {
+    if (!should_issue(depthWrite == (int)write)) return;
+    glDepthMask(write ? GL_TRUE : GL_FALSE);
+    depthWrite = write;
+}
+
+void gl_state_cache_t::blend_func(unsigned int src, unsigned int dst) {
+    blend_func_separate(src, dst, src, dst);
+}
+
+void gl_state_cache_t::blend_func_separate(unsigned int srcRGB, unsigned int dstRGB,
+                                           unsigned int srcAlpha, unsigned int dstAlpha) {
+    bool same = blendSrcRGB == srcRGB && blendDstRGB == dstRGB &&
+                blendSrcAlpha == srcAlpha && blendDstAlpha == dstAlpha;
+    if (!should_issue(same)) return;
+    glBlendFuncSeparate(srcRGB, dstRGB, srcAlpha, dstAlpha);
+    blendSrcRGB = srcRGB;
+    blendDstRGB = dstRGB;
+    blendSrcAlpha = srcAlpha;
+    blendDstAlpha = dstAlpha;
+}
+
+void gl_state_cache_t::apply(const render_state_t& state) {
+    enable(GL_CULL_FACE, state.cullFace);
+    enable(GL_BLEND, state.blend);
+    enable(GL_DEPTH_TEST, state.depthTest);
+    enable(GL_RASTERIZER_DISCARD, state.rasterizerDiscard);
+    depth_mask(state.depthWrite);
+    if (!state.blend) return;
+    if (state.blendMode == BLEND_OIT) {
+        // color and weight add up, accumulation alpha multiplies to the revealage
+        blend_func_separate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+    } else {
+        blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
+}
+
+void gl_state_cache_t::draw_elements(unsigned int mode, int count, int instanceCount) {
+    draws++;
+    if (instanceCount == 1) glDrawElements(mode, count, GL_UNSIGNED_INT, 0);
+    else glDrawElementsInstanced(mode, count, GL_UNSIGNED_INT, 0, instanceCount);
+}
+
+void gl_state_cache_t::draw_arrays(unsigned int mode, int first, int count, int instanceCount) {
+    draws++;
+    if (instanceCount == 1) glDrawArrays(mode, first, count);
+    else glDrawArraysInstanced(mode, first, count, instanceCount);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// render_queue_t
+
+void render_queue_t::submit(render_item_t item) {
+    unsigned int program = item.program ? item.program->get_program_id() : 0;
+    item.key = make_sort_key(item.pass, program, item.material, item.texture, item.depth, item.backToFront);
+    items.push_back(std::move(item));
+}
+
+// LSD radix sort of item indices by key, 8 bits per pass. Digits every key
+// shares (most of them with a handful of programs) are skipped.
+void render_queue_t::sort() {
+    size_t n = items.size();
+    order.resize(n);
+    scratch.resize(n);
+    for (size_t i = 0; i < n; i++) order[i] = i;
+
+    uint64_t differs = 0;
+    for (size_t i = 1; i < n; i++) differs |= items[i].key ^ items[0].key;
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        if (((differs >> shift) & 0xFF) == 0) continue;
+
+        size_t count[257] = {0};
+        for (size_t i = 0; i < n; i++) count[((items[order[i]].key >> shift) & 0xFF) + 1]++;
+        for (int b = 0; b < 256; b++) count[b + 1] += count[b];
+        for (size_t i = 0; i < n; i++) scratch[count[(items[order[i]].key >> shift) & 0xFF]++] = order[i];
+        order.swap(scratch);
+    }
+}
+
+void render_queue_t::set_pass_hooks(int pass, std::function<void()> begin, std::function<void()> end) {
+    if (pass < 0 || pass >= MAX_PASSES) return;
+    passBegin[pass] = std::move(begin);
+    passEnd[pass] = std::move(end);
+}
+
+void render_queue_t::run_hook(int pass, bool begin, gl_state_cache_t& cache) {
+    if (pass < 0 || pass >= MAX_PASSES) return;
+    const std::function<void()>& hook = begin ? passBegin[pass] : passEnd[pass];
+    if (!hook) return;
+    hook();
+    cache.invalidate();
+}
+
+void render_queue_t::flush(gl_state_cache_t& cache, gpu_timer_t* timer) {
+    if (items.empty()) return;
+    PROFILE_ZONE("queue flush");
+    sort();
+
+    const char* activeTimer = nullptr;
+    const render_item_t* previous = nullptr;
+    for (uint32_t index : order) {
+        const render_item_t& item = items[index];
+
+        if (!previous || previous->pass != item.pass) {
+            if (previous) run_hook(previous->pass, false, cache);
+            run_hook(item.pass, true, cache);
+        }
+
+        bool timerChanged = (item.timer == nullptr) != (activeTimer == nullptr) ||
+                            (item.timer && std::strcmp(item.timer, activeTimer) != 0);
+        if (timer && timerChanged) {
+            if (activeTimer) timer->end();
+            if (item.timer) timer->begin(item.timer);
+        }
+        activeTimer = item.timer;
+
+        cache.apply(item.state);
+        cache.use_program(item.program);
+        bool rebind = !previous || previous->program != item.program || previous->material != item.material;
+        if (rebind && item.bind) item.bind();
+        item.draw(cache);
+        previous = &item;
+    }
+    run_hook(previous->pass, false, cache);
+    if (timer && activeTimer) timer->end();
+
+    items.clear();
+}
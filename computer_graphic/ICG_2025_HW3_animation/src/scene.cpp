@@ -0,0 +1,322 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+#include "header/scene.h"
+#include "header/animated_model.h"
+#include "header/gpu_memory.h"
+
+// One instance as read from the file, before it is split into columns
+struct scene_row_t {
+    uint16_t asset = 0;
+    uint8_t flags = 0;
+    glm::vec3 position = glm::vec3(0.0f);
+    float yaw = 0.0f;
+    float scale = 1.0f;
+    glm::vec3 orbit = glm::vec3(0.0f);
+};
+
+// Whitespace separated, "double quoted" tokens may hold spaces, # starts a comment
+static std::vector<std::string> tokenize(const std::string& line) {
+    std::vector<std::string> tokens;
+    size_t i = 0;
+    while (i < line.size()) {
+        if (std::isspace((unsigned char)line[i])) {
+            i++;
+        } else if (line[i] == '#') {
+            break;
+        } else if (line[i] == '"') {
+            size_t end = line.find('"', i + 1);
+            if (end == std::string::npos) end = line.size();
+            tokens.push_back(line.substr(i + 1, end - i - 1));
+            i = end + 1;
+        } else {
+            size_t end = i;
+            while (end < line.size() && !std::isspace((unsigned char)line[end])) end++;
+            tokens.push_back(line.substr(i, end - i));
+            i = end;
+        }
+    }
+    return tokens;
+}
+
+static bool parse_float(const std::string& token, float& value) {
+    char* end = nullptr;
+    value = std::strtof(token.c_str(), &end);
+    return end != token.c_str() && *end == '\0';
+}
+
+static bool parse_count(const std::string& token, int& value) {
+    char* end = nullptr;
+    long parsed = std::strtol(token.c_str(), &end, 10);
+    value = (int)parsed;
+    return end != token.c_str() && *end == '\0' && parsed > 0 && parsed <= 100000;
+}
+
+static std::string parse_asset(const std::vector<std::string>& tokens, const std::string& dir,
+                               std::vector<scene_asset_t>& assets) {
+    if (tokens.size() < 3) return "expected asset NAME FILE";
+    for (const scene_asset_t& other : assets) {
+        if (other.name == tokens[1]) return "asset " + tokens[1] + " defined twice";
+    }
+    if (assets.size() >= 65535) return "too many assets";
+    scene_asset_t asset;
+    asset.name = tokens[1];
+    asset.path = dir + tokens[2];
+    for (size_t t = 3; t < tokens.size(); t++) {
+        const std::string& option = tokens[t];
+        bool hasValue = t + 1 < tokens.size();
+        if (option == "white") {
+            asset.whiteTexture = true;
+        } else if (option == "texture" && hasValue) {
+            asset.texture = dir + tokens[++t];
+        } else if (option == "speed" && hasValue) {
+            if (!parse_float(tokens[++t], asset.timeScale)) return "bad speed " + tokens[t];
+        } else if (option == "offset" && hasValue) {
+            if (!parse_float(tokens[++t], asset.timeOffset)) return "bad offset " + tokens[t];
+        } else {
+            return "unknown asset option " + option;
+        }
+    }
+    assets.push_back(asset);
+    return "";
+}
+
+// instance ASSET X Y Z [OPTIONS] or grid ASSET COLUMNS ROWS SPACING X Y Z [OPTIONS]
+static std::string parse_instances(const std::vector<std::string>& tokens, const std::vector<scene_asset_t>& assets,
+                                   std::vector<scene_row_t>& rows) {
+    bool grid = tokens[0] == "grid";
+    size_t first = grid ? 8 : 5;
+    if (tokens.size() < first) {
+        return grid ? "expected grid ASSET COLUMNS ROWS SPACING X Y Z" : "expected instance ASSET X Y Z";
+    }
+
+    scene_row_t row;
+    auto asset = std::find_if(assets.begin(), assets.end(),
+                              [&](const scene_asset_t& a) { return a.name == tokens[1]; });
+    if (asset == assets.end()) return "unknown asset " + tokens[1];
+    row.asset = (uint16_t)(asset - assets.begin());
+
+    int columns = 1, gridRows = 1;
+    float spacing = 0.0f;
+    size_t p = 2;
+    if (grid) {
+        if (!parse_count(tokens[2], columns) || !parse_count(tokens[3], gridRows) || !parse_float(tokens[4], spacing)) {
+            return "bad grid size";
+        }
+        p = 5;
+    }
+    if (!parse_float(tokens[p], row.position.x) || !parse_float(tokens[p + 1], row.position.y) ||
+        !parse_float(tokens[p + 2], row.position.z)) {
+        return "bad position";
+    }
+
+    for (size_t t = first; t < tokens.size(); t++) {
+        const std::string& option = tokens[t];
+        if (option == "intro") row.flags |= SCENE_INTRO;
+        else if (option == "explosion") row.flags |= SCENE_EXPLOSION;
+        else if (option == "finale") row.flags |= SCENE_FINALE;
+        else if (option == "metallic") row.flags |= SCENE_METALLIC;
+        else if (option == "scale" && t + 1 < tokens.size()) {
+            if (!parse_float(tokens[++t], row.scale)) return "bad scale " + tokens[t];
+        } else if (option == "yaw" && t + 1 < tokens.size()) {
+            if (!parse_float(tokens[++t], row.yaw)) return "bad yaw " + tokens[t];
+        } else if (option == "orbit" && t + 3 < tokens.size()) {
+            if (!parse_float(tokens[t + 1], row.orbit.x) || !parse_float(tokens[t + 2], row.orbit.y) ||
+                !parse_float(tokens[t + 3], row.orbit.z)) {
+                return "bad orbit";
+            }
+            t += 3;
+        } else {
+            return "unknown instance option " + option;
+        }
+    }
+    if ((size_t)columns * gridRows + rows.size() > 1000000) return "more than a million instances";
+
+    glm::vec3 center = row.position;
+    for (int r = 0; r < gridRows; r++) {
+        for (int c = 0; c < columns; c++) {
+            row.position = center + glm::vec3((c - (columns - 1) * 0.5f) * spacing, 0.0f,
+                                              (r - (gridRows - 1) * 0.5f) * spacing);
+            rows.push_back(row);
+        }
+    }
+    return "";
+}
+
+bool scene_t::load(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "scene: cannot read " << path << std::endl;
+        return false;
+    }
+    size_t slash = path.find_last_of("/\\");
+    std::string dir = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+
+    std::vector<scene_asset_t> newAssets;
+    std::vector<scene_row_t> rows;
+    std::string line, error;
+    int lineNumber = 0;
+    bool header = false;
+    while (error.empty() && std::getline(file, line)) {
+        lineNumber++;
+        std::vector<std::string> tokens = tokenize(line);
+        if (tokens.empty()) continue;
+        if (!header) {
+            if (tokens.size() != 2 || tokens[0] != "icg-scene" || tokens[1] != "1") error = "expected icg-scene 1";
+            header = true;
+        } else if (tokens[0] == "asset") {
+            error = parse_asset(tokens, dir, newAssets);
+        } else if (tokens[0] == "instance" || tokens[0] == "grid") {
+            error = parse_instances(tokens, newAssets, rows);
+        } else {
+            error = "unknown entry " + tokens[0];
+        }
+    }
+    if (error.empty() && !header) error = "no icg-scene header";
+    if (!error.empty()) {
+        std::cerr << "scene: " << path << ":" << lineNumber << ": " << error << std::endl;
+        return false;
+    }
+
+    // instances of one asset end up next to each other, so they batch
+    std::stable_sort(rows.begin(), rows.end(),
+                     [](const scene_row_t& a, const scene_row_t& b) { return a.asset < b.asset; });
+    assets = std::move(newAssets);
+    size_t count = rows.size();
+    assetIndex.resize(count);
+    flags.resize(count);
+    position.resize(count);
+    yaw.resize(count);
+    scale.resize(count);
+    orbit.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        assetIndex[i] = rows[i].asset;
+        flags[i] = rows[i].flags;
+        position[i] = rows[i].position;
+        yaw[i] = rows[i].yaw;
+        scale[i] = rows[i].scale;
+        orbit[i] = rows[i].orbit;
+    }
+    transform.assign(count, glm::mat4(1.0f));
+    bounds.assign(count, aabb_t());
+    wanted.assign(count, 0);
+    visible.assign(count, 0);
+    occluded.assign(count, 0);
+    impostorBlend.assign(count, 0.0f);
+    std::cout << "scene: " << assets.size() << " assets, " << count << " instances from " << path << std::endl;
+    return true;
+}
+
+void scene_t::load_assets() {
+    for (scene_asset_t& asset : assets) {
+        asset.model = new AnimatedModel(asset.path);
+        AnimatedModel* model = asset.model;
+        if (asset.whiteTexture) {
+            // shaders multiply by the texture color
+            model->texture.create(GL_OBJECT_TEXTURE, GPU_MEMORY_TEXTURES, "white texture");
+            glBindTexture(GL_TEXTURE_2D, model->texture);
+            unsigned char whiteData[] = { 255, 255, 255, 255 };
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, whiteData);
+            model->texture.resize(4, GL_RGBA);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        } else if (model->texture == 0 && !asset.texture.empty()) {
+            model->loadTexture(asset.texture);
+        }
+    }
+}
+
+void scene_t::release_assets() {
+    for (scene_asset_t& asset : assets) {
+        delete asset.model;
+        asset.model = nullptr;
+    }
+}
+
+void scene_t::animate(float time, std::vector<std::vector<glm::mat4>>& palettes, std::vector<aabb_t>& poseBounds) const {
+    palettes.resize(assets.size());
+    poseBounds.resize(assets.size());
+    for (size_t a = 0; a < assets.size(); a++) {
+        assets[a].model->evaluatePose(asset_time(a, time), palettes[a], poseBounds[a]);
+    }
+}
+
+void scene_t::update_transforms(float time) {
+    for (size_t i = 0; i < size(); i++) {
+        glm::vec3 p = position[i];
+        if (orbit[i].x != 0.0f) {
+            float angle = orbit[i].z + time * orbit[i].y;
+            p.x += std::cos(angle) * orbit[i].x;
+            p.z += std::sin(angle) * orbit[i].x;
+        }
+        // translate * rotate about y * uniform scale, written out
+        float c = std::cos(yaw[i]) * scale[i];
+        float s = std::sin(yaw[i]) * scale[i];
+        glm::mat4& m = transform[i];
+        m[0] = glm::vec4(c, 0.0f, -s, 0.0f);
+        m[1] = glm::vec4(0.0f, scale[i], 0.0f, 0.0f);
+        m[2] = glm::vec4(s, 0.0f, c, 0.0f);
+        m[3] = glm::vec4(p, 1.0f);
+    }
+}
+
+void scene_t::select(uint8_t phases) {
+    for (size_t i = 0; i < size(); i++) {
+        wanted[i] = (flags[i] & phases) != 0;
+    }
+}
+
+size_t scene_t::cull(const glm::mat4& viewProjection, bool frustum, float metallicPadding, float crowdPadding,
+                     float crowdRelative) {
+    size_t count = size();
+    for (size_t i = 0; i < count; i++) {
+        if (!wanted[i]) continue;
+        aabb_t box = transform_aabb(model(i)->m_Bounds, transform[i]);
+        if (flags[i] & SCENE_METALLIC) {
+            box.pad(metallicPadding);
+        } else {
+            box.pad(crowdPadding + crowdRelative * glm::length(box.extent()));
+        }
+        bounds[i] = box;
+    }
+
+    if (frustum) {
+        frustum_cull(extract_frustum(viewProjection), bounds.data(), count, visible.data());
+    } else {
+        std::fill(visible.begin(), visible.end(), 1);
+    }
+
+    size_t culled = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!wanted[i]) {
+            visible[i] = 0;
+        } else if (!visible[i]) {
+            culled++;
+        }
+    }
+    return culled;
+}
+
+void scene_t::build_batches(const uint8_t* draw, bool splitCrossfades, frame_vector_t<scene_batch_t>& batches) const {
+    bool open = false;
+    for (uint32_t i = 0; i < (uint32_t)size(); i++) {
+        if (!draw[i]) {
+            open = false;
+            continue;
+        }
+        bool alone = splitCrossfades && impostorBlend[i] > 0.0f;
+        if (open && !alone && batches.back().asset == assetIndex[i]) {
+            batches.back().count++;
+            continue;
+        }
+        batches.push_back({ i, 1, assetIndex[i] });
+        open = !alone;
+    }
+}
@@ -4,16 +4,59 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "header/shader.h"
+#include "header/gpu_memory.h"
+#include "header/instance_buffer.h"
+#include "header/clustered_lighting.h"
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+bool shader_program_t::async_compile = false;
+int shader_program_t::parallel_compile = -1;
+int shader_program_t::resolve_budget = 0;
+int shader_program_t::pending_programs = 0;
 
 shader_program_t::shader_program_t(){
     program_handle = 0;
 }
 
 shader_program_t::~shader_program_t(){
+    if (link_pending) pending_programs--;
+    for(auto shader_handle: shader_handles)
+        glDeleteShader(shader_handle);
+    if (program_handle) {
+        gpuMemory.untrack(GL_OBJECT_PROGRAM, program_handle);
+        glDeleteProgram(program_handle);
+    }
 }
 
 void shader_program_t::create(){
     program_handle = glCreateProgram();
+    gpuMemory.track(GL_OBJECT_PROGRAM, program_handle, GPU_MEMORY_PROGRAMS, "shader program");
+}
+
+// Shared code put after the #version line: the per-instance fetch
+// (instance.glsl) in vertex shaders, shadow and clustered lighting
+// (fragment.glsl) in fragment shaders, read from next to the shader and
+// preceded by defines from the C++ headers. #line keeps the compiler's line
+// numbers those of the file.
+static void add_prelude(const std::string& filepath, const char* prelude, const std::string& defines,
+                        std::string& source){
+    size_t version = source.find("#version");
+    if (version == std::string::npos) return;
+    size_t body = source.find('\n', version);
+    if (body == std::string::npos) return;
+
+    std::string dir = filepath.substr(0, filepath.find_last_of("/\\") + 1);
+    std::ifstream fs(dir + prelude);
+    if (!fs) {
+        std::cout << "missing shader prelude " << dir << prelude << std::endl;
+        return;
+    }
+    std::stringstream ss;
+    ss << defines << fs.rdbuf() << "\n#line 2\n";
+    source.insert(body + 1, ss.str());
 }
 
 void shader_program_t::add_shader(const std::string& filepath, unsigned int type){
@@ -41,12 +84,27 @@ void shader_program_t::add_shader(const std::string& filepath, unsigned int type
         ss << s << "\n";
     }
     std::string temp = ss.str();
+    if (type == GL_VERTEX_SHADER) {
+        add_prelude(filepath, "instance.glsl", "#define INSTANCE_TEXELS " + std::to_string(INSTANCE_TEXELS) + "\n", temp);
+    } else if (type == GL_FRAGMENT_SHADER) {
+        add_prelude(filepath, "fragment.glsl",
+                    "#define CLUSTER_X " + std::to_string(CLUSTER_X) + "\n#define CLUSTER_Y " + std::to_string(CLUSTER_Y) +
+                    "\n#define CLUSTER_Z " + std::to_string(CLUSTER_Z) + "\n#define LIGHT_TEXELS " +
+                    std::to_string(LIGHT_TEXELS) + "\n", temp);
+    }
     const char *source = temp.c_str();
 
     unsigned int shader = glCreateShader(type);
     glShaderSource(shader, 1, &source, NULL);
     glCompileShader(shader);
 
+    // async: querying GL_COMPILE_STATUS here would wait for the compile, so the
+    // check is deferred to finish_link()
+    if (async_compile) {
+        shader_handles.push_back(shader);
+        return;
+    }
+
     int success;
     char infoLog[512];
     glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
@@ -59,14 +117,47 @@ void shader_program_t::add_shader(const std::string& filepath, unsigned int type
     shader_handles.push_back(shader);
 }
 
+void shader_program_t::set_feedback_varyings(const std::vector<const char*>& varyings){
+    feedback_varyings = varyings;
+}
+
 void shader_program_t::link_shader(){
 
     // attach the compiles shader to program 
     for(auto shader_handle: shader_handles){
         glAttachShader(program_handle, shader_handle);
     }
+    if (!feedback_varyings.empty()) {
+        glTransformFeedbackVaryings(program_handle, feedback_varyings.size(),
+                                    feedback_varyings.data(), GL_INTERLEAVED_ATTRIBS);
+    }
     // link the attached shader to program
     glLinkProgram(program_handle);
+
+    if (async_compile) {
+        link_pending = true;
+        pending_programs++;
+        return;
+    }
+    finish_link();
+}
+
+void shader_program_t::finish_link(){
+    if (link_pending) {
+        link_pending = false;
+        pending_programs--;
+    }
+
+    for(auto shader_handle: shader_handles){
+        int compiled = 0;
+        glGetShaderiv(shader_handle, GL_COMPILE_STATUS, &compiled);
+        if (!compiled) {
+            char infoLog[512];
+            glGetShaderInfoLog(shader_handle, 512, NULL, infoLog);
+            std::cout << "ERROR::SHADER::COMPLIATION_FAILED" << infoLog << std::endl;
+        }
+    }
+
     int success = 0;
     glGetProgramiv(program_handle, GL_LINK_STATUS, &success);
 
@@ -79,23 +170,77 @@ void shader_program_t::link_shader(){
         glGetProgramInfoLog(program_handle, maxLength, &maxLength, infoLog);
 
         // We don't need the program anymore.
+        gpuMemory.untrack(GL_OBJECT_PROGRAM, program_handle);
         glDeleteProgram(program_handle);
+        program_handle = 0;
         
         // Don't leak shaders either.
         for(auto shader_handle: shader_handles)
             glDeleteShader(shader_handle);
+        shader_handles.clear();
 
         puts(infoLog);
         free(infoLog);
+        link_failed = true;
+        return;
     }
     
-    // detach the shader once linked
+    // detach the shader once linked, the program no longer needs them
     for(auto shader_handle: shader_handles){
         glDetachShader(program_handle, shader_handle);
+        glDeleteShader(shader_handle);
+    }
+    shader_handles.clear();
+}
+
+void shader_program_t::set_async_compile(bool enable){
+    async_compile = enable;
+}
+
+bool shader_program_t::has_parallel_compile(){
+    if (parallel_compile < 0) {
+        parallel_compile = 0;
+        int count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (int i = 0; i < count; i++) {
+            const char* ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (ext && (strcmp(ext, "GL_KHR_parallel_shader_compile") == 0 ||
+                        strcmp(ext, "GL_ARB_parallel_shader_compile") == 0)) {
+                parallel_compile = 1;
+                break;
+            }
+        }
     }
+    return parallel_compile == 1;
+}
+
+void shader_program_t::new_frame(int blocking_resolve_budget){
+    resolve_budget = blocking_resolve_budget;
+}
+
+bool shader_program_t::is_ready(){
+    if (link_pending) {
+        if (has_parallel_compile()) {
+            // non-blocking poll, the driver compiles on its own threads
+            int done = 0;
+            glGetProgramiv(program_handle, GL_COMPLETION_STATUS_KHR, &done);
+            if (!done) return false;
+        } else {
+            // no completion query: resolving blocks, so spread it over frames
+            if (resolve_budget <= 0) return false;
+            resolve_budget--;
+        }
+        finish_link();
+    }
+    return !link_failed;
+}
+
+void shader_program_t::wait(){
+    if (link_pending) finish_link();
 }
 
 void shader_program_t::use(){
+    if (link_pending) finish_link();
     glUseProgram(program_handle);
 }
 
@@ -119,6 +264,11 @@ void shader_program_t::set_uniform_value(const char* name, const glm::vec3& vec)
 
 }
 
+void shader_program_t::set_uniform_value(const char* name, const glm::vec2& vec){
+    unsigned int loc = glGetUniformLocation(program_handle, name);
+    glUniform2f(loc, vec.x, vec.y);
+}
+
 void shader_program_t::set_uniform_value(const char* name, const float value){
     unsigned int loc = glGetUniformLocation(program_handle, name);
     glUniform1f(loc, value);
@@ -10,9 +10,7 @@ const int MAX_BONE_INFLUENCE = 4;
 
 uniform mat4 finalBonesMatrices[MAX_BONES];
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+Instance inst;
 
 out VS_OUT {
     vec3 FragPos;
@@ -22,6 +20,8 @@ out VS_OUT {
 
 void main()
 {
+    inst = FetchInstance(instanceBase + gl_InstanceID);
+
     vec4 totalPosition = vec4(0.0f);
     
     for(int i = 0 ; i < MAX_BONE_INFLUENCE ; i++)
@@ -41,7 +41,7 @@ void main()
     if(length(totalPosition) == 0.0)
     {
         totalPosition = vec4(aPos, 1.0f);
-        vs_out.Normal = mat3(transpose(inverse(model))) * aNormal;
+        vs_out.Normal = inst.normalMatrix * aNormal;
     } else {
         // Approximate normal for dynamic mesh (since we don't have bone matrices for normals handy in this simple shader)
         // or just pass transformed aNormal. Ideally we'd accumulate bone normals.
@@ -54,12 +54,12 @@ void main()
             vec3 localNormal = mat3(finalBonesMatrices[aBoneIDs[i]]) * aNormal;
             totalNormal += localNormal * aWeights[i];
         }
-        vs_out.Normal = mat3(transpose(inverse(model))) * totalNormal;
+        vs_out.Normal = inst.normalMatrix * totalNormal;
     }
 
     // Use totalPosition as vertex's input pos (aPos)
-    gl_Position = projection * view * model * totalPosition;
+    gl_Position = inst.mvp * totalPosition;
     
-    vs_out.FragPos = vec3(model * totalPosition);
+    vs_out.FragPos = vec3(inst.model * totalPosition);
     vs_out.TexCoord = aTexCoord;
 }
@@ -10,14 +10,14 @@ const int MAX_BONE_INFLUENCE = 4;
 
 uniform mat4 finalBonesMatrices[MAX_BONES];
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+Instance inst;
 
 out vec3 FragPos;
 out vec3 Normal;
 
 void main() {
+    inst = FetchInstance(instanceBase + gl_InstanceID);
+
     vec4 totalPosition = vec4(0.0f);
     vec3 totalNormal = vec3(0.0f);
     
@@ -44,8 +44,8 @@ void main() {
         totalNormal = aNormal;
     }
 
-    vec4 worldPos = model * totalPosition;
+    vec4 worldPos = inst.model * totalPosition;
     FragPos = worldPos.xyz;
-    Normal = normalize(mat3(model) * totalNormal);
-    gl_Position = projection * view * worldPos;
+    Normal = normalize(inst.normalMatrix * totalNormal);
+    gl_Position = inst.mvp * totalPosition;
 }
@@ -11,9 +11,7 @@ const int MAX_BONE_INFLUENCE = 4;
 
 uniform mat4 finalBonesMatrices[MAX_BONES];
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+Instance inst;
 
 struct Light {
     vec3 position;
@@ -40,6 +38,8 @@ out VS_OUT {
 
 void main()
 {
+    inst = FetchInstance(instanceBase + gl_InstanceID);
+
     vec4 totalPosition = vec4(0.0f);
     vec3 totalNormal = vec3(0.0f);
     
@@ -66,8 +66,8 @@ void main()
         totalNormal = aNormal;
     }
 
-    vec4 worldPos = model * totalPosition;
-    vec3 norm = normalize(mat3(model) * totalNormal);
+    vec4 worldPos = inst.model * totalPosition;
+    vec3 norm = normalize(inst.normalMatrix * totalNormal);
     vec3 lightDir = normalize(light.position - worldPos.xyz);
     vec3 viewDir = normalize(viewPos - worldPos.xyz);
     vec3 halfDir = normalize(lightDir + viewDir);
@@ -79,7 +79,7 @@ void main()
     vec3 diffuse = light.diffuse * material.diffuse * diff;
     vec3 specular = light.specular * material.specular * spec;
 
-    gl_Position = projection * view * worldPos;
+    gl_Position = inst.mvp * totalPosition;
     vs_out.Color = ambient + diffuse + specular;
     vs_out.TexCoord = aTexCoord;
 }
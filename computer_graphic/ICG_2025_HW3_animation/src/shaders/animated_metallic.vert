@@ -10,9 +10,7 @@ const int MAX_BONE_INFLUENCE = 4;
 
 uniform mat4 finalBonesMatrices[MAX_BONES];
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+Instance inst;
 
 out VS_OUT {
     vec3 FragPos;
@@ -21,6 +19,8 @@ out VS_OUT {
 } vs_out;
 
 void main() {
+    inst = FetchInstance(instanceBase + gl_InstanceID);
+
     vec4 totalPosition = vec4(0.0f);
     vec3 totalNormal = vec3(0.0f);
     
@@ -47,9 +47,9 @@ void main() {
         totalNormal = aNormal;
     }
     
-    vec4 worldPos = model * totalPosition;
+    vec4 worldPos = inst.model * totalPosition;
     vs_out.FragPos = worldPos.xyz;
-    vs_out.Normal = mat3(model) * totalNormal;
+    vs_out.Normal = inst.normalMatrix * totalNormal;
     vs_out.TexCoord = aTexCoord;
-    gl_Position = projection * view * worldPos;
+    gl_Position = inst.mvp * totalPosition;
 }
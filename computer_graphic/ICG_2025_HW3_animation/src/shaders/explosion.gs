@@ -15,8 +15,7 @@ out VS_OUT {
 } gs_out;
 
 uniform float magnitude; // Explosion magnitude (time)
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat4 viewProjection;
 
 vec3 GetNormal()
 {
@@ -40,7 +39,7 @@ void main() {
 
     for(int i = 0; i < 3; i++) {
         vec3 newPos = gs_in[i].FragPos + offset;
-        gl_Position = projection * view * vec4(newPos, 1.0);
+        gl_Position = viewProjection * vec4(newPos, 1.0);
         
         // Pass to fragment shader
         gs_out.FragPos = newPos;
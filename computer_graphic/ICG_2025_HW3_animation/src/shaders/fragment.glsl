@@ -0,0 +1,71 @@
+// Dithering, shadow and lighting shared by the fragment shaders, put after
+// the #version line of every fragment shader by shader_program_t::add_shader,
+// which also defines CLUSTER_X/Y/Z and LIGHT_TEXELS from clustered_lighting.h.
+
+// Ordered 4x4 dither threshold for the impostor crossfade: toon.frag discards
+// the pixels below impostorBlend and impostor.frag the rest, so the two only
+// add up to one surface with the same threshold
+float bayer4(vec2 p)
+{
+    ivec2 i = ivec2(mod(p, 4.0));
+    const float m[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0,
+                                  3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    return (m[i.y * 4 + i.x] + 0.5) / 16.0;
+}
+
+// Sun shadow (shadow_map.h): hardware 2x2 PCF at four offsets
+uniform sampler2DShadow shadowMap;
+uniform mat4 lightViewProjection;
+uniform bool shadowsEnabled;
+
+float sunShadow(vec3 worldPos, vec3 norm, vec3 lightDir)
+{
+    if (!shadowsEnabled) return 1.0;
+    // orthographic light, w is 1
+    vec3 p = (lightViewProjection * vec4(worldPos, 1.0)).xyz * 0.5 + 0.5;
+    if (p.z > 1.0) return 1.0;
+    float bias = max(0.002 * (1.0 - dot(norm, lightDir)), 0.0005);
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0));
+    float lit = texture(shadowMap, vec3(p.xy + vec2(-1.0, -1.0) * texel, p.z - bias));
+    lit += texture(shadowMap, vec3(p.xy + vec2(1.0, -1.0) * texel, p.z - bias));
+    lit += texture(shadowMap, vec3(p.xy + vec2(-1.0, 1.0) * texel, p.z - bias));
+    lit += texture(shadowMap, vec3(p.xy + vec2(1.0, 1.0) * texel, p.z - bias));
+    return lit * 0.25;
+}
+
+// Clustered lights (clustered_lighting.h): each fragment only walks the light
+// list of the view-space cluster it falls in
+uniform samplerBuffer  lightData;    // (position, radius) (color, cosOuter) (direction, cosInner)
+uniform usamplerBuffer clusterData;  // (first index, count)
+uniform usamplerBuffer lightIndices;
+uniform mat4 clusterView;
+uniform vec2 clusterScreen;          // framebuffer size
+uniform vec2 clusterDepth;           // near plane, CLUSTER_Z / log(far / near)
+
+uvec2 clusterLights(vec3 worldPos)
+{
+    float depth = -(clusterView * vec4(worldPos, 1.0)).z;
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / clusterScreen * vec2(CLUSTER_X, CLUSTER_Y)),
+                       ivec2(0), ivec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+    int slice = clamp(int(floor(log(max(depth, clusterDepth.x) / clusterDepth.x) * clusterDepth.y)), 0, CLUSTER_Z - 1);
+    return texelFetch(clusterData, (slice * CLUSTER_Y + tile.y) * CLUSTER_X + tile.x).rg;
+}
+
+// Radiance of one light at worldPos and the direction towards it
+vec3 clusterLight(uint index, vec3 worldPos, out vec3 lightDir)
+{
+    int base = int(index) * LIGHT_TEXELS;
+    vec4 positionRadius = texelFetch(lightData, base);
+    vec4 colorOuter = texelFetch(lightData, base + 1);
+    vec4 directionInner = texelFetch(lightData, base + 2);
+
+    vec3 toLight = positionRadius.xyz - worldPos;
+    float dist = length(toLight);
+    lightDir = toLight / max(dist, 1e-4);
+    float falloff = clamp(1.0 - dist * dist / (positionRadius.w * positionRadius.w), 0.0, 1.0);
+    falloff *= falloff;
+    if (colorOuter.w >= -1.0) {
+        falloff *= smoothstep(colorOuter.w, directionInner.w, dot(-lightDir, directionInner.xyz));
+    }
+    return colorOuter.rgb * falloff;
+}
@@ -0,0 +1,51 @@
+#version 330 core
+// Vertex-stage version of explosion.gs. Drawn from the de-indexed face stream:
+// every corner knows the three vertices of its triangle and fetches their
+// skinned positions from the post-skin buffer, so the face normal is the same
+// one the geometry shader computed.
+layout (location = 0) in ivec4 aFace;     // xyz = triangle vertex indices, w = this corner
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in float aFaceSeed; // triangle index (gl_PrimitiveIDIn of the GS)
+
+uniform samplerBuffer skinnedVertices;   // texel 2i = position, 2i+1 = normal
+
+uniform float magnitude; // Explosion magnitude (time)
+uniform mat4 viewProjection;
+
+// only the model and normal matrix, the vertices are placed in world space
+mat4 model;
+mat3 normalMatrix;
+
+out VS_OUT {
+    vec3 FragPos;
+    vec3 Normal;
+    vec2 TexCoord;
+} vs_out;
+
+vec3 WorldPos(int index)
+{
+    return vec3(model * texelFetch(skinnedVertices, 2 * index));
+}
+
+void main()
+{
+    model = FetchInstanceModel(instanceBase + gl_InstanceID);
+    normalMatrix = FetchInstanceNormal(instanceBase + gl_InstanceID);
+
+    int self = aFace[aFace.w];
+    vec3 worldPos = WorldPos(self);
+    vec3 offset = vec3(0.0);
+
+    // If magnitude is 0 (Flair), skip normal calculation to avoid NaNs from degenerate triangles.
+    if (magnitude != 0.0) {
+        vec3 a = WorldPos(aFace.x) - WorldPos(aFace.y);
+        vec3 b = WorldPos(aFace.z) - WorldPos(aFace.y);
+        offset = normalize(cross(a, b)) * magnitude * 20.0 * (-1.0);
+    }
+
+    vec3 newPos = worldPos + offset;
+    gl_Position = viewProjection * vec4(newPos, 1.0);
+    vs_out.FragPos = newPos;
+    vs_out.Normal = normalize(normalMatrix * texelFetch(skinnedVertices, 2 * self + 1).xyz);
+    vs_out.TexCoord = aTexCoord;
+}
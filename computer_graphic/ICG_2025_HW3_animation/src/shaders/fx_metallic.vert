@@ -0,0 +1,61 @@
+#version 330 core
+// Vertex-stage version of metallic.gs, drawn from the de-indexed face stream
+// (see fx_explosion.vert). Like metallic.gs the surface and the aura are
+// separate draws, in separate passes: layer 0 is the metal surface, layer 1
+// the aura.
+layout (location = 0) in ivec4 aFace;     // xyz = triangle vertex indices, w = this corner
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in float aFaceSeed;
+
+uniform samplerBuffer skinnedVertices;   // texel 2i = position, 2i+1 = normal
+
+uniform float time;
+uniform float magnitude;
+uniform int layer;
+uniform mat4 viewProjection;
+
+// only the model and normal matrix, the vertices are placed in world space
+mat4 model;
+mat3 normalMatrix;
+
+out VS_OUT {
+    vec3 FragPos;
+    vec3 Normal;
+    vec2 TexCoord;
+} vs_out;
+
+out float isAura;
+
+vec3 WorldPos(int index)
+{
+    return vec3(model * texelFetch(skinnedVertices, 2 * index));
+}
+
+void main()
+{
+    model = FetchInstanceModel(instanceBase);
+    normalMatrix = FetchInstanceNormal(instanceBase);
+
+    int self = aFace[aFace.w];
+    vec3 p0 = WorldPos(aFace.x);
+    vec3 faceNormal = normalize(cross(WorldPos(aFace.y) - p0, WorldPos(aFace.z) - p0));
+
+    vec3 baseExplosionOffset = faceNormal * magnitude * 20.0;
+    vec3 newPos = WorldPos(self);
+    bool aura = layer == 1;
+
+    if (aura) {
+        // Aura explodes 1.5x further than base and floats off the surface
+        float auraOffsetDist = 0.5 + sin(time * 3.0) * 1.0;
+        newPos += baseExplosionOffset * 1.5 + faceNormal * auraOffsetDist;
+        vs_out.Normal = faceNormal;
+    } else {
+        newPos += baseExplosionOffset;
+        vs_out.Normal = normalMatrix * texelFetch(skinnedVertices, 2 * self + 1).xyz;
+    }
+
+    gl_Position = viewProjection * vec4(newPos, 1.0);
+    vs_out.FragPos = newPos;
+    vs_out.TexCoord = aTexCoord;
+    isAura = aura ? 1.0 : 0.0;
+}
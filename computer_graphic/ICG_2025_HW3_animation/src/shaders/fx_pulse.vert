@@ -0,0 +1,43 @@
+#version 330 core
+// Vertex-stage version of pulse.gs, drawn from the de-indexed face stream
+// (see fx_explosion.vert). Each triangle scales around its own centroid.
+layout (location = 0) in ivec4 aFace;     // xyz = triangle vertex indices, w = this corner
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in float aFaceSeed; // triangle index (gl_PrimitiveIDIn of the GS)
+
+uniform samplerBuffer skinnedVertices;   // texel 2i = position, 2i+1 = normal
+
+uniform float time;
+uniform mat4 viewProjection;
+
+// only the model and normal matrix, the vertices are placed in world space
+mat4 model;
+mat3 normalMatrix;
+
+out VS_OUT {
+    vec3 FragPos;
+    vec3 Normal;
+    vec2 TexCoord;
+} vs_out;
+
+vec3 WorldPos(int index)
+{
+    return vec3(model * texelFetch(skinnedVertices, 2 * index));
+}
+
+void main()
+{
+    model = FetchInstanceModel(instanceBase + gl_InstanceID);
+    normalMatrix = FetchInstanceNormal(instanceBase + gl_InstanceID);
+
+    int self = aFace[aFace.w];
+    vec3 center = (WorldPos(aFace.x) + WorldPos(aFace.y) + WorldPos(aFace.z)) / 3.0;
+    float wobble = sin(time * 3.0 + aFaceSeed * 0.07);
+    float scale = 1.0 + 0.15 * wobble;
+
+    vec3 newPos = center + (WorldPos(self) - center) * scale;
+    gl_Position = viewProjection * vec4(newPos, 1.0);
+    vs_out.FragPos = newPos;
+    vs_out.Normal = normalize(normalMatrix * texelFetch(skinnedVertices, 2 * self + 1).xyz);
+    vs_out.TexCoord = aTexCoord;
+}
@@ -1,11 +1,19 @@
 #version 330 core
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out float OitWeight; // only written to in the OIT pass
 
 in vec3 FragPos;
 in vec3 Normal;
 
 uniform vec3 viewPos;
 uniform samplerCube skybox;
+uniform bool oitPass;
+
+float oitWeight(float a)
+{
+    float z = 1.0 - gl_FragCoord.z;
+    return clamp(a * max(1e-2, 3e3 * z * z * z), 1e-2, 3e3);
+}
 
 void main()
 {
@@ -24,5 +32,14 @@ void main()
     vec4 refractColor = texture(skybox, R_refract);
     vec4 reflectColor = texture(skybox, R_reflect);
 
-    FragColor = mix(refractColor, reflectColor, fresnel);
+    vec4 color = mix(refractColor, reflectColor, fresnel);
+    if (oitPass) {
+        // see-through at normal incidence, mirror-like at grazing angles
+        float a = mix(0.25, 1.0, fresnel);
+        float w = oitWeight(a);
+        FragColor = vec4(color.rgb * a * w, a);
+        OitWeight = a * w;
+    } else {
+        FragColor = color;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,22 @@
+#version 330 core
+// One level of the Hi-Z pyramid: each texel keeps the farthest depth of the
+// 2x2 source texels it covers. Levels are ceil(size / 2), so the last row or
+// column of an odd sized source is clamped onto and nothing is skipped.
+out float maxDepth;
+
+// Depth buffer copy for level 0, else the pyramid with its base level set to
+// the previous level, so the level being written is never sampled
+uniform sampler2D source;
+uniform ivec2 sourceSize;
+
+void main()
+{
+    ivec2 base = ivec2(gl_FragCoord.xy) * 2;
+    ivec2 last = sourceSize - 1;
+
+    float d = texelFetch(source, min(base, last), 0).r;
+    d = max(d, texelFetch(source, min(base + ivec2(1, 0), last), 0).r);
+    d = max(d, texelFetch(source, min(base + ivec2(0, 1), last), 0).r);
+    d = max(d, texelFetch(source, min(base + ivec2(1, 1), last), 0).r);
+    maxDepth = d;
+}
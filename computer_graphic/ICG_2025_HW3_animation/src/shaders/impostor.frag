@@ -0,0 +1,52 @@
+#version 330 core
+// Octahedral impostor: bilinear blend of the four baked views around the view
+// direction, for the two animation frames around the current time
+out vec4 FragColor;
+
+in vec2 quadUV;
+flat in vec3 viewDirection;
+
+uniform sampler2DArray atlas;
+uniform int frame0;
+uniform int frame1;
+uniform float frameBlend;
+uniform float impostorBlend; // share of the crossfade drawn by the impostor
+
+const int VIEWS = 8;         // IMPOSTOR_VIEWS
+
+// impostor_encode() in impostor.cpp
+vec2 octEncode(vec3 d)
+{
+    vec3 p = d / (abs(d.x) + abs(d.y) + abs(d.z));
+    vec2 e = p.xz;
+    if (p.y < 0.0) {
+        vec2 s = vec2(p.x >= 0.0 ? 1.0 : -1.0, p.z >= 0.0 ? 1.0 : -1.0);
+        e = (1.0 - abs(p.zx)) * s;
+    }
+    return e * 0.5 + 0.5;
+}
+
+vec4 sampleCell(ivec2 cell)
+{
+    cell = clamp(cell, ivec2(0), ivec2(VIEWS - 1));
+    vec2 uv = (vec2(cell) + quadUV) / float(VIEWS);
+    return mix(texture(atlas, vec3(uv, float(frame0))), texture(atlas, vec3(uv, float(frame1))), frameBlend);
+}
+
+void main()
+{
+    // the mesh draws the pixels this one leaves out (toon.frag)
+    if (bayer4(gl_FragCoord.xy) >= impostorBlend) discard;
+
+    vec2 grid = octEncode(normalize(viewDirection)) * float(VIEWS) - 0.5;
+    ivec2 base = ivec2(floor(grid));
+    vec2 f = grid - vec2(base);
+
+    vec4 color = sampleCell(base) * (1.0 - f.x) * (1.0 - f.y)
+               + sampleCell(base + ivec2(1, 0)) * f.x * (1.0 - f.y)
+               + sampleCell(base + ivec2(0, 1)) * (1.0 - f.x) * f.y
+               + sampleCell(base + ivec2(1, 1)) * f.x * f.y;
+    if (color.a < 0.5) discard;
+
+    FragColor = vec4(color.rgb / color.a, 1.0);
+}
@@ -0,0 +1,30 @@
+#version 330 core
+// Camera-facing quad over an instance's bounding sphere, four vertices as a
+// triangle strip from gl_VertexID (no vertex buffer)
+uniform mat4 model;
+uniform mat4 viewProjection;
+uniform vec3 viewPos;
+uniform vec3 boundsCenter;   // model space
+uniform float boundsRadius;
+
+out vec2 quadUV;
+flat out vec3 viewDirection; // towards the camera, model space
+
+void main()
+{
+    vec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1)) * 2.0 - 1.0;
+
+    vec3 center = (model * vec4(boundsCenter, 1.0)).xyz;
+    float radius = boundsRadius * length(model[0].xyz);
+    vec3 toCamera = normalize(viewPos - center);
+
+    // same basis as glm::lookAt in the bake (impostor_up in impostor.cpp)
+    vec3 up = abs(toCamera.y) > 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(0.0, 1.0, 0.0);
+    vec3 right = normalize(cross(-toCamera, up));
+    vec3 quadUp = cross(right, -toCamera);
+
+    gl_Position = viewProjection * vec4(center + (right * corner.x + quadUp * corner.y) * radius, 1.0);
+    quadUV = corner * 0.5 + 0.5;
+    // rotation and uniform scale only, the transpose undoes the rotation
+    viewDirection = normalize(transpose(mat3(model)) * toCamera);
+}
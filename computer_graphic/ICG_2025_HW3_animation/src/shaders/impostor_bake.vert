@@ -0,0 +1,49 @@
+#version 330 core
+// animated_default.vert for the impostor bake: one character at the origin of
+// its own space, viewed by the orthographic camera of the current atlas cell
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoord;
+layout (location = 3) in ivec4 aBoneIDs;
+layout (location = 4) in vec4 aWeights;
+
+const int MAX_BONES = 200;
+const int MAX_BONE_INFLUENCE = 4;
+
+uniform mat4 finalBonesMatrices[MAX_BONES];
+uniform mat4 viewProjection;
+
+out VS_OUT {
+    vec3 FragPos;
+    vec3 Normal;
+    vec2 TexCoord;
+} vs_out;
+
+void main()
+{
+    vec4 totalPosition = vec4(0.0);
+    vec3 totalNormal = vec3(0.0);
+    for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+    {
+        if (aBoneIDs[i] == -1)
+            continue;
+        if (aBoneIDs[i] >= MAX_BONES)
+        {
+            totalPosition = vec4(aPos, 1.0);
+            totalNormal = aNormal;
+            break;
+        }
+        totalPosition += finalBonesMatrices[aBoneIDs[i]] * vec4(aPos, 1.0) * aWeights[i];
+        totalNormal += mat3(finalBonesMatrices[aBoneIDs[i]]) * aNormal * aWeights[i];
+    }
+    if (length(totalPosition) == 0.0)
+    {
+        totalPosition = vec4(aPos, 1.0);
+        totalNormal = aNormal;
+    }
+
+    gl_Position = viewProjection * totalPosition;
+    vs_out.FragPos = totalPosition.xyz;
+    vs_out.Normal = totalNormal;
+    vs_out.TexCoord = aTexCoord;
+}
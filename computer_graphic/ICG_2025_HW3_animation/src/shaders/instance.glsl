@@ -0,0 +1,43 @@
+// Per-instance matrices computed once per instance on the CPU
+// (instance_buffer.cpp): INSTANCE_TEXELS RGBA32F texels per instance, model
+// in 0-3, mvp in 4-7, normal matrix in 8-10. Put after the #version line of
+// every vertex shader by shader_program_t::add_shader, which also defines
+// INSTANCE_TEXELS from instance_buffer.h.
+uniform samplerBuffer instanceData;
+uniform int instanceBase;
+
+struct Instance {
+    mat4 model;
+    mat4 mvp;
+    mat3 normalMatrix;
+};
+
+mat4 FetchInstanceModel(int index)
+{
+    int t = index * INSTANCE_TEXELS;
+    return mat4(texelFetch(instanceData, t), texelFetch(instanceData, t + 1),
+                texelFetch(instanceData, t + 2), texelFetch(instanceData, t + 3));
+}
+
+mat4 FetchInstanceMvp(int index)
+{
+    int t = index * INSTANCE_TEXELS + 4;
+    return mat4(texelFetch(instanceData, t), texelFetch(instanceData, t + 1),
+                texelFetch(instanceData, t + 2), texelFetch(instanceData, t + 3));
+}
+
+mat3 FetchInstanceNormal(int index)
+{
+    int t = index * INSTANCE_TEXELS + 8;
+    return mat3(texelFetch(instanceData, t).xyz, texelFetch(instanceData, t + 1).xyz,
+                texelFetch(instanceData, t + 2).xyz);
+}
+
+Instance FetchInstance(int index)
+{
+    Instance inst;
+    inst.model = FetchInstanceModel(index);
+    inst.mvp = FetchInstanceMvp(index);
+    inst.normalMatrix = FetchInstanceNormal(index);
+    return inst;
+}
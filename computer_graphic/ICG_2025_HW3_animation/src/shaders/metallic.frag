@@ -1,5 +1,6 @@
 #version 330 core
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out float OitWeight; // only written to in the OIT pass
 
 in VS_OUT {
     vec3 FragPos;
@@ -33,13 +34,24 @@ uniform float bias;            // 0.2
 uniform float alpha;           // 0.4
 uniform float lightIntensity;  // 1.0
 
+// Weighted blended OIT: premultiplied, depth weighted color into target 0
+// and the weight into target 1 instead of a plain alpha blended color. Only
+// the aura is blended, the surface is opaque either way.
+uniform bool auraOIT;
+
+float oitWeight(float a)
+{
+    float z = 1.0 - gl_FragCoord.z;
+    return clamp(a * max(1e-2, 3e3 * z * z * z), 1e-2, 3e3);
+}
+
 void main() 
 {
     vec3 norm = normalize(fs_in.Normal);
     vec3 viewDir = normalize(viewPos - fs_in.FragPos);
     vec3 lightDir = normalize(light.position - fs_in.FragPos);
 
-    float diff = max(dot(norm, lightDir), 0.0);
+    float diff = max(dot(norm, lightDir), 0.0) * sunShadow(fs_in.FragPos, norm, lightDir);
 
     // No albedo/texture contribution for metallic mode
     vec3 ambient = light.ambient * material.ambient * 0.3; // keep base light subtle
@@ -59,6 +71,16 @@ void main()
     float reflectWeight = clamp(F0 + fresnelScale * pow(1.0 - cosTheta, fresnelPower), 0.0, 1.0);
 
     vec3 finalColor = mix(ambient + diffuse, envColor, reflectWeight);
+
+    // clustered lights: the same weak diffuse plus a sharp highlight on the metal
+    uvec2 range = clusterLights(fs_in.FragPos);
+    for (uint i = 0u; i < range.y; i++) {
+        vec3 L;
+        vec3 radiance = lightIntensity * clusterLight(texelFetch(lightIndices, int(range.x + i)).r, fs_in.FragPos, L);
+        float d = max(dot(norm, L), 0.0);
+        float s = d > 0.0 ? pow(max(dot(norm, normalize(L + viewDir)), 0.0), material.gloss) : 0.0;
+        finalColor += radiance * (material.diffuse * d * diffuseWeight + material.specular * s);
+    }
     
     // Aura Handling
     float finalAlpha = 1.0; // Default to Solid for Base
@@ -68,5 +90,11 @@ void main()
         finalAlpha = 0.3; 
     }
 
-    FragColor = vec4(finalColor, finalAlpha);
+    if (auraOIT && isAura > 0.5) {
+        float w = oitWeight(finalAlpha);
+        FragColor = vec4(finalColor * finalAlpha * w, finalAlpha);
+        OitWeight = finalAlpha * w;
+    } else {
+        FragColor = vec4(finalColor, finalAlpha);
+    }
 } 
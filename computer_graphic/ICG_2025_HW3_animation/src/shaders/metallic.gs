@@ -1,6 +1,6 @@
 #version 330 core
 layout (triangles) in;
-layout (triangle_strip, max_vertices = 6) out;
+layout (triangle_strip, max_vertices = 3) out;
 
 // Data from vertex shader
 in VS_OUT {
@@ -19,10 +19,12 @@ out VS_OUT {
 out float isAura;
 
 uniform float time;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat4 viewProjection;
 uniform float magnitude;
 uniform vec3 viewPos; 
+// The surface and the aura are separate passes with their own blend/depth
+// state, so each draw emits one of them: 0 = metal surface, 1 = aura
+uniform int layer;
 
 // Face normal computed in world space
 vec3 GetFaceNormal() {
@@ -37,19 +39,22 @@ void main() {
     // Calculate Explosion Offset for Base Geometry
     vec3 baseExplosionOffset = faceNormal * magnitude * 20.0; 
 
-    // Base geometry (metal surface)
-    isAura = 0.0;
-    for(int i = 0; i < 3; i++) {
-        vec3 explodedPos = gs_in[i].FragPos + baseExplosionOffset;
-        
-        gs_out.FragPos = explodedPos;
-        gs_out.Normal = gs_in[i].Normal; 
-        gs_out.TexCoord = gs_in[i].TexCoord;
-        
-        gl_Position = projection * view * vec4(explodedPos, 1.0);
-        EmitVertex();
+    if (layer == 0) {
+        // Base geometry (metal surface)
+        isAura = 0.0;
+        for(int i = 0; i < 3; i++) {
+            vec3 explodedPos = gs_in[i].FragPos + baseExplosionOffset;
+            
+            gs_out.FragPos = explodedPos;
+            gs_out.Normal = gs_in[i].Normal; 
+            gs_out.TexCoord = gs_in[i].TexCoord;
+            
+            gl_Position = viewProjection * vec4(explodedPos, 1.0);
+            EmitVertex();
+        }
+        EndPrimitive();
+        return;
     }
-    EndPrimitive();
 
     // Aura Effect - Make it explode faster/further!
     isAura = 1.0;
@@ -66,7 +71,7 @@ void main() {
         gs_out.Normal = faceNormal;
         gs_out.TexCoord = gs_in[i].TexCoord;
 
-        gl_Position = projection * view * vec4(finalPos, 1.0);
+        gl_Position = viewProjection * vec4(finalPos, 1.0);
         EmitVertex();
     }
     EndPrimitive();
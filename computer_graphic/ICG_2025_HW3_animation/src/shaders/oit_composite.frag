@@ -0,0 +1,19 @@
+#version 330 core
+// Resolve of the weighted blended OIT targets over the opaque image
+// (McGuire & Bavoil 2013). Blended with SRC_ALPHA / ONE_MINUS_SRC_ALPHA.
+out vec4 FragColor;
+
+uniform sampler2D accumulation; // rgb = sum(color * a * w), a = prod(1 - a)
+uniform sampler2D weights;      // r = sum(a * w)
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    vec4 accum = texelFetch(accumulation, texel, 0);
+    float revealage = accum.a;
+    if (revealage >= 1.0) discard; // nothing transparent here
+
+    float weightSum = texelFetch(weights, texel, 0).r;
+    vec3 average = accum.rgb / max(weightSum, 1e-5);
+    FragColor = vec4(average, 1.0 - revealage);
+}
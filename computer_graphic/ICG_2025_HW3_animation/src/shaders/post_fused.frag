@@ -0,0 +1,64 @@
+#version 330 core
+// Per-pixel post effects fused into one full-screen pass. Each stage runs
+// when its bit is set in stages (POST_* in post_process.h), in this order.
+out vec4 FragColor;
+
+uniform sampler2D source;  // HDR scene or the previous pass
+uniform int stages;
+
+// tone mapping
+uniform float exposure;     // 1.0
+uniform float toneKnee;     // 0.8, below it colors pass through unchanged
+
+// color grading
+uniform float saturation;   // 1.0
+uniform float contrast;     // 1.0
+uniform vec3 gain;          // vec3(1.0)
+
+// vignette
+uniform float vignetteStrength; // 0.0 - 1.0
+uniform float vignetteRadius;   // distance from the center where darkening starts
+
+// fade to black (scene transitions)
+uniform float fade;
+
+const int POST_TONEMAP = 1;
+const int POST_GRADE = 2;
+const int POST_VIGNETTE = 4;
+const int POST_FADE = 8;
+
+// Linear up to the knee so the LDR look of the scene is kept, highlights above
+// it roll off towards 1 instead of clipping
+vec3 tonemap(vec3 color)
+{
+    color *= exposure;
+    vec3 over = max(color - toneKnee, 0.0);
+    float range = 1.0 - toneKnee;
+    vec3 rolled = toneKnee + range * (1.0 - exp(-over / range));
+    return mix(color, rolled, step(toneKnee, color));
+}
+
+vec3 grade(vec3 color)
+{
+    float luma = dot(color, vec3(0.2126, 0.7152, 0.0722));
+    color = mix(vec3(luma), color, saturation);
+    color = (color - 0.5) * contrast + 0.5;
+    return max(color * gain, 0.0);
+}
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    vec3 color = texelFetch(source, texel, 0).rgb;
+
+    if ((stages & POST_TONEMAP) != 0) color = tonemap(color);
+    if ((stages & POST_GRADE) != 0) color = grade(color);
+    if ((stages & POST_VIGNETTE) != 0) {
+        vec2 uv = gl_FragCoord.xy / vec2(textureSize(source, 0));
+        float dist = length(uv - 0.5) * 1.41421356;
+        color *= 1.0 - vignetteStrength * smoothstep(vignetteRadius, 1.0, dist);
+    }
+    if ((stages & POST_FADE) != 0) color *= 1.0 - fade;
+
+    FragColor = vec4(color, 1.0);
+}
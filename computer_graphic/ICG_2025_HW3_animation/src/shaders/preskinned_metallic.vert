@@ -0,0 +1,25 @@
+#version 330 core
+// Same outputs as animated_metallic.vert, but positions/normals come from the
+// post-skin buffer written by the skinning pass.
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoord;
+
+Instance inst;
+
+out VS_OUT {
+    vec3 FragPos;
+    vec3 Normal;
+    vec2 TexCoord;
+} vs_out;
+
+void main()
+{
+    inst = FetchInstance(instanceBase + gl_InstanceID);
+
+    vs_out.Normal = inst.normalMatrix * aNormal;
+    gl_Position = inst.mvp * vec4(aPos, 1.0f);
+    
+    vs_out.FragPos = vec3(inst.model * vec4(aPos, 1.0f));
+    vs_out.TexCoord = aTexCoord;
+}
@@ -15,8 +15,7 @@ out VS_OUT {
 } gs_out;
 
 uniform float time;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat4 viewProjection;
 
 void main()
 {
@@ -29,7 +28,7 @@ void main()
         vec3 dir = gs_in[i].FragPos - center;
         vec3 newPos = center + dir * scale;
 
-        gl_Position = projection * view * vec4(newPos, 1.0);
+        gl_Position = viewProjection * vec4(newPos, 1.0);
         gs_out.FragPos = newPos;
         gs_out.Normal = gs_in[i].Normal;
         gs_out.TexCoord = gs_in[i].TexCoord;
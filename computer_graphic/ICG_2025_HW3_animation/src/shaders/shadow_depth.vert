@@ -0,0 +1,12 @@
+#version 330 core
+// Shadow caster from the post-skin buffer: the skinning pass already posed the
+// vertices, only the instance's model matrix and the light are applied
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 lightViewProjection;
+
+void main()
+{
+    mat4 model = FetchInstanceModel(instanceBase + gl_InstanceID);
+    gl_Position = lightViewProjection * model * vec4(aPos, 1.0);
+}
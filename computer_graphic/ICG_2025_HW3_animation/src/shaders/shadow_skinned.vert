@@ -0,0 +1,33 @@
+#version 330 core
+// Depth-only skinning for casters without post-skin data this frame (skipped
+// by the camera culling, or --skinning=vs): positions only, no normals
+layout (location = 0) in vec3 aPos;
+layout (location = 3) in ivec4 aBoneIDs;
+layout (location = 4) in vec4 aWeights;
+
+const int MAX_BONES = 200;
+const int MAX_BONE_INFLUENCE = 4;
+
+uniform mat4 finalBonesMatrices[MAX_BONES];
+uniform mat4 lightViewProjection;
+
+void main()
+{
+    vec4 totalPosition = vec4(0.0);
+    for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+    {
+        if (aBoneIDs[i] == -1)
+            continue;
+        if (aBoneIDs[i] >= MAX_BONES)
+        {
+            totalPosition = vec4(aPos, 1.0);
+            break;
+        }
+        totalPosition += finalBonesMatrices[aBoneIDs[i]] * vec4(aPos, 1.0) * aWeights[i];
+    }
+    if (length(totalPosition) == 0.0)
+        totalPosition = vec4(aPos, 1.0);
+
+    mat4 model = FetchInstanceModel(instanceBase + gl_InstanceID);
+    gl_Position = lightViewProjection * model * totalPosition;
+}
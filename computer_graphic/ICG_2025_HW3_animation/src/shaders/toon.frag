@@ -26,14 +26,20 @@ uniform Material material;
 uniform vec3     viewPos;
 uniform sampler2D ourTexture;
 
+// Crossfade with the impostor (impostor.frag): screen-door dither, the mesh
+// keeps the pixels the impostor discards. 0 = mesh only.
+uniform float impostorBlend;
+
 void main()
 {
+    if (bayer4(gl_FragCoord.xy) < impostorBlend) discard;
+
     vec3 norm = normalize(fs_in.Normal);
     vec3 lightDir = normalize(light.position - fs_in.FragPos);
     vec3 viewDir = normalize(viewPos - fs_in.FragPos);
 
-    // Diffuse quantization
-    float diff = max(dot(norm, lightDir), 0.0);
+    // Diffuse quantization, shadowed parts fall into the lower bands
+    float diff = max(dot(norm, lightDir), 0.0) * sunShadow(fs_in.FragPos, norm, lightDir);
     float diffuseLevels = 3.0;
     float diffStep = floor(diff * diffuseLevels) / diffuseLevels;
 
@@ -48,6 +54,17 @@ void main()
     vec3 diffuse = light.diffuse * material.diffuse * diffStep * texColor;
     vec3 specular = light.specular * material.specular * specStep;
 
+    // same bands for every clustered light
+    uvec2 range = clusterLights(fs_in.FragPos);
+    for (uint i = 0u; i < range.y; i++) {
+        vec3 L;
+        vec3 radiance = clusterLight(texelFetch(lightIndices, int(range.x + i)).r, fs_in.FragPos, L);
+        float d = max(dot(norm, L), 0.0);
+        float s = d > 0.0 ? pow(max(dot(norm, normalize(L + viewDir)), 0.0), material.gloss) : 0.0;
+        diffuse += radiance * material.diffuse * (floor(d * diffuseLevels) / diffuseLevels) * texColor;
+        specular += radiance * material.specular * step(0.6, s);
+    }
+
     FragColor = vec4(ambient + diffuse + specular, 1.0);
 }
 
@@ -0,0 +1,193 @@
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+
+#include "header/shader.h"
+#include "header/instance_buffer.h"
+#include "header/shadow_map.h"
+#include "header/gpu_memory.h"
+
+uint64_t shadow_version(const void* data, size_t bytes, uint64_t seed) {
+    const unsigned char* p = (const unsigned char*)data;
+    uint64_t hash = seed;
+    for (size_t i = 0; i < bytes; i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static void make_depth_target(unsigned int& texture, unsigned int& fbo, bool compare, const char* owner) {
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 0,
+                 GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+    gpuMemory.track(GL_OBJECT_TEXTURE, texture, GPU_MEMORY_TARGETS, owner);
+    gpuMemory.resize(GL_OBJECT_TEXTURE, texture,
+                     gpu_memory_t::texture_bytes(GL_DEPTH_COMPONENT24, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE), GL_DEPTH_COMPONENT24);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    if (compare) {
+        // hardware 2x2 PCF through sampler2DShadow, outside the map is lit
+        const float border[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    } else {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "shadow framebuffer incomplete" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+shadow_map_t::shadow_map_t(const std::string& shaderDir) {
+    preskinnedProgram = new shader_program_t();
+    preskinnedProgram->create();
+    preskinnedProgram->add_shader(shaderDir + "shadow_depth.vert", GL_VERTEX_SHADER);
+    preskinnedProgram->add_shader(shaderDir + "shadow_depth.frag", GL_FRAGMENT_SHADER);
+    preskinnedProgram->link_shader();
+
+    skinnedProgram = new shader_program_t();
+    skinnedProgram->create();
+    skinnedProgram->add_shader(shaderDir + "shadow_skinned.vert", GL_VERTEX_SHADER);
+    skinnedProgram->add_shader(shaderDir + "shadow_depth.frag", GL_FRAGMENT_SHADER);
+    skinnedProgram->link_shader();
+
+    make_depth_target(shadowTexture, shadowFBO, true, "shadow map");
+    make_depth_target(staticTexture, staticFBO, false, "static shadow cache");
+}
+
+shadow_map_t::~shadow_map_t() {
+    delete preskinnedProgram;
+    delete skinnedProgram;
+    glDeleteFramebuffers(1, &shadowFBO);
+    glDeleteFramebuffers(1, &staticFBO);
+    gpuMemory.untrack(GL_OBJECT_TEXTURE, shadowTexture);
+    gpuMemory.untrack(GL_OBJECT_TEXTURE, staticTexture);
+    glDeleteTextures(1, &shadowTexture);
+    glDeleteTextures(1, &staticTexture);
+}
+
+void shadow_map_t::set_light(const glm::vec3& direction, const glm::vec3& center, float radius) {
+    glm::vec3 dir = glm::normalize(direction);
+    glm::vec3 up = std::abs(dir.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::mat4 lightView = glm::lookAt(center - dir * (2.0f * radius), center, up);
+    glm::mat4 lightProjection = glm::ortho(-radius, radius, -radius, radius, 0.0f, 4.0f * radius);
+    glm::mat4 viewProjection = lightProjection * lightView;
+    if (viewProjection != lightViewProjection) {
+        lightViewProjection = viewProjection;
+        staticDirty = true;
+    }
+}
+
+void shadow_map_t::draw_casters(const std::vector<const shadow_caster_t*>& list) {
+    shader_program_t* current = nullptr;
+    for (const shadow_caster_t* caster : list) {
+        shader_program_t* program = caster->preskinned ? preskinnedProgram : skinnedProgram;
+        if (!program->is_ready()) continue;
+        if (program != current) {
+            program->use();
+            program->set_uniform_value("lightViewProjection", lightViewProjection);
+            program->set_uniform_value("instanceData", INSTANCE_BUFFER_TEXTURE_UNIT);
+            current = program;
+        }
+        caster->draw(program);
+        drawnCasters++;
+    }
+    if (current) current->release();
+}
+
+void shadow_map_t::render(const shadow_caster_t* casters, size_t count, unsigned int sceneFBO) {
+    bool rebuild = staticDirty;
+    for (caster_state_t& state : states) state.seen = false;
+    cachedList.clear();
+    dynamicList.clear();
+
+    for (size_t c = 0; c < count; c++) {
+        const shadow_caster_t& caster = casters[c];
+        if (caster.id >= (int)states.size()) states.resize(caster.id + 1);
+        caster_state_t& state = states[caster.id];
+        state.stableFrames = state.version == caster.version ? state.stableFrames + 1 : 0;
+        state.version = caster.version;
+        state.seen = true;
+
+        bool cache = enableCache && state.stableFrames >= SHADOW_CACHE_AFTER_FRAMES;
+        if (cache != state.cached) rebuild = true;
+        state.cached = cache;
+        (cache ? cachedList : dynamicList).push_back(&caster);
+    }
+    // a cached caster that is gone still has its depth in the static map
+    for (caster_state_t& state : states) {
+        if (!state.seen && state.cached) {
+            state.cached = false;
+            rebuild = true;
+        }
+    }
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glViewport(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_TRUE);
+    // casters outside the light's depth range still land on its near/far plane
+    glEnable(GL_DEPTH_CLAMP);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);
+
+    if (rebuild) {
+        glBindFramebuffer(GL_FRAMEBUFFER, staticFBO);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        draw_casters(cachedList);
+        staticEmpty = cachedList.empty();
+        staticRebuilds++;
+        // draw_casters skips casters whose program isn't linked yet, redo it once they are
+        staticDirty = !(preskinnedProgram->is_ready() && skinnedProgram->is_ready());
+    } else {
+        cachedCasters += cachedList.size();
+    }
+
+    if (staticEmpty) {
+        glBindFramebuffer(GL_FRAMEBUFFER, shadowFBO);
+        glClear(GL_DEPTH_BUFFER_BIT);
+    } else {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFBO);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadowFBO);
+        glBlitFramebuffer(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE,
+                          GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, shadowFBO);
+    }
+    draw_casters(dynamicList);
+
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glDisable(GL_DEPTH_CLAMP);
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void shadow_map_t::bind() {
+    glActiveTexture(GL_TEXTURE0 + SHADOW_MAP_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, shadowTexture);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void shadow_map_t::set_uniforms(shader_program_t* program) const {
+    program->set_uniform_value("shadowMap", SHADOW_MAP_TEXTURE_UNIT);
+    program->set_uniform_value("lightViewProjection", lightViewProjection);
+    program->set_uniform_value("shadowsEnabled", 1);
+}
@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "header/sim_thread.h"
+#include "header/profiler.h"
+#include "header/frame_arena.h"
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+sim_clock_t::sim_clock_t(double step, int catchUp) : stepSeconds(step), maxCatchUp(catchUp) {}
+
+void sim_clock_t::reset(double now) {
+    accumulator = 0.0;
+    lastWall = now;
+    steps = 0;
+    skippedSeconds = 0.0;
+}
+
+int sim_clock_t::advance(double now) {
+    if (deterministic) {
+        steps++;
+        return 1;
+    }
+    accumulator += now - lastWall;
+    lastWall = now;
+    int due = 0;
+    while (accumulator >= stepSeconds && due < maxCatchUp) {
+        accumulator -= stepSeconds;
+        due++;
+    }
+    if (accumulator >= stepSeconds) {
+        double dropped = std::floor(accumulator / stepSeconds) * stepSeconds;
+        skippedSeconds += dropped;
+        accumulator -= dropped;
+    }
+    steps += due;
+    return due;
+}
+
+float sim_clock_t::alpha(double now) const {
+    if (deterministic) return 1.0f;
+    return (float)std::clamp((accumulator + now - lastWall) / stepSeconds, 0.0, 1.0);
+}
+
+sim_thread_t::sim_thread_t(std::function<void()> stepFn) : step(std::move(stepFn)) {}
+
+sim_thread_t::~sim_thread_t() {
+    stop();
+}
+
+void sim_thread_t::start() {
+    if (thread.joinable()) return;
+    stopping = false;
+    thread = std::thread(&sim_thread_t::loop, this);
+}
+
+void sim_thread_t::stop() {
+    if (!thread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+}
+
+void sim_thread_t::request_step() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // one step ahead is all the triple buffer can hold without dropping
+        requested = 1;
+    }
+    wake.notify_one();
+}
+
+sim_thread_t::stats_t sim_thread_t::take_stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    stats_t result = stats;
+    stats = stats_t();
+    return result;
+}
+
+void sim_thread_t::loop() {
+    PROFILE_THREAD("sim");
+    while (true) {
+        auto idleStart = std::chrono::steady_clock::now();
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || requested > 0; });
+            if (stopping) return;
+            requested = 0;
+            stats.idleSeconds += seconds_since(idleStart);
+        }
+
+        auto stepStart = std::chrono::steady_clock::now();
+        unsigned long allocationsBefore = heap_allocations();
+        step();
+        unsigned long allocations = heap_allocations() - allocationsBefore;
+        double stepSeconds = seconds_since(stepStart);
+        // a step is this thread's frame
+        frame_arena().reset();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.steps++;
+        stats.stepSeconds += stepSeconds;
+        stats.heapAllocations += allocations;
+    }
+}
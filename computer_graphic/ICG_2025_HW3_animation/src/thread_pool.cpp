@@ -0,0 +1,82 @@
+#include <algorithm>
+
+#include "header/thread_pool.h"
+#include "header/profiler.h"
+
+thread_pool_t::thread_pool_t(unsigned int workerCount) {
+    if (workerCount == 0) {
+        unsigned int hw = std::thread::hardware_concurrency();
+        workerCount = hw > 1 ? hw - 1 : 0;
+    }
+    for (unsigned int i = 0; i < workerCount; i++) {
+        workers.emplace_back(&thread_pool_t::worker_loop, this);
+    }
+}
+
+thread_pool_t::~thread_pool_t() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void thread_pool_t::run_chunks() {
+    PROFILE_ZONE("parallel_for");
+    size_t begin;
+    while ((begin = nextItem.fetch_add(jobGrain)) < jobCount) {
+        (*job)(begin, std::min(begin + jobGrain, jobCount));
+    }
+}
+
+void thread_pool_t::worker_loop() {
+    PROFILE_THREAD("pool worker");
+    unsigned long seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+
+        run_chunks();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busyWorkers--;
+        }
+        done.notify_one();
+    }
+}
+
+void thread_pool_t::parallel_for(size_t count, size_t grain, const frame_function_t<void(size_t, size_t)>& fn) {
+    if (count == 0) return;
+    grain = std::max<size_t>(grain, 1);
+
+    // not worth waking anyone for a single chunk
+    if (workers.empty() || count <= grain) {
+        fn(0, count);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &fn;
+        jobCount = count;
+        jobGrain = grain;
+        nextItem = 0;
+        busyWorkers = workers.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    run_chunks();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return busyWorkers == 0; });
+    job = nullptr;
+}